@@ -2,31 +2,82 @@
 
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "InetAddress.h"
+#include "ListenerHandoff.h"
 #include "Logger.h"
 
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    int protocol = (family == AF_UNIX) ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
     if (sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d\n",
                   __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return sockfd;
+}
+
+// 优先使用从旧进程交接过来的同一地址的监听socket
+static int openListenSocket(const InetAddress &listenAddr)
+{
+    int sockfd = ListenerHandoff::takeInherited(listenAddr);
+    return sockfd >= 0 ? sockfd : createNonblocking(listenAddr.family());
+}
+
+static bool isListening(int sockfd)
+{
+    int on = 0;
+    socklen_t len = sizeof on;
+    return ::getsockopt(sockfd, SOL_SOCKET, SO_ACCEPTCONN, &on, &len) == 0 && on != 0;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop),
-      acceptSocket_(createNonblocking()),
+      acceptSocket_(openListenSocket(listenAddr)),
       acceptChannel_(loop, acceptSocket_.fd()),
-      listenning_(false)
+      listenning_(false),
+      unixSocket_(listenAddr.isUnix())
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
-    acceptSocket_.bindAddress(listenAddr);
+    const bool inherited = isListening(acceptSocket_.fd());
+    if (inherited)
+    {
+        // 交接过来的socket已经bind、listen，AF_UNIX的socket文件还在使用，不能删除重建
+        std::string path = listenAddr.isUnix() ? listenAddr.toIp() : std::string();
+        if (!path.empty() && path[0] != '@')
+        {
+            unixPath_ = path;
+        }
+        LOG_INFO("Acceptor: using inherited listen fd=%d for %s\n",
+                 acceptSocket_.fd(), listenAddr.toIpPort().c_str());
+    }
+    else if (listenAddr.isUnix())
+    {
+        // 文件系统中的AF_UNIX地址，上一次运行留下的socket文件会导致bind失败，只删除socket类型的文件
+        std::string path = listenAddr.toIp();
+        struct stat st;
+        if (!path.empty() && path[0] != '@' && ::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            ::unlink(path.c_str());
+        }
+        if (!path.empty() && path[0] != '@')
+        {
+            unixPath_ = path;
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(true);
+    }
+    if (!inherited)
+    {
+        acceptSocket_.bindAddress(listenAddr);
+    }
     // TcpServer -> start() -> Acceptor->listen() -> 当有用户连接要执行回调
     // 回调需要:(将connfd打包成channel,再唤醒一个subloop，让subloop来监听后续这个connfd的事件)
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
@@ -36,15 +87,30 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (!unixPath_.empty())
+    {
+        ::unlink(unixPath_.c_str());
+    }
 }
 
 void Acceptor::listen()
 {
     listenning_ = true;
-    acceptSocket_.listen();
+    // 交接过来的socket再设置一次也没有问题，listen也只是更新backlog
+    acceptSocket_.applyListenOptions(options_, unixSocket_);
+    acceptSocket_.listen(options_.backlog);
     acceptChannel_.enableReading();
 }
 
+void Acceptor::stopListening()
+{
+    if (listenning_)
+    {
+        listenning_ = false;
+        acceptChannel_.disableAll();
+    }
+}
+
 // 当listenfd有事件发生即有新用户连接时被调用
 void Acceptor::handleRead()
 {
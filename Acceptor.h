@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <string>
 
 #include "Channel.h"
 #include "Socket.h"
@@ -22,8 +23,16 @@ public:
         newConnectionCallback_ = std::move(cb);
     }
 
+    // listen()之前设置
+    void setSocketOptions(const SocketOptions &options) { options_ = options; }
+
     bool listenning() const { return listenning_; }
     void listen();
+    // 不再accept，监听fd保持打开；已经交给新进程时，监听队列中的连接由新进程accept
+    void stopListening();
+    // 监听fd交给新进程之后调用，析构时不再删除AF_UNIX socket文件
+    void handOff() { unixPath_.clear(); }
+    int fd() const { return acceptChannel_.fd(); }
 
 private:
     void handleRead();
@@ -32,5 +41,8 @@ private:
     Socket acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
+    SocketOptions options_;
     bool listenning_;
+    const bool unixSocket_;
+    std::string unixPath_;  // 监听AF_UNIX文件路径时，析构时删除socket文件
 };
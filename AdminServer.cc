@@ -0,0 +1,213 @@
+#include "AdminServer.h"
+
+#include <stdio.h>
+
+#include <future>
+
+#include "EventLoop.h"
+#include "HttpServer.h"
+#include "TcpServer.h"
+
+// 标签值中的反斜杠、双引号和换行需要转义
+static std::string escapeLabel(const std::string &value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+using Source = std::pair<std::string, TrafficStats::Snapshot>;
+
+static void appendHeader(std::string *out, const char *metric, const char *type, const char *help)
+{
+    *out += "# HELP ";
+    *out += metric;
+    *out += ' ';
+    *out += help;
+    *out += "\n# TYPE ";
+    *out += metric;
+    *out += ' ';
+    *out += type;
+    *out += '\n';
+}
+
+static void appendSample(std::string *out, const char *metric, const std::string &labels, double value)
+{
+    char line[64];
+    snprintf(line, sizeof line, "} %.15g\n", value);
+    *out += metric;
+    *out += '{';
+    *out += labels;
+    *out += line;
+}
+
+// 每个服务器一行
+template <typename Getter>
+static void appendMetric(std::string *out, const std::vector<Source> &sources, const char *metric,
+                         const char *type, const char *help, Getter getter)
+{
+    appendHeader(out, metric, type, help);
+    for (const Source &source : sources)
+    {
+        appendSample(out, metric, "server=\"" + source.first + "\"", static_cast<double>(getter(source.second)));
+    }
+}
+
+static void appendLifetimeHistogram(std::string *out, const std::vector<Source> &sources)
+{
+    appendHeader(out, "mymuduo_connection_lifetime_seconds", "histogram", "Lifetime of closed connections.");
+    for (const Source &source : sources)
+    {
+        const TrafficStats::Snapshot &snapshot = source.second;
+        const std::string server = "server=\"" + source.first + "\"";
+        int64_t cumulative = 0;
+        for (int i = 0; i < TrafficStats::kLifetimeBuckets; ++i)
+        {
+            cumulative += snapshot.lifetimeCounts[i];
+            char le[32];
+            if (i < TrafficStats::kLifetimeBuckets - 1)
+            {
+                snprintf(le, sizeof le, ",le=\"%g\"", TrafficStats::kLifetimeBounds[i]);
+            }
+            else
+            {
+                snprintf(le, sizeof le, ",le=\"+Inf\"");
+            }
+            appendSample(out, "mymuduo_connection_lifetime_seconds_bucket", server + le, static_cast<double>(cumulative));
+        }
+        appendSample(out, "mymuduo_connection_lifetime_seconds_sum", server, snapshot.lifetimeSecondsSum);
+        appendSample(out, "mymuduo_connection_lifetime_seconds_count", server, static_cast<double>(cumulative));
+    }
+}
+
+// 耗时直方图按summary导出几个常用的百分位数
+static void appendLatencySummary(std::string *out, const std::vector<Source> &sources, const char *metric,
+                                 const char *help, LatencyHistogram TrafficStats::Snapshot::*histogram)
+{
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const std::string name(metric);
+    appendHeader(out, metric, "summary", help);
+    for (const Source &source : sources)
+    {
+        const LatencyHistogram &latency = source.second.*histogram;
+        const std::string server = "server=\"" + source.first + "\"";
+        for (double q : kQuantiles)
+        {
+            char quantile[32];
+            snprintf(quantile, sizeof quantile, ",quantile=\"%g\"", q);
+            appendSample(out, metric, server + quantile, static_cast<double>(latency.percentile(q)) / 1000000);
+        }
+        appendSample(out, (name + "_sum").c_str(), server, static_cast<double>(latency.sum()) / 1000000);
+        appendSample(out, (name + "_count").c_str(), server, static_cast<double>(latency.count()));
+    }
+}
+
+AdminServer::AdminServer(const InetAddress &listenAddr, const std::string &name)
+    : thread_(EventLoopThread::ThreadInitCallback(), name),
+      loop_(thread_.startLoop()),
+      server_(new HttpServer(loop_, listenAddr, name))
+{
+    server_->setHttpCallback(std::bind(&AdminServer::onRequest, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+AdminServer::~AdminServer()
+{
+    // HttpServer和它的连接在admin loop中销毁，之后EventLoopThread退出loop
+    std::promise<void> destroyed;
+    loop_->runInLoop([this, &destroyed]() {
+        server_.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+}
+
+void AdminServer::addServer(const TcpServer &server)
+{
+    addTrafficStats(server.name(), server.trafficStats());
+}
+
+void AdminServer::addTrafficStats(const std::string &name, const TrafficStatsPtr &stats)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    sources_.emplace_back(escapeLabel(name), stats);
+}
+
+void AdminServer::start()
+{
+    server_->start();
+}
+
+std::string AdminServer::metricsText() const
+{
+    std::vector<Source> sources;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &source : sources_)
+        {
+            sources.emplace_back(source.first, source.second->snapshot());
+        }
+    }
+
+    using Snapshot = TrafficStats::Snapshot;
+    std::string out;
+    appendMetric(&out, sources, "mymuduo_connections_opened_total", "counter", "Connections established.",
+                 [](const Snapshot &s) { return s.connectionsOpened; });
+    appendMetric(&out, sources, "mymuduo_connections_closed_total", "counter", "Connections closed.",
+                 [](const Snapshot &s) { return s.connectionsClosed; });
+    appendMetric(&out, sources, "mymuduo_connections_active", "gauge", "Connections currently open.",
+                 [](const Snapshot &s) { return s.activeConnections; });
+    appendMetric(&out, sources, "mymuduo_received_bytes_total", "counter", "Bytes read from sockets.",
+                 [](const Snapshot &s) { return s.traffic.bytesReceived; });
+    appendMetric(&out, sources, "mymuduo_sent_bytes_total", "counter", "Bytes written to sockets.",
+                 [](const Snapshot &s) { return s.traffic.bytesSent; });
+    appendMetric(&out, sources, "mymuduo_messages_received_total", "counter", "Reads delivered to the message callback.",
+                 [](const Snapshot &s) { return s.traffic.messagesReceived; });
+    appendMetric(&out, sources, "mymuduo_writes_total", "counter", "Socket writes that sent data.",
+                 [](const Snapshot &s) { return s.traffic.writes; });
+    appendMetric(&out, sources, "mymuduo_write_eagain_total", "counter", "Socket writes that filled the kernel send buffer.",
+                 [](const Snapshot &s) { return s.traffic.eagains; });
+    appendMetric(&out, sources, "mymuduo_output_buffer_bytes", "gauge", "Bytes queued in connection output buffers.",
+                 [](const Snapshot &s) { return s.traffic.outputBufferBytes; });
+    appendMetric(&out, sources, "mymuduo_output_buffer_max_bytes", "gauge",
+                 "Largest output buffer of a single connection so far.",
+                 [](const Snapshot &s) { return s.maxOutputBufferBytes; });
+    appendLifetimeHistogram(&out, sources);
+    appendLatencySummary(&out, sources, "mymuduo_request_latency_seconds",
+                         "Time from receiving data until the output buffer was fully written.",
+                         &TrafficStats::Snapshot::requestLatency);
+    appendLatencySummary(&out, sources, "mymuduo_callback_latency_seconds", "Time spent in the message callback.",
+                         &TrafficStats::Snapshot::callbackLatency);
+    return out;
+}
+
+void AdminServer::onRequest(const HttpRequest &request, HttpResponse *response) const
+{
+    if (request.path() != "/metrics")
+    {
+        response->setStatusCode(HttpResponse::k404NotFound);
+        return;
+    }
+    if (request.method() != HttpRequest::kGet && request.method() != HttpRequest::kHead)
+    {
+        response->setStatusCode(HttpResponse::k405MethodNotAllowed);
+        return;
+    }
+    response->setContentType("text/plain; version=0.0.4");
+    response->setBody(metricsText());
+}
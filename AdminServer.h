@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EventLoopThread.h"
+#include "InetAddress.h"
+#include "TrafficStats.h"
+#include "noncopyable.h"
+
+class EventLoop;
+class HttpRequest;
+class HttpResponse;
+class HttpServer;
+class TcpServer;
+
+/**
+ * 内置的管理端口 在自己的EventLoop线程中运行一个HttpServer，GET /metrics返回Prometheus文本格式的流量统计
+ * 读取统计只是把各个loop分片的计数加起来，不往业务loop投递任务；业务loop繁忙或者阻塞时照常应答
+ * 每个指标带server="<名字>"标签，名字默认是TcpServer::name()
+ */
+class AdminServer : noncopyable
+{
+public:
+    explicit AdminServer(const InetAddress &listenAddr, const std::string &name = "AdminServer");
+    ~AdminServer();
+
+    // 以下可以在任意线程调用，start()之后登记的也会导出
+    void addServer(const TcpServer &server);
+    void addTrafficStats(const std::string &name, const TrafficStatsPtr &stats);
+
+    void start();
+
+    // 所有登记的统计，Prometheus文本格式
+    std::string metricsText() const;
+
+private:
+    void onRequest(const HttpRequest &request, HttpResponse *response) const;
+
+    EventLoopThread thread_;
+    EventLoop *loop_;  // thread_中的loop，AdminServer析构时退出
+    std::unique_ptr<HttpServer> server_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::pair<std::string, TrafficStatsPtr>> sources_;
+};
@@ -0,0 +1,156 @@
+#include "AsyncLogging.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+#include "LogFile.h"
+
+AsyncLogging::AsyncLogging(const std::string &basename,
+                           off_t rollSize,
+                           int flushInterval,
+                           size_t maxBuffers)
+    : flushInterval_(flushInterval),
+      maxBuffers_(maxBuffers),
+      running_(false),
+      basename_(basename),
+      rollSize_(rollSize),
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
+      currentBuffer_(new LogBuffer),
+      nextBuffer_(new LogBuffer),
+      dropped_(0),
+      totalDropped_(0)
+{
+    buffers_.reserve(16);
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    {
+        // 在锁内修改，后端线程在锁内检查running_之后才会等待，不会错过这次通知
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void AsyncLogging::append(const char *logline, int len)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (currentBuffer_->avail() > len)
+    {
+        currentBuffer_->append(logline, len);
+        return;
+    }
+
+    // 后端写文件跟不上，积压的缓冲区已经达到上限，丢弃这条日志
+    if (buffers_.size() >= maxBuffers_)
+    {
+        ++dropped_;
+        return;
+    }
+
+    buffers_.push_back(std::move(currentBuffer_));
+    if (nextBuffer_)
+    {
+        currentBuffer_ = std::move(nextBuffer_);
+    }
+    else
+    {
+        currentBuffer_.reset(new LogBuffer);  // 很少发生
+    }
+    currentBuffer_->append(logline, len);
+    cond_.notify_one();
+}
+
+void AsyncLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_, flushInterval_);
+    BufferPtr newBuffer1(new LogBuffer);
+    BufferPtr newBuffer2(new LogBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(16);
+
+    while (running_)
+    {
+        int64_t dropped = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (buffers_.empty() && running_)
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            // 不管currentBuffer_是否写满都交换出来，保证日志最多延迟flushInterval_秒落盘
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_ = std::move(newBuffer1);
+            buffersToWrite.swap(buffers_);
+            if (!nextBuffer_)
+            {
+                nextBuffer_ = std::move(newBuffer2);
+            }
+            dropped = dropped_;
+            dropped_ = 0;
+        }
+
+        if (dropped > 0)
+        {
+            totalDropped_ += dropped;
+            char buf[128];
+            int n = snprintf(buf, sizeof buf, "Dropped %ld log messages, logging backend is overloaded\n",
+                             static_cast<long>(dropped));
+            fputs(buf, stderr);
+            output.append(buf, n);
+        }
+
+        for (const BufferPtr &buffer : buffersToWrite)
+        {
+            output.append(buffer->data(), buffer->length());
+        }
+
+        // 留下两个缓冲区用来补充newBuffer1和newBuffer2，其余的释放掉
+        if (buffersToWrite.size() > 2)
+        {
+            buffersToWrite.resize(2);
+        }
+        if (!newBuffer1)
+        {
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->reset();
+        }
+        if (!newBuffer2)
+        {
+            newBuffer2 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer2->reset();
+        }
+        buffersToWrite.clear();
+        output.flush();
+    }
+
+    // 退出前把前端剩余的日志写完
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const BufferPtr &buffer : buffers_)
+    {
+        output.append(buffer->data(), buffer->length());
+    }
+    output.append(currentBuffer_->data(), currentBuffer_->length());
+    currentBuffer_->reset();
+    buffers_.clear();
+    output.flush();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Thread.h"
+#include "noncopyable.h"
+
+// 日志前端使用的定长缓冲区
+template <int SIZE>
+class FixedBuffer : noncopyable
+{
+public:
+    FixedBuffer() : cur_(data_) {}
+
+    void append(const char *buf, size_t len)
+    {
+        if (static_cast<size_t>(avail()) > len)
+        {
+            memcpy(cur_, buf, len);
+            cur_ += len;
+        }
+    }
+
+    const char *data() const { return data_; }
+    int length() const { return static_cast<int>(cur_ - data_); }
+    int avail() const { return static_cast<int>(end() - cur_); }
+
+    void reset() { cur_ = data_; }
+
+private:
+    const char *end() const { return data_ + sizeof data_; }
+
+    char data_[SIZE];
+    char *cur_;
+};
+
+/**
+ * 异步日志 双缓冲：前端线程把日志追加到currentBuffer_，写满后交给后端线程
+ * 后端线程定期或被唤醒后交换出所有写满的缓冲区，通过LogFile写入文件
+ * 前端只做内存拷贝，不会产生系统调用；积压的缓冲区超过maxBuffers后直接丢弃新日志，内存有上界
+ * 使用：Logger::instance().setOutput(std::bind(&AsyncLogging::append, &asyncLog, _1, _2))
+ *      LOG_FATAL退出进程前会调用Logger的flush，可以设置为AsyncLogging::stop把剩余日志写完
+ */
+class AsyncLogging : noncopyable
+{
+public:
+    AsyncLogging(const std::string &basename,
+                 off_t rollSize,
+                 int flushInterval = 3,
+                 size_t maxBuffers = 16);
+    ~AsyncLogging();
+
+    // 前端接口 任意线程调用
+    void append(const char *logline, int len);
+
+    void start();
+    void stop();
+
+    // 因积压被丢弃的日志条数
+    int64_t droppedMessages() const { return totalDropped_; }
+
+private:
+    static const int kLargeBuffer = 4 * 1024 * 1024;
+
+    using LogBuffer = FixedBuffer<kLargeBuffer>;
+    using BufferVector = std::vector<std::unique_ptr<LogBuffer>>;
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+
+    void threadFunc();  // 后端线程
+
+    const int flushInterval_;
+    const size_t maxBuffers_;
+    std::atomic_bool running_;
+    const std::string basename_;
+    const off_t rollSize_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    BufferPtr currentBuffer_;  // 当前正在写入的缓冲区
+    BufferPtr nextBuffer_;     // 预备缓冲区，currentBuffer_写满后直接替换，减少前端分配内存
+    BufferVector buffers_;     // 已经写满待后端写入文件的缓冲区
+    int64_t dropped_;          // 上一次交换之后丢弃的日志条数
+
+    std::atomic<int64_t> totalDropped_;
+};
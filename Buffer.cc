@@ -1,44 +1,123 @@
 #include "Buffer.h"
 
 #include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 
+#include "Logger.h"
+
 /**
  * 从fd上读取数据，Poller工作在LT模式下
  * Buffer缓冲区是有大小的，但是从fd上读数据的时候却不知道tcp流式数据的最终大小
  */
 ssize_t Buffer::readFd(int fd, int* savedErrno)
 {
-    char extrabuf[65536] = {0};
+    char extrabuf[65536];  // 只使用readv写入的部分，不需要清零
 
     struct iovec vec[2];
     const size_t writeable = writeableBytes();  // buffer_底层缓冲区剩余可写空间大小
-    vec[0].iov_base = begin() + writerIndex_;
-    vec[0].iov_len = writeable;
-
-    vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
-
-    const int iovcnt = (writeable < sizeof extrabuf) ? 2 : 1;
-    const size_t n = ::readv(fd, vec, iovcnt);
+    int iovcnt = 0;
+    // 延迟分配的缓冲区还没有内存，只读到extrabuf中，再按实际读到的长度分配
+    if (writeable > 0)
+    {
+        vec[iovcnt].iov_base = begin() + writerIndex_;
+        vec[iovcnt].iov_len = writeable;
+        ++iovcnt;
+    }
+    if (writeable < sizeof extrabuf)
+    {
+        vec[iovcnt].iov_base = extrabuf;
+        vec[iovcnt].iov_len = sizeof extrabuf;
+        ++iovcnt;
+    }
+    const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
         *savedErrno = errno;
     }
-    else if (n <= writeable)
+    else if (static_cast<size_t>(n) <= writeable)
     {
         writerIndex_ += n;
     }
     else
     {
         // buffer_底层缓冲区可写空间都已经写满了，readv将没读完的数据写入到extrabuf中
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writeable;
         append(extrabuf, n - writeable);
     }
 
     return n;
 }
 
+ssize_t Buffer::readFd(int fd, int* savedErrno, std::vector<int>* receivedFds)
+{
+    char extrabuf[65536];
+    // 一个消息最多可以携带SCM_MAX_FD(253)个文件描述符
+    char control[CMSG_SPACE(sizeof(int) * 253)];
+
+    struct iovec vec[2];
+    const size_t writeable = writeableBytes();
+    int iovcnt = 0;
+    if (writeable > 0)
+    {
+        vec[iovcnt].iov_base = begin() + writerIndex_;
+        vec[iovcnt].iov_len = writeable;
+        ++iovcnt;
+    }
+    if (writeable < sizeof extrabuf)
+    {
+        vec[iovcnt].iov_base = extrabuf;
+        vec[iovcnt].iov_len = sizeof extrabuf;
+        ++iovcnt;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    const ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0)
+    {
+        *savedErrno = errno;
+        return n;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char* data = CMSG_DATA(cmsg);
+            for (size_t i = 0; i < count; ++i)
+            {
+                int received = -1;
+                memcpy(&received, data + i * sizeof(int), sizeof received);
+                receivedFds->push_back(received);
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        // 超出control容量的文件描述符已经被内核关闭
+        LOG_ERROR("Buffer::readFd fd=%d SCM_RIGHTS truncated\n", fd);
+    }
+
+    if (static_cast<size_t>(n) <= writeable)
+    {
+        writerIndex_ += n;
+    }
+    else
+    {
+        writerIndex_ += writeable;
+        append(extrabuf, n - writeable);
+    }
+    return n;
+}
+
 // 通过fd发送数据
 ssize_t Buffer::writeFd(int fd, int* saveErrno)
 {
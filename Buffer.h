@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -24,8 +25,9 @@ public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
 
+    // initialSize为0时不预先分配内存，第一次写入数据时再分配，空闲的连接不占用缓冲区内存
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize),
+        : buffer_(initialSize > 0 ? kCheapPrepend + initialSize : 0),
           readerIndex_(kCheapPrepend),
           writerIndex_(kCheapPrepend)
     {
@@ -38,7 +40,7 @@ public:
 
     size_t writeableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0;
     }
 
     size_t prependableBytes() const
@@ -52,6 +54,12 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 协议层可以原地修改还没有取走的数据，例如WebSocket原地去掩码
+    char* peek()
+    {
+        return begin() + readerIndex_;
+    }
+
     // 缓冲区中内数据已经被读取转换成string类型后，对缓冲区进行复位
     void retrieve(size_t len)
     {
@@ -100,6 +108,43 @@ public:
         writerIndex_ += len;
     }
 
+    void append(const std::string& str)
+    {
+        append(str.data(), str.size());
+    }
+
+    // 直接写入beginWrite()之后，再调用hasWritten()提交写入的长度
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
+    // 撤销最后写入的len个字节
+    void unwrite(size_t len)
+    {
+        writerIndex_ -= len;
+    }
+
+    // 在[start, beginWrite())中查找"\r\n"，返回'\r'的位置，找不到返回nullptr
+    const char* findCRLF(const char* start) const
+    {
+        const char* end = beginWrite();
+        while (start < end)
+        {
+            const char* cr = static_cast<const char*>(memchr(start, '\r', end - start));
+            if (cr == nullptr || cr + 1 >= end)
+            {
+                return nullptr;
+            }
+            if (cr[1] == '\n')
+            {
+                return cr;
+            }
+            start = cr + 1;
+        }
+        return nullptr;
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -112,18 +157,20 @@ public:
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
+    // 从AF_UNIX socket上读取数据，同时收下对端通过SCM_RIGHTS发送的文件描述符，追加到receivedFds
+    ssize_t readFd(int fd, int* saveErrno, std::vector<int>* receivedFds);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int* saveErrno);
 
 private:
     char* begin()
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
 
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
 
     void makeSpace(size_t len)
@@ -135,7 +182,12 @@ private:
          * kCheapPrepend  |~~~|  reader  |    writer  |
          * kCheapPrepend  |                len                |
          */
-        if (writeableBytes() + prependableBytes() < len + kCheapPrepend)
+        if (buffer_.empty())
+        {
+            // 延迟分配的缓冲区第一次写入，至少分配kInitialSize
+            buffer_.resize(writerIndex_ + (len > kInitialSize ? len : kInitialSize));
+        }
+        else if (writeableBytes() + prependableBytes() < len + kCheapPrepend)
         {
             buffer_.resize(writerIndex_ + len);
         }
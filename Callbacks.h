@@ -5,7 +5,9 @@
 
 class Timestamp;
 class Buffer;
+class InetAddress;
 class TcpConnection;
+class UdpChannel;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
@@ -14,4 +16,12 @@ using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void(const TcpConnectionPtr&,
                                            Buffer*,
                                            Timestamp)>;
-using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+using LowWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+using TimerCallback = std::function<void()>;
+// 收到一个数据报 data只在回调期间有效，回复可以直接调用channel->send()
+using UdpMessageCallback = std::function<void(UdpChannel*,
+                                              const InetAddress& peer,
+                                              const char* data,
+                                              size_t len,
+                                              Timestamp)>;
@@ -4,6 +4,7 @@
 
 #include "EventLoop.h"
 #include "Logger.h"
+#include "Trace.h"
 
 const int Channel::KNoneEvent = 0;
 const int Channel::KReadEvent = EPOLLIN | EPOLLPRI;
@@ -42,6 +43,7 @@ void Channel::remove()
 // fd得到Poller通知以后，处理事件的回调方法
 void Channel::handleEvent(Timestamp receiveTime)
 {
+    TraceScope trace("Channel::handleEvent", fd_, revents_);
     std::shared_ptr<void> guard;
     if (tied_)  // FIXME:
     {
@@ -60,9 +62,9 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的具体事件，由channel负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d", revents_);
 
-    if ((revents_ & EPOLLHUP) && !(revents_ && EPOLLIN))
+    if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
         if (closeCallback_)
         {
@@ -66,8 +66,8 @@ public:
 
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == KNoneEvent; }
-    bool isReadEvent() const { return events_ == KReadEvent; }
-    bool isWriteEvent() const { return events_ == KWriteEvent; }
+    bool isReadEvent() const { return events_ & KReadEvent; }
+    bool isWriteEvent() const { return events_ & KWriteEvent; }
 
     int index() { return index_; }
     void set_index(int index) { index_ = index; }
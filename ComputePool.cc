@@ -0,0 +1,317 @@
+#include "ComputePool.h"
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+#include "Thread.h"
+
+// 当前工作线程所属的线程池以及在线程池中的下标，工作线程中嵌套提交的任务直接放入自己的队列
+__thread ComputePool *t_computePool = nullptr;
+__thread int t_workerIndex = -1;
+
+ComputePool::ComputePool(const std::string &nameArg)
+    : name_(nameArg),
+      numThreads_(0),
+      started_(false),
+      running_(false),
+      next_(0),
+      pending_(0),
+      idle_(0)
+{
+}
+
+ComputePool::~ComputePool()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void ComputePool::start()
+{
+    if (numThreads_ <= 0)
+    {
+        LOG_FATAL("ComputePool %s needs at least one thread\n", name_.c_str());
+    }
+    started_ = true;
+    running_ = true;
+
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    // 所有队列创建完成后再启动线程，窃取任务时遍历workers_不需要加锁
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        char buf[name_.size() + 32];
+        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
+        workers_[i]->thread.reset(new Thread(std::bind(&ComputePool::threadFunc, this, i), buf));
+        workers_[i]->thread->start();
+    }
+}
+
+void ComputePool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker->thread->join();
+    }
+
+    // push()在队列锁内检查running_，和stop()并发的提交可能在工作线程退出后才入队，
+    // 这里在同一把锁内把它们取出来直接执行，之后的提交都会被拒绝
+    for (auto &worker : workers_)
+    {
+        std::deque<Job *> jobs;
+        {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            jobs.swap(worker->jobs);
+        }
+        for (Job *job : jobs)
+        {
+            --pending_;
+            execute(job);
+        }
+    }
+}
+
+void ComputePool::submit(const TcpConnectionPtr &conn, Task task, Task done)
+{
+    EventLoop *loop = conn->getLoop();
+    // 序号只在conn所属的loop线程中分配，保证同一连接的顺序不需要加锁
+    if (!loop->isInLoopThread())
+    {
+        loop->runInLoop(std::bind(&ComputePool::submit, this, conn, std::move(task), std::move(done)));
+        return;
+    }
+
+    std::shared_ptr<LoopInbox> inbox = inboxOf(loop);
+    Job *job = new Job;
+    job->task = std::move(task);
+    job->done = std::move(done);
+    job->conn = conn;
+    job->seq = inbox->nextSeq(conn.get());
+    job->inbox = std::move(inbox);
+    if (!push(job))
+    {
+        // 被拒绝的任务归还序号，否则这个连接之后的done永远等不到它
+        job->inbox->cancelSeq(conn.get());
+        delete job;
+    }
+}
+
+void ComputePool::run(Task task)
+{
+    Job *job = new Job;
+    job->task = std::move(task);
+    job->seq = 0;
+    if (!push(job))
+    {
+        delete job;
+    }
+}
+
+std::shared_ptr<ComputePool::LoopInbox> ComputePool::inboxOf(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(inboxMutex_);
+    std::shared_ptr<LoopInbox> &inbox = inboxes_[loop];
+    if (!inbox)
+    {
+        inbox.reset(new LoopInbox(loop));
+    }
+    return inbox;
+}
+
+bool ComputePool::push(Job *job)
+{
+    // start()之前workers_为空，无法选择工作线程
+    if (!started_)
+    {
+        LOG_ERROR("ComputePool %s: submit before start(), task rejected\n", name_.c_str());
+        return false;
+    }
+
+    int index = 0;
+    if (t_computePool == this)
+    {
+        index = t_workerIndex;
+    }
+    else
+    {
+        index = next_++ % workers_.size();
+    }
+
+    Worker *worker = workers_[index].get();
+    bool accepted = false;
+    {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        // stop()期间工作线程嵌套提交的任务照常执行；其他线程在stop()之后提交的任务直接拒绝
+        // 检查和入队在同一把锁内，stop()最后取剩余任务时不会漏掉
+        if (running_ || t_computePool == this)
+        {
+            worker->jobs.push_back(job);
+            accepted = true;
+        }
+    }
+    if (!accepted)
+    {
+        LOG_ERROR("ComputePool %s: submit after stop(), task rejected\n", name_.c_str());
+        return false;
+    }
+
+    // 先增加pending_再检查idle_，与工作线程先增加idle_再检查pending_相对应，不会丢失唤醒
+    ++pending_;
+    if (idle_ > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+        }
+        cond_.notify_one();
+    }
+    return true;
+}
+
+// 先从自己的队尾取任务，没有任务时依次从其他线程的队头窃取
+ComputePool::Job *ComputePool::take(int index)
+{
+    Job *job = nullptr;
+    {
+        Worker *self = workers_[index].get();
+        std::unique_lock<std::mutex> lock(self->mutex);
+        if (!self->jobs.empty())
+        {
+            job = self->jobs.back();
+            self->jobs.pop_back();
+        }
+    }
+
+    const int n = static_cast<int>(workers_.size());
+    for (int i = 1; job == nullptr && i < n; ++i)
+    {
+        Worker *victim = workers_[(index + i) % n].get();
+        std::unique_lock<std::mutex> lock(victim->mutex);
+        if (!victim->jobs.empty())
+        {
+            job = victim->jobs.front();
+            victim->jobs.pop_front();
+        }
+    }
+
+    if (job != nullptr)
+    {
+        --pending_;
+    }
+    return job;
+}
+
+void ComputePool::execute(Job *job)
+{
+    job->task();
+    if (job->inbox)
+    {
+        job->inbox->complete(job);
+    }
+    else
+    {
+        delete job;
+    }
+}
+
+// 工作线程函数
+void ComputePool::threadFunc(int index)
+{
+    t_computePool = this;
+    t_workerIndex = index;
+
+    while (true)
+    {
+        Job *job = take(index);
+        if (job != nullptr)
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        ++idle_;
+        cond_.wait(lock, [this]() { return pending_ > 0 || !running_; });
+        --idle_;
+        // stop()之后也要把已经提交的任务执行完
+        if (!running_ && pending_ == 0)
+        {
+            break;
+        }
+    }
+
+    t_computePool = nullptr;
+    t_workerIndex = -1;
+}
+
+void ComputePool::LoopInbox::complete(Job *job)
+{
+    // job放入completed_之后随时可能被loop线程释放，先拷贝一份inbox
+    std::shared_ptr<LoopInbox> self = job->inbox;
+    bool wasEmpty = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wasEmpty = completed_.empty();
+        completed_.push_back(job);
+    }
+
+    // 只有第一个完成的任务负责唤醒loop，后续完成的任务在drain执行前都会合并到同一批
+    if (wasEmpty)
+    {
+        loop_->queueInLoop(std::bind(&LoopInbox::drain, self));
+    }
+}
+
+void ComputePool::LoopInbox::cancelSeq(const TcpConnection *conn)
+{
+    auto it = orders_.find(conn);
+    Order &order = it->second;
+    --order.nextSubmit;
+    if (order.nextDeliver == order.nextSubmit)
+    {
+        orders_.erase(it);
+    }
+}
+
+void ComputePool::LoopInbox::drain()
+{
+    std::vector<Job *> jobs;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        jobs.swap(completed_);
+    }
+
+    for (Job *job : jobs)
+    {
+        auto it = orders_.find(job->conn.get());
+        Order &order = it->second;
+        order.ready[job->seq] = job;
+
+        // 按提交顺序执行已经完成的done，前面的任务未完成时后面的任务继续等待
+        auto ready = order.ready.begin();
+        while (ready != order.ready.end() && ready->first == order.nextDeliver)
+        {
+            Job *next = ready->second;
+            if (next->done)
+            {
+                next->done();
+            }
+            delete next;
+            ready = order.ready.erase(ready);
+            ++order.nextDeliver;
+        }
+
+        if (order.nextDeliver == order.nextSubmit)
+        {
+            orders_.erase(it);
+        }
+    }
+}
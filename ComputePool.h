@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Callbacks.h"
+#include "noncopyable.h"
+
+class EventLoop;
+class Thread;
+
+/**
+ * 计算线程池 用于把onMessage中CPU密集的工作(压缩、加解密、查询计算)从subloop中卸载出去
+ * 每个工作线程拥有一个任务双端队列，从自己的队尾取任务，空闲时从其他线程的队头窃取任务
+ * 任务完成后的done回调投递回conn->getLoop()执行，同一个连接的done严格按照submit的顺序执行
+ */
+class ComputePool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ComputePool(const std::string &nameArg = std::string("ComputePool"));
+    ~ComputePool();
+
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+
+    void start();
+    void stop();  // 执行完所有已提交的任务后退出工作线程
+
+    // task在工作线程中执行，执行完成后done在conn所属的loop中执行
+    // start()之前或者stop()之后调用会被拒绝并记录错误，task和done都不会执行
+    void submit(const TcpConnectionPtr &conn, Task task, Task done);
+    // 不需要把结果投递回loop的任务，调用时机的要求同submit()
+    void run(Task task);
+
+    bool started() const { return started_; }
+    const std::string &name() const { return name_; }
+
+private:
+    class LoopInbox;
+
+    // 一次提交的任务
+    struct Job
+    {
+        Task task;
+        Task done;
+        TcpConnectionPtr conn;
+        uint64_t seq;
+        std::shared_ptr<LoopInbox> inbox;
+    };
+
+    // 每个工作线程的任务队列，队尾由本线程使用，队头给其他线程窃取
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job *> jobs;
+        std::unique_ptr<Thread> thread;
+    };
+
+    /**
+     * 每个EventLoop对应一个LoopInbox，收集工作线程完成的任务
+     * 只有inbox由空变为非空时才queueInLoop一次，一批完成的任务只需要唤醒loop一次
+     */
+    class LoopInbox : noncopyable
+    {
+    public:
+        explicit LoopInbox(EventLoop *loop) : loop_(loop) {}
+
+        // 以下两个方法只在loop_线程中调用
+        uint64_t nextSeq(const TcpConnection *conn) { return orders_[conn].nextSubmit++; }
+        void cancelSeq(const TcpConnection *conn);  // 撤销刚刚分配的序号
+        void drain();
+
+        // 工作线程调用
+        void complete(Job *job);
+
+    private:
+        // 单个连接的完成顺序，乱序完成的任务暂存在ready中
+        struct Order
+        {
+            Order() : nextSubmit(0), nextDeliver(0) {}
+            uint64_t nextSubmit;
+            uint64_t nextDeliver;
+            std::map<uint64_t, Job *> ready;
+        };
+
+        EventLoop *loop_;
+        std::unordered_map<const TcpConnection *, Order> orders_;
+
+        std::mutex mutex_;
+        std::vector<Job *> completed_;
+    };
+
+    void threadFunc(int index);
+    bool push(Job *job);  // 被拒绝时返回false，job仍归调用者所有
+    Job *take(int index);
+    void execute(Job *job);
+    std::shared_ptr<LoopInbox> inboxOf(EventLoop *loop);
+
+    std::string name_;
+    int numThreads_;
+    bool started_;
+    std::atomic_bool running_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic_uint next_;  // 非工作线程提交任务时轮询选择工作线程
+
+    std::atomic_int pending_;  // 所有队列中尚未被取走的任务数
+    std::atomic_int idle_;     // 正在等待任务的工作线程数
+    std::mutex sleepMutex_;
+    std::condition_variable cond_;
+
+    std::mutex inboxMutex_;
+    std::unordered_map<EventLoop *, std::shared_ptr<LoopInbox>> inboxes_;
+};
@@ -0,0 +1,108 @@
+#include "ConnectionPool.h"
+
+#include <algorithm>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpClient.h"
+
+ConnectionPool::ConnectionPool(EventLoop *loop,
+                               const InetAddress &serverAddr,
+                               const std::string &nameArg,
+                               int size)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      name_(nameArg),
+      size_(size)
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+}
+
+void ConnectionPool::start()
+{
+    for (int i = 0; i < size_; ++i)
+    {
+        char buf[name_.size() + 32];
+        snprintf(buf, sizeof buf, "%s-%d", name_.c_str(), i);
+        TcpClient *client = new TcpClient(loop_, serverAddr_, buf);
+        client->setConnectionCallback(std::bind(&ConnectionPool::onConnection, this, std::placeholders::_1));
+        client->setMessageCallback(messageCallback_);
+        client->enableRetry();
+        clients_.push_back(std::unique_ptr<TcpClient>(client));
+        client->connect();
+    }
+}
+
+bool ConnectionPool::inLoopThread() const
+{
+    if (!loop_->isInLoopThread())
+    {
+        LOG_ERROR("ConnectionPool %s used outside its loop thread\n", name_.c_str());
+        return false;
+    }
+    return true;
+}
+
+TcpConnectionPtr ConnectionPool::acquire()
+{
+    TcpConnectionPtr conn;
+    if (!inLoopThread())
+    {
+        return conn;
+    }
+
+    while (!idle_.empty() && !conn)
+    {
+        conn = idle_.back();
+        idle_.pop_back();
+        if (!conn->connected())
+        {
+            conn.reset();
+        }
+    }
+    return conn;
+}
+
+void ConnectionPool::release(const TcpConnectionPtr &conn)
+{
+    if (!loop_->isInLoopThread())
+    {
+        // 在其他线程中用完的连接也要回到池中，转到loop_线程执行
+        loop_->runInLoop(std::bind(&ConnectionPool::release, this, conn));
+        return;
+    }
+    if (!conn->connected())
+    {
+        return;
+    }
+    // 重复归还时不能再放入一次，否则两个使用者会取到同一个连接
+    if (std::find(idle_.begin(), idle_.end(), conn) != idle_.end())
+    {
+        LOG_ERROR("ConnectionPool %s: %s released twice\n", name_.c_str(), conn->name().c_str());
+        return;
+    }
+    // 恢复池的默认回调，避免上一个使用者的回调继续收到数据
+    conn->setMessageCallback(messageCallback_);
+    idle_.push_back(conn);
+}
+
+// 池中连接建立和断开的回调 在loop_线程中执行
+void ConnectionPool::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        idle_.push_back(conn);
+    }
+    else
+    {
+        idle_.erase(std::remove(idle_.begin(), idle_.end(), conn), idle_.end());
+    }
+
+    if (connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "noncopyable.h"
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * 同一个loop上到某个后端的出站连接池
+ * 池中的连接全部属于loop_，handler在loop_线程中取出已经建立好的连接直接使用，不需要跨线程
+ * 连接断开后自动重连，重连成功后重新放回空闲列表
+ * 多个subloop各自创建自己的ConnectionPool，例如在TcpServer的ThreadInitCallback中创建
+ */
+class ConnectionPool : noncopyable
+{
+public:
+    ConnectionPool(EventLoop *loop,
+                   const InetAddress &serverAddr,
+                   const std::string &nameArg,
+                   int size);
+    ~ConnectionPool();
+
+    // 空闲连接的默认回调，连接被取出后可以由使用者重新设置
+    void setConnectionCallback(ConnectionCallback cb) { connectionCallback_ = std::move(cb); }
+    void setMessageCallback(MessageCallback cb) { messageCallback_ = std::move(cb); }
+
+    void start();  // 建立size个连接
+
+    // 只能在loop_线程中调用 取出一个空闲的连接，没有空闲连接时返回nullptr
+    TcpConnectionPtr acquire();
+    // 归还连接，已经断开的连接直接丢弃，重复归还会被忽略；在其他线程中调用时转到loop_线程执行
+    void release(const TcpConnectionPtr &conn);
+
+    size_t idleCount() const { return idle_.size(); }  // 只能在loop_线程中调用
+    EventLoop *getLoop() const { return loop_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    bool inLoopThread() const;
+
+    EventLoop *loop_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+    const int size_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+    std::vector<TcpConnectionPtr> idle_;  // 后进先出，优先使用最近使用过的连接
+};
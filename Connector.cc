@@ -0,0 +1,216 @@
+#include "Connector.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+static int createNonblocking(sa_family_t family)
+{
+    int protocol = (family == AF_UNIX) ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d\n",
+                  __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = static_cast<socklen_t>(sizeof optval);
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本地端口和目的端口相同时，没有监听者的情况下connect会连到自己，AF_UNIX没有这个问题
+static bool isSelfConnect(int sockfd)
+{
+    InetAddress local = InetAddress::localAddressOf(sockfd);
+    InetAddress peer = InetAddress::peerAddressOf(sockfd);
+    if (local.isUnix())
+    {
+        return false;
+    }
+    return local.getSockAddr()->sin_port == peer.getSockAddr()->sin_port &&
+           local.getSockAddr()->sin_addr.s_addr == peer.getSockAddr()->sin_addr.s_addr;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connect_(false),
+      state_(kDisconnected),
+      retryDelayMs_(kInitRetryDelayMs)
+{
+}
+
+Connector::~Connector()
+{
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if (connect_)
+    {
+        connect();
+    }
+}
+
+// 连接断开后重新连接，重置退避间隔
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    loop_->cancel(retryTimer_);
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        retry(sockfd);  // connect_已经为false，只会关闭sockfd
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.sockAddr(), serverAddr_.sockAddrLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case ENOENT:  // AF_UNIX的监听者还没有创建socket文件
+        retry(sockfd);
+        break;
+
+    default:
+        LOG_ERROR("Connector::connect error:%d\n", savedErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+// 等待sockfd可写，可写时连接要么建立成功要么出错
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前正处于channel的回调中，不能在这里释放channel
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        if (err)
+        {
+            LOG_ERROR("Connector::handleWrite - SO_ERROR = %d\n", err);
+            retry(sockfd);
+        }
+        else if (isSelfConnect(sockfd))
+        {
+            LOG_ERROR("Connector::handleWrite - Self connect\n");
+            retry(sockfd);
+        }
+        else
+        {
+            setState(kConnected);
+            if (connect_ && newConnectionCallback_)
+            {
+                newConnectionCallback_(sockfd);
+            }
+            else
+            {
+                ::close(sockfd);
+            }
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_ERROR("Connector::handleError - SO_ERROR = %d\n", err);
+        retry(sockfd);
+    }
+}
+
+// 关闭本次失败的sockfd，退避一段时间后重新connect
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (connect_)
+    {
+        LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds\n",
+                 serverAddr_.toIpPort().c_str(), retryDelayMs_);
+        retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0,
+                                      std::bind(&Connector::startInLoop, shared_from_this()));
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "InetAddress.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接 非阻塞connect，通过channel的可写事件得知连接是否建立
+ * 连接失败后按指数退避的间隔重试，连接建立后把sockfd交给newConnectionCallback_
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+
+    void start();    // 可以在任意线程调用
+    void restart();  // 只能在loop线程调用
+    void stop();     // 可以在任意线程调用
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected,
+    };
+    static const int kMaxRetryDelayMs = 30 * 1000;
+    static const int kInitRetryDelayMs = 500;
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+    TimerId retryTimer_;
+};
@@ -9,7 +9,7 @@ namespace CurrentThread
         if (t_cachedTid == 0)
         {
             // 通过Linux系统调用获取当前的线程的tid
-            t_cachedTid = static_cast<pid_t>(::syscall(SYS_getpid));
+            t_cachedTid = static_cast<pid_t>(::syscall(SYS_gettid));
         }
     }
 
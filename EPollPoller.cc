@@ -33,7 +33,7 @@ EPollPoller::~EPollPoller()
 // epoll_wait
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList* artiveChannels)
 {
-    LOG_INFO("func=%s -> fd total count:%lu\n", __FUNCTION__, channels_.size());
+    LOG_DEBUG("func=%s -> fd total count:%lu\n", __FUNCTION__, channels_.size());
 
     int numEvents = ::epoll_wait(epollfd_,
                                  &*events_.begin(),  // 容器第一个元素的地址
@@ -43,7 +43,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList* artiveChannels)
     Timestamp now(Timestamp::now());
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happend\n", numEvents);
+        LOG_DEBUG("%d events happend\n", numEvents);
         fillActiveChannels(numEvents, artiveChannels);
         if (numEvents == events_.size())
         {
@@ -70,7 +70,7 @@ void EPollPoller::updateChannel(Channel* channel)
 {
     const int index = channel->index();
     int fd = channel->fd();
-    LOG_INFO("func:%s -> fd=%d events=%d index=%d \n", __FUNCTION__, fd, channel->events(), index);
+    LOG_DEBUG("func:%s -> fd=%d events=%d index=%d \n", __FUNCTION__, fd, channel->events(), index);
 
     if (index == kNew || index == kDeleted)
     {
@@ -101,7 +101,7 @@ void EPollPoller::removeChannel(Channel* channel)
 {
     int fd = channel->fd();
     channels_.erase(fd);
-    LOG_INFO("func:%s -> fd=%d \n", __FUNCTION__, fd);
+    LOG_DEBUG("func:%s -> fd=%d \n", __FUNCTION__, fd);
 
     int index = channel->index();
     if (index == kAdded)
@@ -131,8 +131,7 @@ void EPollPoller::update(int operation, Channel* channel)
     int fd = channel->fd();
 
     event.events = channel->events();
-    event.data.ptr = channel;
-    event.data.fd = fd;
+    event.data.ptr = channel;  // data是union，不能再设置data.fd覆盖掉channel指针
 
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
@@ -11,10 +12,21 @@
 #include "EPollPoller.h"
 #include "Logger.h"
 #include "Poller.h"
+#include "Slab.h"
+#include "TimerQueue.h"
+#include "Trace.h"
 
 // 防止一个线程创建多个EventLoop
 __thread EventLoop *t_loopInThisThread = nullptr;
 
+// 对端关闭连接后继续写socket会触发SIGPIPE，默认行为是终止进程，网络库统一忽略该信号
+class IgnoreSigPipe
+{
+public:
+    IgnoreSigPipe() { ::signal(SIGPIPE, SIG_IGN); }
+};
+IgnoreSigPipe initObj;
+
 // 定义默认的Poller I/O复用接口的超时时间
 const int kPollTimeMs = 10000;
 
@@ -35,9 +47,13 @@ EventLoop::EventLoop()
       quit_(false),
       callingPendingFunctors_(false),
       threadId_(CurrentThread::tid()),
+      pollReturnTime_(Timestamp::now()),
+      pollReturnMicros_(Timestamp::monotonicMicroSeconds()),
       poller_(Poller::newDefaultPoller(this)),
+      timerQueue_(new TimerQueue(this)),
       wakeupFd_(createEventFd()),
-      wakeupChannel_(new Channel(this, wakeupFd_))
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      connectionSlab_(std::make_shared<Slab>())
 {
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     if (t_loopInThisThread)
@@ -66,16 +82,22 @@ EventLoop::~EventLoop()
 // 开启事件循环
 void EventLoop::loop()
 {
+    // 不在开始时重置quit_：其他线程在loop()开始之前调用的quit()不能丢失(例如EventLoopThread刚启动就析构)
+    // 退出时重置，同一个loop可以再次调用loop()
     looping_ = true;
-    quit_ = false;
 
     LOG_INFO("EventLoop %p start loop\n", this);
 
     while (!quit_)
     {
         activeChannels_.clear();
-        // epoll_wait 会监听到两种fd，一种是用户client fd，一种是各个loop之间的wakeup fd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        {
+            TraceScope trace("EventLoop::poll");
+            // epoll_wait 会监听到两种fd，一种是用户client fd，一种是各个loop之间的wakeup fd
+            pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+            pollReturnMicros_ = Timestamp::monotonicMicroSeconds();
+            trace.setArg0(static_cast<int32_t>(activeChannels_.size()));
+        }
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生事件了，然后上报给EventLoop来通知channel处理相应的事件
@@ -83,8 +105,10 @@ void EventLoop::loop()
         }
         // 执行当前EventLoop事件循环需要处理的回调操作
         doPendingFunctors();
+        doBeforePollFunctors();
     }
     LOG_INFO("EventLoop %p stop looping\n", this);
+    quit_ = false;
     looping_ = false;
 }
 
@@ -156,6 +180,28 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 // 执行回调
 void EventLoop::doPendingFunctors()
 {
@@ -167,6 +213,7 @@ void EventLoop::doPendingFunctors()
         // 不影响mainloop继续向pendingFunctors_放入回调
         functors.swap(pendingFunctors_);
     }
+    TraceScope trace("EventLoop::doPendingFunctors", static_cast<int32_t>(functors.size()));
 
     for (const Functor &functor : functors)
     {
@@ -175,6 +222,26 @@ void EventLoop::doPendingFunctors()
     callingPendingFunctors_ = false;
 }
 
+void EventLoop::doBeforePollFunctors()
+{
+    if (beforePollFunctors_.empty())
+    {
+        return;
+    }
+    // 这期间queueInLoop的回调要唤醒下一次poll，否则会等到超时
+    callingPendingFunctors_ = true;
+    while (!beforePollFunctors_.empty())
+    {
+        std::vector<Functor> functors;
+        functors.swap(beforePollFunctors_);
+        for (const Functor &functor : functors)
+        {
+            functor();
+        }
+    }
+    callingPendingFunctors_ = false;
+}
+
 // Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -188,5 +255,5 @@ void EventLoop::removeChannel(Channel *channel)
 
 bool EventLoop::hasChannel(Channel *channel)
 {
-    poller_->hasChannel(channel);
+    return poller_->hasChannel(channel);
 }
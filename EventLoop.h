@@ -6,12 +6,16 @@
 #include <mutex>
 #include <vector>
 
+#include "Callbacks.h"
 #include "CurrentThread.h"
+#include "TimerId.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 class Channel;
 class Poller;
+class Slab;
+class TimerQueue;
 
 /**
  * 事件循环类 主要包含了两个大模块 Channel 和 Poller(epoll的抽象)
@@ -27,24 +31,43 @@ public:
     void loop();  // 开启事件循环
     void quit();  // 退出事件循环
 
+    // 本轮循环缓存的当前时间，每次poll返回时刷新一次，loop线程中代替时钟调用使用
+    // 单调时钟(微秒)，不受系统时间调整的影响，用于测量耗时，和Timestamp::monotonicMicroSeconds()可以相减
+    int64_t monotonicMicros() const { return pollReturnMicros_; }
+    // 墙上时间，用于receiveTime、日志和对外展示
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    Timestamp now() const { return pollReturnTime_; }
 
     void runInLoop(Functor cb);    // 在当前loop中执行cb
     void queueInLoop(Functor cb);  // 把cb放入到队列中，唤醒loop所在的线程，执行cb
 
     void wakeup();  // 唤醒loop所在的线程
 
+    // 本轮的事件和回调都处理完、下一次poll之前在loop线程中执行cb，只能在loop线程中调用
+    // 用于把一轮中的多次操作合并成一次，例如TcpConnection合并多次send()
+    void runBeforePoll(Functor cb) { beforePollFunctors_.push_back(std::move(cb)); }
+
+    // 定时器 线程安全，回调在loop所在线程中执行
+    TimerId runAt(Timestamp time, TimerCallback cb);      // 在time时刻执行cb
+    TimerId runAfter(double delay, TimerCallback cb);     // delay秒后执行cb
+    TimerId runEvery(double interval, TimerCallback cb);  // 每隔interval秒执行一次cb
+    void cancel(TimerId timerId);
+
     // Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // 本loop上的TcpConnection从这里分配，可以在任意线程中释放
+    const std::shared_ptr<Slab> &connectionSlab() const { return connectionSlab_; }
+
     // 判断EventLoop对象是否在当前线程里面
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
 private:
     void handleRead();         // wake up
     void doPendingFunctors();  // 执行回调
+    void doBeforePollFunctors();
 
     using ChannelList = std::vector<Channel *>;
 
@@ -54,7 +77,9 @@ private:
     const pid_t threadId_;  // 记录当前loop所在的线程id
 
     Timestamp pollReturnTime_;  // poller返回事件的channel的时间点
+    int64_t pollReturnMicros_;  // 同一时刻的单调时钟 只在loop线程中访问
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_;
 
     // 当mainloop获取到一个新的channel，通过轮询算法选择一个subloop，通过该成员唤醒subloop处理channel
     int wakeupFd_;
@@ -62,7 +87,11 @@ private:
 
     ChannelList activeChannels_;
 
+    std::shared_ptr<Slab> connectionSlab_;
+
     std::atomic_bool callingPendingFunctors_;  // 标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_;     // 存储loop需要执行的所有回调操作
     std::mutex mutex_;                         // 保护pendingFunctors_的线程安全
+
+    std::vector<Functor> beforePollFunctors_;  // 只在loop线程中访问
 };
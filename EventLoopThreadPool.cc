@@ -3,7 +3,7 @@
 #include "EventLoopThread.h"
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
-    : baseLoop_(baseLoop_),
+    : baseLoop_(baseLoop),
       name_(nameArg),
       started_(false),
       numThreads_(0),
@@ -30,7 +30,7 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 
     // 整个服务端只有一个线程运行着baseLoop
-    if (numThreads_ == 0)
+    if (numThreads_ == 0 && cb)
     {
         cb(baseLoop_);
     }
@@ -45,7 +45,7 @@ EventLoop *EventLoopThreadPool::getNextLoop()
     {
         loop = loops_[next_];  // 轮询获取下一个处理事件的loop
         ++next_;
-        if (next_ > loops_.size())
+        if (next_ >= loops_.size())
         {
             next_ = 0;
         }
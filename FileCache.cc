@@ -0,0 +1,232 @@
+#include "FileCache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iterator>
+
+#include "OpenFile.h"
+#include "Timestamp.h"
+
+FileCache::FileCache(const FileCacheOptions &options)
+    : options_(options),
+      memoryBytes_(0)
+{
+}
+
+FileCache::EntryPtr FileCache::get(const std::string &path)
+{
+    const int64_t now = Timestamp::monotonicMicroSeconds();
+    const int64_t revalidate = static_cast<int64_t>(options_.revalidateSeconds * Timestamp::kMicroSecondsPerSecond);
+
+    EntryPtr stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(path);
+        if (found != index_.end())
+        {
+            NodeList::iterator it = found->second;
+            lru_.splice(lru_.begin(), lru_, it);
+            if (now - it->validatedAt < revalidate)
+            {
+                return it->entry;
+            }
+            stale = it->entry;
+        }
+    }
+
+    // 过期的条目先stat一次，文件没有变化就继续使用
+    if (stale)
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && st.st_ino == stale->ino && st.st_dev == stale->dev &&
+            st.st_mtime == stale->mtime && st.st_size == stale->size)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(path);
+            if (found != index_.end() && found->second->entry == stale)
+            {
+                found->second->validatedAt = now;
+            }
+            return stale;
+        }
+    }
+
+    EntryPtr entry = load(path);
+    int savedErrno = errno;
+    if (entry)
+    {
+        insert(path, entry, now);
+    }
+    else if (stale)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(path);
+        if (found != index_.end())
+        {
+            eraseLocked(found->second);
+        }
+    }
+    errno = savedErrno;
+    return entry;
+}
+
+FileCache::EntryPtr FileCache::load(const std::string &path)
+{
+    std::shared_ptr<OpenFile> file = OpenFile::open(path);
+    if (!file)
+    {
+        return nullptr;
+    }
+    const struct stat &st = file->stat();
+    if (!S_ISREG(st.st_mode))
+    {
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+        return nullptr;
+    }
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->ino = st.st_ino;
+    entry->dev = st.st_dev;
+
+    if (static_cast<size_t>(st.st_size) <= options_.smallFileBytes)
+    {
+        // 小文件读入内存后关闭fd，不占用fd
+        std::shared_ptr<std::string> content = std::make_shared<std::string>(st.st_size, '\0');
+        size_t done = 0;
+        while (done < content->size())
+        {
+            ssize_t n = ::pread(file->fd(), &(*content)[done], content->size() - done, done);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            done += n;
+        }
+        if (done != content->size())
+        {
+            // 读取期间文件被截断
+            errno = EAGAIN;
+            return nullptr;
+        }
+        entry->content = content;
+    }
+    else
+    {
+        entry->file = file;
+    }
+
+    char buf[64];
+    snprintf(buf, sizeof buf, "\"%lx-%lx\"", static_cast<long>(st.st_mtime), static_cast<long>(st.st_size));
+    entry->etag = buf;
+    struct tm tm_time;
+    ::gmtime_r(&st.st_mtime, &tm_time);
+    strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+    entry->lastModified = buf;
+
+    entry->headers.reserve(160);
+    entry->headers.append("Content-Type: ").append(mimeType(path)).append("\r\n");
+    entry->headers.append("Last-Modified: ").append(entry->lastModified).append("\r\n");
+    entry->headers.append("ETag: ").append(entry->etag).append("\r\n");
+    entry->headers.append("Accept-Ranges: bytes\r\n");
+    return entry;
+}
+
+void FileCache::insert(const std::string &path, const EntryPtr &entry, int64_t now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(path);
+    if (found != index_.end())
+    {
+        eraseLocked(found->second);
+    }
+    lru_.push_front(Node{path, entry, now});
+    index_[path] = lru_.begin();
+    if (entry->content)
+    {
+        memoryBytes_ += entry->content->size();
+    }
+
+    // 从最久没有使用的一端淘汰，刚插入的条目至少保留
+    while (lru_.size() > 1 && (lru_.size() > options_.maxEntries || memoryBytes_ > options_.maxMemoryBytes))
+    {
+        eraseLocked(std::prev(lru_.end()));
+    }
+}
+
+void FileCache::eraseLocked(NodeList::iterator it)
+{
+    if (it->entry->content)
+    {
+        memoryBytes_ -= it->entry->content->size();
+    }
+    index_.erase(it->path);
+    lru_.erase(it);
+}
+
+size_t FileCache::entries()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+size_t FileCache::memoryBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memoryBytes_;
+}
+
+const char *FileCache::mimeType(const std::string &path)
+{
+    struct MimeType
+    {
+        const char *extension;
+        const char *type;
+    };
+    static const MimeType kTypes[] = {
+        {".html", "text/html; charset=utf-8"},
+        {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "application/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".xml", "application/xml"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".woff", "font/woff"},
+        {".woff2", "font/woff2"},
+        {".wasm", "application/wasm"},
+        {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"},
+    };
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        const char *extension = path.c_str() + dot;
+        for (const MimeType &m : kTypes)
+        {
+            if (strcasecmp(extension, m.extension) == 0)
+            {
+                return m.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
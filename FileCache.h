@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "noncopyable.h"
+
+class OpenFile;
+
+struct FileCacheOptions
+{
+    size_t maxEntries = 1024;                  // 缓存的文件数上限，也是缓存占用fd数的上限
+    size_t smallFileBytes = 16 * 1024;         // 不超过这个大小的文件把内容读入内存，不保留fd
+    size_t maxMemoryBytes = 64 * 1024 * 1024;  // 小文件内容占用内存的上限
+    double revalidateSeconds = 1.0;            // 命中的条目超过这个时间后重新stat，检查文件是否变化
+};
+
+/**
+ * 静态文件的LRU缓存 缓存打开的fd、stat结果和预先生成的应答头部，小文件同时缓存内容
+ * 命中时不再open/stat；条目超过revalidateSeconds后stat一次路径，文件被替换或修改时重新加载
+ * 条目通过shared_ptr交给调用者，淘汰后正在使用它的应答(例如还在sendfile)不受影响
+ * 可以在多个loop线程中同时使用，锁只保护LRU链表，open/stat/read都在锁外进行
+ */
+class FileCache : noncopyable
+{
+public:
+    struct Entry
+    {
+        std::shared_ptr<OpenFile> file;              // 大文件的fd，用sendfile发送；小文件为空
+        std::shared_ptr<const std::string> content;  // 小文件的内容；大文件为空
+        off_t size;
+        time_t mtime;
+        ino_t ino;
+        dev_t dev;
+        std::string etag;          // "mtime-size" 带引号
+        std::string lastModified;  // HTTP日期格式
+        std::string headers;       // Content-Type、Last-Modified、ETag、Accept-Ranges头部行
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    explicit FileCache(const FileCacheOptions &options = FileCacheOptions());
+
+    // path不存在或者不是普通文件时返回nullptr，errno说明原因
+    EntryPtr get(const std::string &path);
+
+    size_t entries();
+    size_t memoryBytes();
+
+    static const char *mimeType(const std::string &path);
+
+private:
+    struct Node
+    {
+        std::string path;
+        EntryPtr entry;
+        int64_t validatedAt;  // 单调时钟 微秒
+    };
+    using NodeList = std::list<Node>;
+
+    EntryPtr load(const std::string &path);
+    void insert(const std::string &path, const EntryPtr &entry, int64_t now);
+    void eraseLocked(NodeList::iterator it);
+
+    const FileCacheOptions options_;
+    std::mutex mutex_;
+    NodeList lru_;  // 最近使用的在前
+    std::unordered_map<std::string, NodeList::iterator> index_;
+    size_t memoryBytes_;
+};
@@ -0,0 +1,432 @@
+#include "HttpContext.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "Buffer.h"
+
+// 分块长度行(含扩展)的长度上限，正常的长度行只有几个字节
+static const size_t kMaxChunkLineBytes = 1024;
+// 请求结束后chunked正文缓冲区最多保留的容量
+static const size_t kMaxRetainedBodyBytes = 64 * 1024;
+
+static HttpRequest::Method toMethod(const char *begin, size_t len)
+{
+    struct MethodName
+    {
+        const char *name;
+        size_t len;
+        HttpRequest::Method method;
+    };
+    static const MethodName kMethods[] = {
+        {"GET", 3, HttpRequest::kGet},
+        {"POST", 4, HttpRequest::kPost},
+        {"HEAD", 4, HttpRequest::kHead},
+        {"PUT", 3, HttpRequest::kPut},
+        {"DELETE", 6, HttpRequest::kDelete},
+        {"OPTIONS", 7, HttpRequest::kOptions},
+        {"PATCH", 5, HttpRequest::kPatch},
+    };
+    for (const MethodName &m : kMethods)
+    {
+        if (m.len == len && memcmp(m.name, begin, len) == 0)
+        {
+            return m.method;
+        }
+    }
+    return HttpRequest::kInvalid;
+}
+
+static bool equalsIgnoreCase(const char *begin, const char *end, const char *str)
+{
+    return StringPiece(begin, end - begin).equalsIgnoreCase(str);
+}
+
+// 严格的十进制/十六进制解析，不接受空串、符号和溢出
+static bool parseSize(const char *begin, const char *end, int base, size_t *value)
+{
+    if (begin == end)
+    {
+        return false;
+    }
+    size_t result = 0;
+    for (const char *p = begin; p < end; ++p)
+    {
+        int digit;
+        if (*p >= '0' && *p <= '9')
+        {
+            digit = *p - '0';
+        }
+        else if (base == 16 && *p >= 'a' && *p <= 'f')
+        {
+            digit = *p - 'a' + 10;
+        }
+        else if (base == 16 && *p >= 'A' && *p <= 'F')
+        {
+            digit = *p - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        if (result > (static_cast<size_t>(-1) - digit) / base)
+        {
+            return false;
+        }
+        result = result * base + digit;
+    }
+    *value = result;
+    return true;
+}
+
+HttpContext::HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes)
+    : maxHeaderBytes_(maxHeaderBytes),
+      maxBodyBytes_(maxBodyBytes),
+      state_(kExpectRequestLine),
+      scanned_(0),
+      method_(HttpRequest::kInvalid),
+      version_(HttpRequest::kUnknown),
+      methodSpan_{0, 0},
+      pathSpan_{0, 0},
+      querySpan_{0, 0},
+      hasContentLength_(false),
+      chunked_(false),
+      expectContinue_(false),
+      continueSent_(false),
+      contentLength_(0),
+      bodyOffset_(0),
+      chunkRemaining_(0),
+      trailerOffset_(0),
+      requestEnd_(0)
+{
+}
+
+HttpContext::ParseResult HttpContext::parse(Buffer *buf, Timestamp receiveTime)
+{
+    const char *base = buf->peek();
+    size_t readable = buf->readableBytes();
+
+    while (state_ != kGotAll)
+    {
+        if (state_ == kExpectBody)
+        {
+            if (readable - bodyOffset_ < contentLength_)
+            {
+                return kNeedMore;
+            }
+            requestEnd_ = bodyOffset_ + contentLength_;
+            state_ = kGotAll;
+            break;
+        }
+
+        if (state_ == kExpectChunkData)
+        {
+            // 分块数据和它后面的CRLF都到齐了才处理
+            if (readable - scanned_ < chunkRemaining_ + 2)
+            {
+                return kNeedMore;
+            }
+            const char *data = base + scanned_;
+            if (data[chunkRemaining_] != '\r' || data[chunkRemaining_ + 1] != '\n')
+            {
+                return kBadRequest;
+            }
+            chunkedBody_.append(data, chunkRemaining_);
+            scanned_ += chunkRemaining_ + 2;
+            state_ = kExpectChunkSize;
+            continue;
+        }
+
+        // 其余状态都是按行解析
+        const char *lineBegin = base + scanned_;
+        const char *crlf = buf->findCRLF(lineBegin);
+        const bool inHeader = state_ == kExpectRequestLine || state_ == kExpectHeaders;
+        size_t lineEnd = crlf ? crlf + 2 - base : readable;
+        if (inHeader && lineEnd > maxHeaderBytes_)
+        {
+            return kHeaderTooLarge;
+        }
+        // chunked的尾部字段和头部一起计入maxHeaderBytes，尾部在请求结束前一直留在缓冲区中
+        if (state_ == kExpectChunkTrailer && bodyOffset_ + (lineEnd - trailerOffset_) > maxHeaderBytes_)
+        {
+            return kHeaderTooLarge;
+        }
+        if (!inHeader && lineEnd - scanned_ > kMaxChunkLineBytes)
+        {
+            return kBadRequest;
+        }
+        if (crlf == nullptr)
+        {
+            return kNeedMore;
+        }
+        scanned_ = lineEnd;
+
+        switch (state_)
+        {
+        case kExpectRequestLine:
+            // 请求之间多余的空行直接忽略
+            if (lineBegin == crlf)
+            {
+                buf->retrieve(scanned_);
+                base = buf->peek();
+                readable = buf->readableBytes();
+                scanned_ = 0;
+                continue;
+            }
+            if (!parseRequestLine(base, lineBegin, crlf))
+            {
+                return kBadRequest;
+            }
+            state_ = kExpectHeaders;
+            break;
+        case kExpectHeaders:
+            if (lineBegin == crlf)
+            {
+                if (!finishHeaders())
+                {
+                    return kBadRequest;
+                }
+                bodyOffset_ = scanned_;  // 也就是请求行和头部的长度
+                if (chunked_)
+                {
+                    state_ = kExpectChunkSize;
+                }
+                else if (contentLength_ > maxBodyBytes_)
+                {
+                    return kBodyTooLarge;
+                }
+                else
+                {
+                    requestEnd_ = scanned_;
+                    state_ = contentLength_ > 0 ? kExpectBody : kGotAll;
+                }
+            }
+            else if (!parseHeader(base, lineBegin, crlf))
+            {
+                return kBadRequest;
+            }
+            break;
+        case kExpectChunkSize:
+        {
+            // 忽略分块扩展 "1a;name=value"
+            const char *sizeEnd = std::find(lineBegin, crlf, ';');
+            while (sizeEnd > lineBegin && (sizeEnd[-1] == ' ' || sizeEnd[-1] == '\t'))
+            {
+                --sizeEnd;
+            }
+            size_t chunkSize = 0;
+            if (!parseSize(lineBegin, sizeEnd, 16, &chunkSize))
+            {
+                return kBadRequest;
+            }
+            if (chunkSize > maxBodyBytes_ - chunkedBody_.size())
+            {
+                return kBodyTooLarge;
+            }
+            if (chunkSize == 0)
+            {
+                trailerOffset_ = scanned_;
+                state_ = kExpectChunkTrailer;
+            }
+            else
+            {
+                chunkRemaining_ = chunkSize;
+                state_ = kExpectChunkData;
+            }
+            break;
+        }
+        case kExpectChunkTrailer:
+            // 尾部字段不交给回调，遇到空行整个请求结束
+            if (lineBegin == crlf)
+            {
+                requestEnd_ = scanned_;
+                state_ = kGotAll;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    buildRequest(base, receiveTime);
+    return kGotRequest;
+}
+
+// GET /index.html?a=1 HTTP/1.1
+bool HttpContext::parseRequestLine(const char *base, const char *begin, const char *end)
+{
+    const char *space = std::find(begin, end, ' ');
+    if (space == end)
+    {
+        return false;
+    }
+    method_ = toMethod(begin, space - begin);
+    if (method_ == HttpRequest::kInvalid)
+    {
+        return false;
+    }
+    methodSpan_ = Span{static_cast<size_t>(begin - base), static_cast<size_t>(space - begin)};
+
+    const char *target = space + 1;
+    space = std::find(target, end, ' ');
+    if (space == end || space == target)
+    {
+        return false;
+    }
+    const char *question = std::find(target, space, '?');
+    pathSpan_ = Span{static_cast<size_t>(target - base), static_cast<size_t>(question - target)};
+    if (question != space)
+    {
+        querySpan_ = Span{static_cast<size_t>(question + 1 - base), static_cast<size_t>(space - question - 1)};
+    }
+    else
+    {
+        querySpan_ = Span{0, 0};
+    }
+
+    const char *version = space + 1;
+    if (end - version != 8 || memcmp(version, "HTTP/1.", 7) != 0)
+    {
+        return false;
+    }
+    if (version[7] == '1')
+    {
+        version_ = HttpRequest::kHttp11;
+    }
+    else if (version[7] == '0')
+    {
+        version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Name: value 去掉值两端的空白，不支持已经废弃的折行
+bool HttpContext::parseHeader(const char *base, const char *begin, const char *end)
+{
+    const char *colon = std::find(begin, end, ':');
+    if (colon == end || colon == begin || *begin == ' ' || *begin == '\t' ||
+        colon[-1] == ' ' || colon[-1] == '\t')
+    {
+        return false;
+    }
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
+    {
+        ++value;
+    }
+    const char *valueEnd = end;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+    {
+        --valueEnd;
+    }
+
+    // 决定正文长度的字段在解析时就处理，避免在请求完成后再遍历一次
+    if (equalsIgnoreCase(begin, colon, "Content-Length"))
+    {
+        size_t length = 0;
+        if (!parseSize(value, valueEnd, 10, &length) ||
+            (hasContentLength_ && length != contentLength_))
+        {
+            return false;
+        }
+        hasContentLength_ = true;
+        contentLength_ = length;
+    }
+    else if (equalsIgnoreCase(begin, colon, "Transfer-Encoding"))
+    {
+        // 只支持chunked作为最后一个编码，其他编码无法确定正文长度
+        static const size_t kChunkedLen = 7;
+        if (static_cast<size_t>(valueEnd - value) < kChunkedLen ||
+            !equalsIgnoreCase(valueEnd - kChunkedLen, valueEnd, "chunked"))
+        {
+            return false;
+        }
+        chunked_ = true;
+    }
+    else if (equalsIgnoreCase(begin, colon, "Expect"))
+    {
+        expectContinue_ = equalsIgnoreCase(value, valueEnd, "100-continue");
+    }
+
+    headerSpans_.push_back(std::make_pair(
+        Span{static_cast<size_t>(begin - base), static_cast<size_t>(colon - begin)},
+        Span{static_cast<size_t>(value - base), static_cast<size_t>(valueEnd - value)}));
+    return true;
+}
+
+bool HttpContext::finishHeaders()
+{
+    // 同时带有两种长度信息的请求可能被前后两级服务器按不同方式切分(请求走私)，直接拒绝
+    if (chunked_ && hasContentLength_)
+    {
+        return false;
+    }
+    if (version_ == HttpRequest::kHttp10 && chunked_)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool HttpContext::expectingContinue() const
+{
+    return expectContinue_ && !continueSent_ && version_ == HttpRequest::kHttp11 &&
+           (state_ == kExpectBody || state_ == kExpectChunkSize || state_ == kExpectChunkData);
+}
+
+void HttpContext::buildRequest(const char *base, Timestamp receiveTime)
+{
+    request_.reset();
+    request_.method_ = method_;
+    request_.version_ = version_;
+    request_.methodString_ = StringPiece(base + methodSpan_.offset, methodSpan_.length);
+    request_.path_ = StringPiece(base + pathSpan_.offset, pathSpan_.length);
+    request_.query_ = StringPiece(base + querySpan_.offset, querySpan_.length);
+    request_.receiveTime_ = receiveTime;
+    for (const std::pair<Span, Span> &header : headerSpans_)
+    {
+        request_.headers_.push_back(HttpRequest::Header(
+            StringPiece(base + header.first.offset, header.first.length),
+            StringPiece(base + header.second.offset, header.second.length)));
+    }
+    if (chunked_)
+    {
+        request_.body_ = StringPiece(chunkedBody_);
+    }
+    else
+    {
+        request_.body_ = StringPiece(base + bodyOffset_, contentLength_);
+    }
+}
+
+void HttpContext::finishRequest(Buffer *buf)
+{
+    buf->retrieve(requestEnd_);
+
+    state_ = kExpectRequestLine;
+    scanned_ = 0;
+    method_ = HttpRequest::kInvalid;
+    version_ = HttpRequest::kUnknown;
+    headerSpans_.clear();
+    hasContentLength_ = false;
+    chunked_ = false;
+    expectContinue_ = false;
+    continueSent_ = false;
+    contentLength_ = 0;
+    bodyOffset_ = 0;
+    chunkRemaining_ = 0;
+    trailerOffset_ = 0;
+    requestEnd_ = 0;
+    // 偶尔的大正文不要一直占着连接的内存
+    if (chunkedBody_.capacity() > kMaxRetainedBodyBytes)
+    {
+        std::string().swap(chunkedBody_);
+    }
+    chunkedBody_.clear();
+    request_.reset();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "HttpRequest.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+class Buffer;
+
+/**
+ * 每个连接一个的HTTP/1.x请求解析器 增量解析，数据不完整时记住解析到的位置，下次从断点继续
+ * 解析过程中不取走输入缓冲区的数据，只记录各字段相对peek()的偏移；缓冲区扩容搬移数据后偏移仍然有效
+ * 一个请求完整后才把偏移换成指向缓冲区的StringPiece，请求处理完由finishRequest()取走它占用的字节
+ * 同一个缓冲区中的多个流水线请求依次解析，每次只解析一个
+ *
+ * Content-Length正文直接指向输入缓冲区；chunked正文的各个分块之间隔着分块长度行，
+ * 合并到一个连接内复用的string中再交给回调
+ */
+class HttpContext : noncopyable
+{
+public:
+    enum ParseResult
+    {
+        kNeedMore,          // 请求还不完整
+        kGotRequest,        // request()中是一个完整的请求
+        kBadRequest,        // 格式错误 应答400并关闭连接
+        kHeaderTooLarge,    // 请求行、头部和chunked尾部字段超过maxHeaderBytes 应答431
+        kBodyTooLarge,      // 正文超过maxBodyBytes 应答413
+    };
+
+    HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes);
+
+    // 从buf->peek()开始继续解析，不取走数据
+    ParseResult parse(Buffer *buf, Timestamp receiveTime);
+    // parse()返回kGotRequest之后有效，直到调用finishRequest()或者缓冲区被修改
+    const HttpRequest &request() const { return request_; }
+    // 从缓冲区取走当前请求占用的字节，准备解析下一个请求
+    void finishRequest(Buffer *buf);
+
+    // 头部已经解析完、正在等待正文，并且请求带有Expect: 100-continue
+    bool expectingContinue() const;
+    void setContinueSent() { continueSent_ = true; }
+
+private:
+    enum State
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+        kExpectChunkSize,
+        kExpectChunkData,
+        kExpectChunkTrailer,
+        kGotAll,
+    };
+
+    // 相对缓冲区peek()的偏移和长度
+    struct Span
+    {
+        size_t offset;
+        size_t length;
+    };
+
+    bool parseRequestLine(const char *base, const char *begin, const char *end);
+    bool parseHeader(const char *base, const char *begin, const char *end);
+    bool finishHeaders();
+    void buildRequest(const char *base, Timestamp receiveTime);
+
+    const size_t maxHeaderBytes_;
+    const size_t maxBodyBytes_;
+
+    State state_;
+    size_t scanned_;  // 下一行的起始偏移
+    HttpRequest::Method method_;
+    HttpRequest::Version version_;
+    Span methodSpan_;
+    Span pathSpan_;
+    Span querySpan_;
+    std::vector<std::pair<Span, Span>> headerSpans_;
+
+    bool hasContentLength_;
+    bool chunked_;
+    bool expectContinue_;
+    bool continueSent_;
+    size_t contentLength_;
+    size_t bodyOffset_;       // 正文的起始偏移，也就是请求行和头部的长度
+    size_t chunkRemaining_;
+    size_t trailerOffset_;    // chunked尾部字段的起始偏移
+    size_t requestEnd_;       // 完整请求的长度
+    std::string chunkedBody_;  // 合并后的chunked正文 连接内复用
+
+    HttpRequest request_;
+};
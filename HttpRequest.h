@@ -0,0 +1,101 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+/**
+ * 一个已经完整解析的HTTP请求
+ * 方法、路径、头部和正文都是指向连接输入缓冲区的StringPiece，解析时不拷贝数据，只在HttpCallback期间有效
+ * 需要在回调之后继续使用的字段要先用asString()拷贝出来
+ */
+class HttpRequest
+{
+public:
+    enum Method
+    {
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+        kOptions,
+        kPatch,
+    };
+    enum Version
+    {
+        kUnknown,
+        kHttp10,
+        kHttp11,
+    };
+
+    using Header = std::pair<StringPiece, StringPiece>;
+
+    HttpRequest()
+        : method_(kInvalid),
+          version_(kUnknown)
+    {
+    }
+
+    Method method() const { return method_; }
+    StringPiece methodString() const { return methodString_; }
+    Version version() const { return version_; }
+    // 不含'?'之后的查询串
+    StringPiece path() const { return path_; }
+    // '?'之后的部分，没有时为空
+    StringPiece query() const { return query_; }
+    StringPiece body() const { return body_; }
+    Timestamp receiveTime() const { return receiveTime_; }
+    const std::vector<Header> &headers() const { return headers_; }
+
+    // 字段名不区分大小写，没有该字段时返回空的StringPiece
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for (const Header &header : headers_)
+        {
+            if (header.first.equalsIgnoreCase(field))
+            {
+                return header.second;
+            }
+        }
+        return StringPiece();
+    }
+
+    // HTTP/1.1默认保持连接，除非Connection: close；HTTP/1.0只有Connection: Keep-Alive时才保持
+    bool keepAlive() const
+    {
+        StringPiece connection = getHeader("Connection");
+        if (version_ == kHttp11)
+        {
+            return !connection.equalsIgnoreCase("close");
+        }
+        return version_ == kHttp10 && connection.equalsIgnoreCase("keep-alive");
+    }
+
+private:
+    friend class HttpContext;
+
+    // 清空字段但保留headers_的容量，同一个连接上的下一个请求不用重新分配内存
+    void reset()
+    {
+        method_ = kInvalid;
+        version_ = kUnknown;
+        methodString_ = StringPiece();
+        path_ = StringPiece();
+        query_ = StringPiece();
+        body_ = StringPiece();
+        headers_.clear();
+    }
+
+    Method method_;
+    Version version_;
+    StringPiece methodString_;
+    StringPiece path_;
+    StringPiece query_;
+    StringPiece body_;
+    Timestamp receiveTime_;
+    std::vector<Header> headers_;
+};
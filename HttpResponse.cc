@@ -0,0 +1,117 @@
+#include "HttpResponse.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Buffer.h"
+
+// 每个线程缓存格式化好的Date头部，同一秒内的应答直接复用
+__thread time_t t_lastDateSecond = -1;
+__thread char t_dateHeader[64];
+__thread int t_dateHeaderLen = 0;
+
+static void cacheDateHeader()
+{
+    time_t now = ::time(nullptr);
+    if (now != t_lastDateSecond)
+    {
+        t_lastDateSecond = now;
+        struct tm tm_time;
+        ::gmtime_r(&now, &tm_time);
+        t_dateHeaderLen = static_cast<int>(
+            strftime(t_dateHeader, sizeof t_dateHeader, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_time));
+    }
+}
+
+const char *HttpResponse::reasonPhrase(StatusCode code)
+{
+    switch (code)
+    {
+    case k100Continue: return "Continue";
+    case k101SwitchingProtocols: return "Switching Protocols";
+    case k200Ok: return "OK";
+    case k204NoContent: return "No Content";
+    case k206PartialContent: return "Partial Content";
+    case k301MovedPermanently: return "Moved Permanently";
+    case k304NotModified: return "Not Modified";
+    case k400BadRequest: return "Bad Request";
+    case k403Forbidden: return "Forbidden";
+    case k404NotFound: return "Not Found";
+    case k405MethodNotAllowed: return "Method Not Allowed";
+    case k413PayloadTooLarge: return "Payload Too Large";
+    case k416RangeNotSatisfiable: return "Range Not Satisfiable";
+    case k426UpgradeRequired: return "Upgrade Required";
+    case k431RequestHeaderFieldsTooLarge: return "Request Header Fields Too Large";
+    case k500InternalServerError: return "Internal Server Error";
+    case k501NotImplemented: return "Not Implemented";
+    case k503ServiceUnavailable: return "Service Unavailable";
+    case k505HttpVersionNotSupported: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+void HttpResponse::addHeader(const StringPiece &field, const StringPiece &value)
+{
+    headers_.append(field.data(), field.size());
+    headers_.append(": ", 2);
+    headers_.append(value.data(), value.size());
+    headers_.append("\r\n", 2);
+}
+
+size_t HttpResponse::bodyLength() const
+{
+    if (file_)
+    {
+        return fileLength_;
+    }
+    return sharedBody_ ? sharedBody_->size() : body_.size();
+}
+
+void HttpResponse::appendToBuffer(Buffer *output, bool withBody) const
+{
+    // 1xx、204和304应答不能带正文，也不写Content-Length
+    const bool noBody = statusCode_ < 200 || statusCode_ == k204NoContent || statusCode_ == k304NotModified;
+    if (noBody)
+    {
+        withBody = false;
+    }
+
+    char statusLine[64];
+    const char *reason = statusMessage_.empty() ? reasonPhrase(statusCode_) : statusMessage_.c_str();
+    int statusLen = snprintf(statusLine, sizeof statusLine, "HTTP/1.1 %d ", statusCode_);
+
+    char lengthLine[48];
+    int lengthLen = noBody ? 0 : snprintf(lengthLine, sizeof lengthLine, "Content-Length: %zu\r\n", bodyLength());
+    const std::string &body = sharedBody_ ? *sharedBody_ : body_;
+    if (file_)
+    {
+        withBody = false;
+    }
+
+    static const char kClose[] = "Connection: close\r\n";
+    static const char kKeepAlive[] = "Connection: Keep-Alive\r\n";
+    const char *connection = closeConnection_ ? kClose : kKeepAlive;
+    size_t connectionLen = closeConnection_ ? sizeof kClose - 1 : sizeof kKeepAlive - 1;
+
+    cacheDateHeader();
+
+    // 先算好总长度只扩容一次，然后依次写入输出缓冲区
+    size_t reasonLen = strlen(reason);
+    size_t total = statusLen + reasonLen + 2 + lengthLen + connectionLen + t_dateHeaderLen +
+                   headers_.size() + 2 + (withBody ? body.size() : 0);
+    output->ensureWriteableBytes(total);
+
+    output->append(statusLine, statusLen);
+    output->append(reason, reasonLen);
+    output->append("\r\n", 2);
+    output->append(lengthLine, lengthLen);
+    output->append(connection, connectionLen);
+    output->append(t_dateHeader, t_dateHeaderLen);
+    output->append(headers_);
+    output->append("\r\n", 2);
+    if (withBody)
+    {
+        output->append(body);
+    }
+}
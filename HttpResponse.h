@@ -0,0 +1,99 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
+#include "StringPiece.h"
+
+class Buffer;
+class OpenFile;
+
+/**
+ * HTTP应答 由HttpCallback填写，HttpServer直接序列化到连接的输出缓冲区，中间不再拼接string
+ * 头部在addHeader()时就按"Name: value\r\n"格式追加到一个string中，序列化时整块拷贝
+ * Content-Length、Connection和Date由appendToBuffer()生成，不需要手动添加
+ * 正文可以是自己的string、共享的只读内容(例如文件缓存)或者文件的一段，后两种不拷贝到应答对象中
+ */
+class HttpResponse
+{
+public:
+    enum StatusCode
+    {
+        kUnknown = 0,
+        k100Continue = 100,
+        k101SwitchingProtocols = 101,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k206PartialContent = 206,
+        k301MovedPermanently = 301,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k403Forbidden = 403,
+        k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k413PayloadTooLarge = 413,
+        k416RangeNotSatisfiable = 416,
+        k426UpgradeRequired = 426,
+        k431RequestHeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+        k503ServiceUnavailable = 503,
+        k505HttpVersionNotSupported = 505,
+    };
+
+    explicit HttpResponse(bool close = false)
+        : statusCode_(k200Ok),
+          closeConnection_(close)
+    {
+    }
+
+    void setStatusCode(StatusCode code) { statusCode_ = code; }
+    StatusCode statusCode() const { return statusCode_; }
+    // 默认使用状态码对应的标准原因短语
+    void setStatusMessage(const std::string &message) { statusMessage_ = message; }
+
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(const StringPiece &contentType) { addHeader("Content-Type", contentType); }
+    void addHeader(const StringPiece &field, const StringPiece &value);
+    // 追加已经格式化好的头部行，每行以"\r\n"结尾，例如文件缓存中预先生成的头部
+    void addRawHeaders(const StringPiece &lines) { headers_.append(lines.data(), lines.size()); }
+
+    void setBody(const std::string &body) { body_ = body; }
+    void setBody(std::string &&body) { body_.swap(body); }
+    void appendBody(const char *data, size_t len) { body_.append(data, len); }
+    const std::string &body() const { return body_; }
+    // 正文引用共享的只读内容，序列化时直接从中拷贝到输出缓冲区
+    void setSharedBody(const std::shared_ptr<const std::string> &body) { sharedBody_ = body; }
+    // 正文是文件的[offset, offset + length)，HttpServer写入头部后用TcpConnection::sendFile()发送
+    void setFileBody(const std::shared_ptr<OpenFile> &file, off_t offset, size_t length)
+    {
+        file_ = file;
+        fileOffset_ = offset;
+        fileLength_ = length;
+    }
+    const std::shared_ptr<OpenFile> &file() const { return file_; }
+    off_t fileOffset() const { return fileOffset_; }
+    size_t fileLength() const { return fileLength_; }
+    size_t bodyLength() const;
+
+    // 写入状态行、头部和正文 withBody为false时只写头部(HEAD请求)，Content-Length仍然是正文的长度
+    // 文件正文不写入，由调用者在之后发送
+    void appendToBuffer(Buffer *output, bool withBody = true) const;
+
+    static const char *reasonPhrase(StatusCode code);
+
+private:
+    StatusCode statusCode_;
+    bool closeConnection_;
+    std::string statusMessage_;
+    std::string headers_;  // 已经格式化的头部行
+    std::string body_;
+    std::shared_ptr<const std::string> sharedBody_;
+    std::shared_ptr<OpenFile> file_;
+    off_t fileOffset_;
+    size_t fileLength_;
+};
@@ -0,0 +1,429 @@
+#include "HttpServer.h"
+
+#include <atomic>
+#include <map>
+#include <utility>
+
+#include "HttpContext.h"
+#include "Logger.h"
+#include "OpenFile.h"
+
+// start()时固定下来的回调和参数 连接持有一份引用，HttpServer先析构也不影响还没有完成的延迟应答
+struct HttpServer::Handlers
+{
+    HttpCallback httpCallback;
+    AsyncHttpCallback asyncHttpCallback;
+    WebSocketOpenCallback webSocketOpenCallback;
+    std::shared_ptr<const WebSocketCallbacks> webSocketCallbacks;
+    HttpServerOptions options;
+    mutable std::atomic_bool draining{false};  // drain()之后的应答都带Connection: close
+};
+
+// 序列化好的应答 文件正文不在data中，写入data之后再用sendFile()发送
+struct HttpServer::SerializedResponse
+{
+    SerializedResponse()
+        : fileOffset(0),
+          fileLength(0),
+          close(false)
+    {
+    }
+
+    SerializedResponse(const HttpResponse &response, bool headRequest)
+        : file(headRequest ? nullptr : response.file()),
+          fileOffset(response.fileOffset()),
+          fileLength(response.fileLength()),
+          close(response.closeConnection())
+    {
+        Buffer buf(0);
+        response.appendToBuffer(&buf, !headRequest);
+        data = buf.retrieveAllAsString();
+    }
+
+    void swap(SerializedResponse &other)
+    {
+        data.swap(other.data);
+        file.swap(other.file);
+        std::swap(fileOffset, other.fileOffset);
+        std::swap(fileLength, other.fileLength);
+        std::swap(close, other.close);
+    }
+
+    void writeTo(const TcpConnectionPtr &conn) const
+    {
+        conn->outputBuffer()->append(data);
+        if (file)
+        {
+            conn->sendFile(file, fileOffset, fileLength);
+        }
+    }
+
+    std::string data;
+    std::shared_ptr<OpenFile> file;
+    off_t fileOffset;
+    size_t fileLength;
+    bool close;
+};
+
+// 每个连接的HTTP状态 保存在TcpConnection的context中，只在连接所属的loop线程中访问
+struct HttpServer::Session
+{
+    explicit Session(const std::shared_ptr<const Handlers> &handlersArg)
+        : handlers(handlersArg),
+          context(handlersArg->options.maxHeaderBytes, handlersArg->options.maxBodyBytes),
+          nextSeq(0),
+          nextSend(0),
+          processing(false),
+          stopParsing(false),
+          closed(false)
+    {
+    }
+
+    std::shared_ptr<const Handlers> handlers;
+    HttpContext context;
+    uint64_t nextSeq;   // 下一个请求的序号
+    uint64_t nextSend;  // 下一个应该写入输出缓冲区的应答的序号
+    // 比前面的应答先完成、已经序列化好的应答
+    std::map<uint64_t, SerializedResponse> ready;
+    bool processing;   // 正在processRequests()中，应答由它最后统一发送
+    bool stopParsing;  // 收到了不保持连接的请求或者格式错误的请求，不再解析后面的数据
+    bool closed;       // 已经写入了关闭连接的应答，之后的应答全部丢弃
+    std::shared_ptr<WebSocketConnection> webSocket;  // 升级之后的输入都交给它
+};
+
+HttpServer::HttpServer(EventLoop *loop,
+                       const InetAddress &listenAddr,
+                       const std::string &name,
+                       TcpServer::Option option)
+    : server_(loop, listenAddr, name, option)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+                                         std::placeholders::_1,
+                                         std::placeholders::_2,
+                                         std::placeholders::_3));
+}
+
+HttpServer::~HttpServer() = default;
+
+void HttpServer::start()
+{
+    std::shared_ptr<Handlers> handlers = std::make_shared<Handlers>();
+    handlers->httpCallback = httpCallback_;
+    handlers->asyncHttpCallback = asyncHttpCallback_;
+    handlers->webSocketOpenCallback = webSocketOpenCallback_;
+    std::shared_ptr<WebSocketCallbacks> webSocketCallbacks = std::make_shared<WebSocketCallbacks>();
+    webSocketCallbacks->messageCallback = webSocketMessageCallback_;
+    webSocketCallbacks->closeCallback = webSocketCloseCallback_;
+    webSocketCallbacks->maxMessageBytes = options_.maxWebSocketMessageBytes;
+    handlers->webSocketCallbacks = webSocketCallbacks;
+    handlers->options = options_;
+    handlers_ = handlers;
+    server_.start();
+}
+
+void HttpServer::drain(double deadlineSeconds, const TcpServer::DrainedCallback &cb)
+{
+    if (handlers_)
+    {
+        handlers_->draining = true;
+    }
+    server_.drain(deadlineSeconds, cb);
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        // 一批流水线应答已经合并成一次write，不需要Nagle再合并
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<Session>(handlers_));
+    }
+    else
+    {
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        if (session != nullptr && session->webSocket)
+        {
+            session->webSocket->handleDisconnected();
+        }
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    Session *session = static_cast<Session *>(conn->getContext().get());
+    if (session == nullptr)
+    {
+        return;
+    }
+    if (session->webSocket)
+    {
+        session->webSocket->handleData(conn, buf);
+    }
+    else
+    {
+        processRequests(conn, session, buf, receiveTime);
+    }
+}
+
+// 依次处理缓冲区中所有完整的请求，应答都写入输出缓冲区，最后一起发送
+void HttpServer::processRequests(const TcpConnectionPtr &conn, Session *session, Buffer *buf, Timestamp receiveTime)
+{
+    const Handlers &handlers = *session->handlers;
+    session->processing = true;
+    while (!session->stopParsing &&
+           session->nextSeq - session->nextSend < handlers.options.maxPipelinedRequests &&
+           buf->readableBytes() > 0)
+    {
+        HttpContext::ParseResult result = session->context.parse(buf, receiveTime);
+        if (result == HttpContext::kNeedMore)
+        {
+            // 前面的应答都已经发出时才能插入100 Continue，否则会被客户端当成前一个请求的应答
+            if (session->context.expectingContinue() && session->nextSend == session->nextSeq)
+            {
+                static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                conn->outputBuffer()->append(kContinue, sizeof kContinue - 1);
+                session->context.setContinueSent();
+            }
+            break;
+        }
+        if (result == HttpContext::kBadRequest)
+        {
+            sendError(conn, session, HttpResponse::k400BadRequest);
+            break;
+        }
+        if (result == HttpContext::kHeaderTooLarge)
+        {
+            sendError(conn, session, HttpResponse::k431RequestHeaderFieldsTooLarge);
+            break;
+        }
+        if (result == HttpContext::kBodyTooLarge)
+        {
+            sendError(conn, session, HttpResponse::k413PayloadTooLarge);
+            break;
+        }
+
+        const HttpRequest &request = session->context.request();
+        if (handlers.webSocketOpenCallback && WebSocketContext::isUpgradeRequest(request))
+        {
+            upgrade(conn, session, request);
+            session->context.finishRequest(buf);
+            continue;
+        }
+
+        const uint64_t seq = session->nextSeq++;
+        const bool keepAlive = request.keepAlive() && !handlers.draining.load(std::memory_order_relaxed);
+        const bool headRequest = request.method() == HttpRequest::kHead;
+        if (!keepAlive)
+        {
+            session->stopParsing = true;
+        }
+
+        if (handlers.asyncHttpCallback)
+        {
+            handlers.asyncHttpCallback(request, HttpResponder(conn, seq, headRequest, keepAlive));
+        }
+        else
+        {
+            HttpResponse response(!keepAlive);
+            if (handlers.httpCallback)
+            {
+                handlers.httpCallback(request, &response);
+            }
+            else
+            {
+                response.setStatusCode(HttpResponse::k404NotFound);
+            }
+            if (!keepAlive)
+            {
+                response.setCloseConnection(true);
+            }
+            deliver(conn, session, seq, response, headRequest);
+        }
+        session->context.finishRequest(buf);
+    }
+    session->processing = false;
+    flush(conn, session);
+
+    // 客户端紧跟在升级请求后面发送的帧
+    if (session->webSocket && buf->readableBytes() > 0)
+    {
+        session->webSocket->handleData(conn, buf);
+    }
+}
+
+// WebSocket握手 升级请求之后的数据都不再是HTTP，无论成功与否都不再解析后面的请求
+void HttpServer::upgrade(const TcpConnectionPtr &conn, Session *session, const HttpRequest &request)
+{
+    const Handlers &handlers = *session->handlers;
+    const uint64_t seq = session->nextSeq++;
+    session->stopParsing = true;
+
+    HttpResponse response(true);
+    StringPiece key = request.getHeader("Sec-WebSocket-Key");
+    // 前面的应答都发出后才能切换协议，否则101会插到它们前面
+    if (seq != session->nextSend || request.version() != HttpRequest::kHttp11 || key.size() != 24)
+    {
+        response.setStatusCode(HttpResponse::k400BadRequest);
+        deliver(conn, session, seq, response, false);
+        return;
+    }
+    if (request.getHeader("Sec-WebSocket-Version") != "13")
+    {
+        response.setStatusCode(HttpResponse::k426UpgradeRequired);
+        response.addHeader("Sec-WebSocket-Version", "13");
+        deliver(conn, session, seq, response, false);
+        return;
+    }
+
+    Buffer *output = conn->outputBuffer();
+    const size_t mark = output->readableBytes();
+    static const char kSwitching[] =
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+    output->append(kSwitching, sizeof kSwitching - 1);
+    output->append(WebSocketContext::acceptKey(key));
+    output->append("\r\n\r\n", 4);
+
+    std::shared_ptr<WebSocketConnection> webSocket =
+        std::make_shared<WebSocketConnection>(conn, handlers.webSocketCallbacks);
+    if (!webSocket->open(request, handlers.webSocketOpenCallback))
+    {
+        // 撤销101应答和回调中写入的帧
+        output->unwrite(output->readableBytes() - mark);
+        response.setStatusCode(HttpResponse::k403Forbidden);
+        deliver(conn, session, seq, response, false);
+        return;
+    }
+    ++session->nextSend;
+    session->webSocket = webSocket;
+}
+
+// 格式错误的请求之后的数据无法再确定请求边界，应答后关闭连接
+void HttpServer::sendError(const TcpConnectionPtr &conn, Session *session, HttpResponse::StatusCode code)
+{
+    LOG_DEBUG("HttpServer bad request from %s, status %d\n", conn->peerAddress().toIpPort().c_str(), code);
+    HttpResponse response(true);
+    response.setStatusCode(code);
+    session->stopParsing = true;
+    deliver(conn, session, session->nextSeq++, response, false);
+}
+
+// 轮到这个应答时直接序列化到输出缓冲区，否则序列化后暂存，等前面的应答
+void HttpServer::deliver(const TcpConnectionPtr &conn, Session *session, uint64_t seq,
+                         const HttpResponse &response, bool headRequest)
+{
+    if (session->closed)
+    {
+        return;
+    }
+    if (seq != session->nextSend)
+    {
+        SerializedResponse serialized(response, headRequest);
+        session->ready[seq].swap(serialized);
+        return;
+    }
+    response.appendToBuffer(conn->outputBuffer(), !headRequest);
+    if (response.file() && !headRequest)
+    {
+        conn->sendFile(response.file(), response.fileOffset(), response.fileLength());
+    }
+    advance(conn, session, response.closeConnection());
+}
+
+void HttpServer::deliverSerialized(const TcpConnectionPtr &conn, Session *session, uint64_t seq,
+                                   SerializedResponse &response)
+{
+    if (session->closed)
+    {
+        return;
+    }
+    if (seq != session->nextSend)
+    {
+        session->ready[seq].swap(response);
+        return;
+    }
+    response.writeTo(conn);
+    advance(conn, session, response.close);
+}
+
+// 写入了序号为nextSend的应答，接着写入紧随其后、已经完成的应答
+void HttpServer::advance(const TcpConnectionPtr &conn, Session *session, bool close)
+{
+    ++session->nextSend;
+    session->closed = close;
+    std::map<uint64_t, SerializedResponse>::iterator it = session->ready.begin();
+    while (!session->closed && it != session->ready.end() && it->first == session->nextSend)
+    {
+        it->second.writeTo(conn);
+        session->closed = it->second.close;
+        ++session->nextSend;
+        it = session->ready.erase(it);
+    }
+    if (session->closed)
+    {
+        session->ready.clear();
+    }
+}
+
+void HttpServer::flush(const TcpConnectionPtr &conn, Session *session)
+{
+    conn->flushOutput();
+    if (session->closed)
+    {
+        // 输出缓冲区还有数据时shutdown会等数据发送完再关闭写端
+        conn->shutdown();
+    }
+}
+
+// 延迟应答完成后，如果流水线因为等待应答暂停过，继续处理输入缓冲区中剩下的请求
+void HttpServer::resume(const TcpConnectionPtr &conn, Session *session)
+{
+    if (!session->processing)
+    {
+        processRequests(conn, session, conn->inputBuffer(), Timestamp::now());
+    }
+}
+
+void HttpServer::deliverSerializedInLoop(const TcpConnectionPtr &conn, uint64_t seq, SerializedResponse &response)
+{
+    Session *session = static_cast<Session *>(conn->getContext().get());
+    if (session != nullptr && conn->connected())
+    {
+        deliverSerialized(conn, session, seq, response);
+        resume(conn, session);
+    }
+}
+
+void HttpResponder::send(HttpResponse response) const
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn)
+    {
+        return;
+    }
+    if (!keepAlive_)
+    {
+        response.setCloseConnection(true);
+    }
+
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        HttpServer::Session *session = static_cast<HttpServer::Session *>(conn->getContext().get());
+        if (session != nullptr && conn->connected())
+        {
+            HttpServer::deliver(conn, session, seq_, response, headRequest_);
+            HttpServer::resume(conn, session);
+        }
+    }
+    else
+    {
+        // 在当前线程序列化，loop线程只需要拷贝到输出缓冲区
+        std::shared_ptr<HttpServer::SerializedResponse> serialized =
+            std::make_shared<HttpServer::SerializedResponse>(response, headRequest_);
+        uint64_t seq = seq_;
+        loop->queueInLoop([conn, seq, serialized]() {
+            HttpServer::deliverSerializedInLoop(conn, seq, *serialized);
+        });
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "TcpServer.h"
+#include "WebSocketConnection.h"
+#include "noncopyable.h"
+
+struct HttpServerOptions
+{
+    size_t maxHeaderBytes = 64 * 1024;        // 请求行加头部的上限，超过应答431
+    size_t maxBodyBytes = 8 * 1024 * 1024;    // 正文上限，超过应答413
+    size_t maxPipelinedRequests = 64;         // 一个连接上已经交给回调、还没有发出应答的请求数上限
+    size_t maxWebSocketMessageBytes = 16 * 1024 * 1024;  // WebSocket消息(合并分片后)上限，超过时以1009关闭
+};
+
+/**
+ * 延迟应答的句柄 AsyncHttpCallback拿到后可以把请求交给其他线程处理，完成后调用send()
+ * 同一个请求必须且只能send()一次，否则这个连接上后面的流水线应答都会一直等待
+ * 连接已经关闭时send()什么也不做
+ */
+class HttpResponder
+{
+public:
+    HttpResponder()
+        : seq_(0),
+          headRequest_(false),
+          keepAlive_(false)
+    {
+    }
+
+    // 可以在任意线程调用
+    void send(HttpResponse response) const;
+
+private:
+    friend class HttpServer;
+    HttpResponder(const TcpConnectionPtr &conn, uint64_t seq, bool headRequest, bool keepAlive)
+        : conn_(conn),
+          seq_(seq),
+          headRequest_(headRequest),
+          keepAlive_(keepAlive)
+    {
+    }
+
+    std::weak_ptr<TcpConnection> conn_;
+    uint64_t seq_;  // 请求在连接上的序号，应答按序号顺序发出
+    bool headRequest_;
+    bool keepAlive_;
+};
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器
+ * - 请求由HttpContext增量解析，头部和正文都是指向输入缓冲区的StringPiece，不拷贝
+ * - 支持keep-alive和流水线：一次onMessage中收到的多个请求依次处理，应答按请求顺序写入输出缓冲区，
+ *   最后一次flushOutput()合并成一次write
+ * - HttpCallback同步填写应答；AsyncHttpCallback通过HttpResponder延迟应答，先完成的后续请求
+ *   暂存起来，等前面的应答发出后再按顺序发送
+ * - 支持Content-Length和chunked正文，Expect: 100-continue
+ * - 设置了WebSocketOpenCallback时，Upgrade: websocket请求完成握手后连接交给WebSocketConnection，不再按HTTP解析
+ */
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+    // request只在回调期间有效
+    using AsyncHttpCallback = std::function<void(const HttpRequest &, const HttpResponder &)>;
+
+    HttpServer(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+    ~HttpServer();
+
+    // 以下设置需要在start()之前调用 同时设置两种回调时使用AsyncHttpCallback
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setAsyncHttpCallback(const AsyncHttpCallback &cb) { asyncHttpCallback_ = cb; }
+    void setWebSocketOpenCallback(const WebSocketOpenCallback &cb) { webSocketOpenCallback_ = cb; }
+    void setWebSocketMessageCallback(const WebSocketMessageCallback &cb) { webSocketMessageCallback_ = cb; }
+    void setWebSocketCloseCallback(const WebSocketCloseCallback &cb) { webSocketCloseCallback_ = cb; }
+    void setOptions(const HttpServerOptions &options) { options_ = options; }
+    void setThreadInitCallback(const TcpServer::ThreadInitCallback &cb) { server_.setThreadInitCallback(cb); }
+    void setThreadNumber(int numThreads) { server_.setThreadNumber(numThreads); }
+    // 提供HTTPS服务，在start()之前设置
+    void setTlsContext(const TlsContextPtr &context) { server_.setTlsContext(context); }
+    // 对端流水线发送请求却不读取应答时，输出缓冲区超过水位线就停止读取，见TcpFlowControl
+    void setFlowControl(const TcpFlowControl &flowControl) { server_.setFlowControl(flowControl); }
+    void setMemoryBudget(const MemoryBudgetPtr &budget) { server_.setMemoryBudget(budget); }
+    // TCP_NODELAY总是打开，应答已经在用户态合并
+    void setSocketOptions(const SocketOptions &options) { server_.setSocketOptions(options); }
+
+    void start();
+    // 停止accept，之后的应答都带Connection: close；空闲的keep-alive连接到deadline时关闭，见TcpServer::drain
+    void drain(double deadlineSeconds, const TcpServer::DrainedCallback &cb);
+    // 交给ListenerHandoff登记
+    TcpServer *tcpServer() { return &server_; }
+
+private:
+    struct Handlers;
+    struct Session;
+    struct SerializedResponse;
+    friend class HttpResponder;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    static void processRequests(const TcpConnectionPtr &conn, Session *session, Buffer *buf, Timestamp receiveTime);
+    static void upgrade(const TcpConnectionPtr &conn, Session *session, const HttpRequest &request);
+    static void sendError(const TcpConnectionPtr &conn, Session *session, HttpResponse::StatusCode code);
+    static void deliver(const TcpConnectionPtr &conn, Session *session, uint64_t seq,
+                        const HttpResponse &response, bool headRequest);
+    static void deliverSerialized(const TcpConnectionPtr &conn, Session *session, uint64_t seq,
+                                  SerializedResponse &response);
+    static void deliverSerializedInLoop(const TcpConnectionPtr &conn, uint64_t seq, SerializedResponse &response);
+    static void advance(const TcpConnectionPtr &conn, Session *session, bool close);
+    static void flush(const TcpConnectionPtr &conn, Session *session);
+    static void resume(const TcpConnectionPtr &conn, Session *session);
+
+    TcpServer server_;
+    HttpServerOptions options_;
+    HttpCallback httpCallback_;
+    AsyncHttpCallback asyncHttpCallback_;
+    WebSocketOpenCallback webSocketOpenCallback_;
+    WebSocketMessageCallback webSocketMessageCallback_;
+    WebSocketCloseCallback webSocketCloseCallback_;
+    std::shared_ptr<const Handlers> handlers_;  // start()时创建，所有连接共享
+};
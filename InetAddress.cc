@@ -1,7 +1,13 @@
 #include "InetAddress.h"
 
+#include <stddef.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+#include "Logger.h"
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
@@ -11,8 +17,115 @@ InetAddress::InetAddress(uint16_t port, std::string ip)
     addr_.sin_addr.s_addr = inet_addr(ip.c_str());
 }
 
+InetAddress InetAddress::fromUnixPath(const std::string& path)
+{
+    std::shared_ptr<sockaddr_un> un = std::make_shared<sockaddr_un>();
+    bzero(un.get(), sizeof(sockaddr_un));
+    un->sun_family = AF_UNIX;
+    // 截断后是另一个地址，绑定、连接甚至unlink都会作用在它上面，直接拒绝
+    // 文件路径需要留出结尾的'\0'，抽象命名空间的名字可以占满sun_path
+    const bool abstract = !path.empty() && path[0] == '@';
+    size_t len = path.size();
+    if (len > sizeof(un->sun_path) - (abstract ? 0 : 1))
+    {
+        LOG_FATAL("InetAddress::fromUnixPath path too long(%zu bytes): %s\n", path.size(), path.c_str());
+    }
+    memcpy(un->sun_path, path.data(), len);
+
+    InetAddress addr;
+    bzero(&addr.addr_, sizeof addr.addr_);
+    addr.addr_.sin_family = AF_UNIX;
+    if (abstract)
+    {
+        // 抽象命名空间 地址长度不包含结尾的'\0'
+        un->sun_path[0] = '\0';
+        addr.unixLen_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len);
+    }
+    else
+    {
+        addr.unixLen_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len + 1);
+    }
+    addr.unix_ = un;
+    return addr;
+}
+
+InetAddress InetAddress::fromSockAddr(const sockaddr* sa, socklen_t len)
+{
+    if (sa->sa_family == AF_UNIX)
+    {
+        InetAddress addr;
+        bzero(&addr.addr_, sizeof addr.addr_);
+        addr.addr_.sin_family = AF_UNIX;
+        // accept得到的对端地址通常是未命名的，不分配内存
+        if (len > offsetof(sockaddr_un, sun_path))
+        {
+            std::shared_ptr<sockaddr_un> un = std::make_shared<sockaddr_un>();
+            bzero(un.get(), sizeof(sockaddr_un));
+            memcpy(un.get(), sa, std::min(static_cast<size_t>(len), sizeof(sockaddr_un)));
+            addr.unix_ = un;
+            addr.unixLen_ = len;
+        }
+        return addr;
+    }
+
+    sockaddr_in in;
+    bzero(&in, sizeof in);
+    memcpy(&in, sa, std::min(static_cast<size_t>(len), sizeof in));
+    return InetAddress(in);
+}
+
+InetAddress InetAddress::localAddressOf(int sockfd)
+{
+    sockaddr_storage storage;
+    bzero(&storage, sizeof storage);
+    socklen_t len = sizeof storage;
+    ::getsockname(sockfd, reinterpret_cast<sockaddr*>(&storage), &len);
+    return fromSockAddr(reinterpret_cast<sockaddr*>(&storage), len);
+}
+
+InetAddress InetAddress::peerAddressOf(int sockfd)
+{
+    sockaddr_storage storage;
+    bzero(&storage, sizeof storage);
+    socklen_t len = sizeof storage;
+    ::getpeername(sockfd, reinterpret_cast<sockaddr*>(&storage), &len);
+    return fromSockAddr(reinterpret_cast<sockaddr*>(&storage), len);
+}
+
+const sockaddr* InetAddress::sockAddr() const
+{
+    if (unix_)
+    {
+        return reinterpret_cast<const sockaddr*>(unix_.get());
+    }
+    return reinterpret_cast<const sockaddr*>(&addr_);
+}
+
+socklen_t InetAddress::sockAddrLen() const
+{
+    if (isUnix())
+    {
+        return unix_ ? unixLen_ : static_cast<socklen_t>(sizeof(sa_family_t));
+    }
+    return static_cast<socklen_t>(sizeof addr_);
+}
+
 std::string InetAddress::toIp() const
 {
+    if (isUnix())
+    {
+        if (!unix_ || unixLen_ <= offsetof(sockaddr_un, sun_path))
+        {
+            return std::string();
+        }
+        size_t len = unixLen_ - offsetof(sockaddr_un, sun_path);
+        if (unix_->sun_path[0] == '\0')
+        {
+            return "@" + std::string(unix_->sun_path + 1, len - 1);
+        }
+        return std::string(unix_->sun_path, strnlen(unix_->sun_path, len));
+    }
+
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     return buf;
@@ -20,6 +133,11 @@ std::string InetAddress::toIp() const
 
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        return "unix:" + toIp();
+    }
+
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     size_t end = strlen(buf);
@@ -30,5 +148,5 @@ std::string InetAddress::toIpPort() const
 
 uint16_t InetAddress::toPort() const
 {
-    return ntohs(addr_.sin_port);
-}
\ No newline at end of file
+    return isUnix() ? 0 : ntohs(addr_.sin_port);
+}
@@ -2,10 +2,16 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 
+#include <memory>
 #include <string>
 
-// 封装socket类型
+/**
+ * 封装socket地址 支持IPv4和AF_UNIX两种地址族
+ * AF_UNIX地址的sockaddr_un比较大，放在共享的堆对象中，IPv4地址不额外分配内存
+ * 地址族记录在addr_.sin_family中，sockaddr各个结构体的family字段位置相同
+ */
 class InetAddress
 {
 public:
@@ -15,13 +21,36 @@ public:
     {
     }
 
+    // AF_UNIX地址 以'@'开头的路径表示Linux的抽象命名空间，不在文件系统中创建文件；超过sun_path长度时LOG_FATAL
+    static InetAddress fromUnixPath(const std::string& path);
+    // 从accept/getsockname/getpeername取得的地址构造
+    static InetAddress fromSockAddr(const sockaddr* addr, socklen_t len);
+    // sockfd本端和对端的地址
+    static InetAddress localAddressOf(int sockfd);
+    static InetAddress peerAddressOf(int sockfd);
+
+    sa_family_t family() const { return addr_.sin_family; }
+    bool isUnix() const { return addr_.sin_family == AF_UNIX; }
+
+    // AF_UNIX地址返回路径，抽象命名空间的路径以'@'开头，未命名的地址返回空串
     std::string toIp() const;
     std::string toIpPort() const;
     uint16_t toPort() const;
 
+    // 只对IPv4地址有意义
     const sockaddr_in* getSockAddr() const { return &addr_; }
-    void setSockaddr(const sockaddr_in& addr) { addr_ = addr; }
+    void setSockaddr(const sockaddr_in& addr)
+    {
+        addr_ = addr;
+        unix_.reset();
+    }
+
+    // 任意地址族 用于bind/connect
+    const sockaddr* sockAddr() const;
+    socklen_t sockAddrLen() const;
 
 private:
     sockaddr_in addr_;
+    std::shared_ptr<const sockaddr_un> unix_;  // AF_UNIX且有路径时才分配
+    socklen_t unixLen_ = 0;
 };
@@ -0,0 +1,82 @@
+#include "LatencyHistogram.h"
+
+#include <math.h>
+
+LatencyHistogram &LatencyHistogram::operator=(const LatencyHistogram &other)
+{
+    if (this != &other)
+    {
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            counts_[i].set(other.counts_[i].get());
+        }
+        count_.set(other.count_.get());
+        sum_.set(other.sum_.get());
+        max_.set(other.max_.get());
+    }
+    return *this;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    // 总数按桶重新加一遍，other正在被写时count()和各个桶之和仍然一致
+    int64_t count = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        int64_t n = other.counts_[i].get();
+        if (n != 0)
+        {
+            counts_[i].add(n);
+            count += n;
+        }
+    }
+    count_.add(count);
+    sum_.add(other.sum_.get());
+    if (other.max_.get() > max_.get())
+    {
+        max_.set(other.max_.get());
+    }
+}
+
+double LatencyHistogram::mean() const
+{
+    int64_t count = count_.get();
+    return count == 0 ? 0 : static_cast<double>(sum_.get()) / static_cast<double>(count);
+}
+
+int64_t LatencyHistogram::percentile(double q) const
+{
+    int64_t count = count_.get();
+    if (count == 0)
+    {
+        return 0;
+    }
+    q = q < 0 ? 0 : (q > 1 ? 1 : q);
+    // 第rank个样本(从1开始)所在的桶
+    int64_t rank = static_cast<int64_t>(ceil(q * static_cast<double>(count)));
+    rank = rank < 1 ? 1 : (rank > count ? count : rank);
+    int64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        seen += counts_[i].get();
+        if (seen >= rank)
+        {
+            int64_t upper = bucketUpperBound(i);
+            return upper < max_.get() ? upper : max_.get();
+        }
+    }
+    return max_.get();
+}
+
+int64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < kLinearBuckets)
+    {
+        return index;
+    }
+    int offset = index - kLinearBuckets;
+    int exponent = offset / kSubBuckets + kSubBucketBits + 1;
+    int shift = exponent - kSubBucketBits;
+    int64_t lower = static_cast<int64_t>(kSubBuckets + offset % kSubBuckets) << shift;
+    return lower + (int64_t(1) << shift) - 1;
+}
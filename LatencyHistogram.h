@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LocalCounter.h"
+
+/**
+ * 对数-线性分桶的耗时直方图(HDR风格) 单位微秒
+ * 0~63每个值一个桶；之后每个2的幂区间[2^k, 2^(k+1))等分成32个桶，相对误差不超过1/32；
+ * 超过kMaxValue(约12.7天)的值计入最后一个桶。桶数固定，record()只是算出下标后加一，不分配内存
+ * 计数是LocalCounter：record()只能由一个线程调用(例如所属的loop线程)，其他线程可以随时拷贝或者merge()读取
+ * 多个直方图merge()之后再求百分位数，和把所有样本记录在一个直方图中的结果相同
+ */
+class LatencyHistogram
+{
+public:
+    static const int64_t kMaxValue = (int64_t(1) << 40) - 1;
+
+    LatencyHistogram() = default;
+    // 逐个桶读取other，other可以正在由另一个线程record()
+    LatencyHistogram(const LatencyHistogram &other) { merge(other); }
+    LatencyHistogram &operator=(const LatencyHistogram &other);
+
+    void record(int64_t micros)
+    {
+        if (micros < 0)
+        {
+            micros = 0;  // 调用者应当用单调时钟计算耗时，这里只是防御
+        }
+        else if (micros > kMaxValue)
+        {
+            micros = kMaxValue;
+        }
+        counts_[bucketIndex(micros)].add(1);
+        count_.add(1);
+        sum_.add(micros);
+        if (micros > max_.get())
+        {
+            max_.set(micros);
+        }
+    }
+
+    // 把other的样本加到这个直方图 只能由写这个直方图的线程调用
+    void merge(const LatencyHistogram &other);
+
+    int64_t count() const { return count_.get(); }
+    int64_t sum() const { return sum_.get(); }
+    int64_t max() const { return max_.get(); }
+    double mean() const;
+    // q在[0, 1]之间，例如0.99；返回所在桶的上界，不超过max()，没有样本时返回0
+    int64_t percentile(double q) const;
+
+private:
+    static const int kSubBucketBits = 5;
+    static const int kSubBuckets = 1 << kSubBucketBits;  // 每个2的幂区间的桶数
+    static const int kLinearBuckets = kSubBuckets * 2;   // 0~63每个值一个桶
+    static const int kBuckets = kLinearBuckets + (40 - kSubBucketBits - 1) * kSubBuckets;
+
+    static int bucketIndex(int64_t value)
+    {
+        if (value < kLinearBuckets)
+        {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(static_cast<unsigned long long>(value));  // value在[2^exponent, 2^(exponent+1))
+        int shift = exponent - kSubBucketBits;
+        int sub = static_cast<int>(value >> shift) - kSubBuckets;
+        return kLinearBuckets + (exponent - kSubBucketBits - 1) * kSubBuckets + sub;
+    }
+    static int64_t bucketUpperBound(int index);
+
+    LocalCounter counts_[kBuckets];
+    LocalCounter count_;
+    LocalCounter sum_;
+    LocalCounter max_;
+};
@@ -0,0 +1,192 @@
+#include "ListenerHandoff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "Buffer.h"
+#include "Logger.h"
+
+const char ListenerHandoff::kEnvironmentName[] = "MYMUDUO_LISTEN_FDS";
+
+// 旧进程发送"MYMUDUO_LISTEN_FDS <个数>\n"，监听fd随第一个字节到达
+static const char kHandoffHeader[] = "MYMUDUO_LISTEN_FDS ";
+
+// 新进程收到、还没有被Acceptor取走的监听fd
+static std::mutex g_inheritedMutex;
+static std::vector<int> g_inheritedFds;
+
+static void addInherited(const std::vector<int> &fds)
+{
+    std::lock_guard<std::mutex> lock(g_inheritedMutex);
+    g_inheritedFds.insert(g_inheritedFds.end(), fds.begin(), fds.end());
+}
+
+static void closeAll(const std::vector<int> &fds)
+{
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+}
+
+ListenerHandoff::ListenerHandoff(EventLoop *loop, const InetAddress &address)
+    : server_(loop, address, "ListenerHandoff")
+{
+    server_.setConnectionCallback(std::bind(&ListenerHandoff::onConnection, this, std::placeholders::_1));
+    server_.setWriteCompleteCallback(std::bind(&ListenerHandoff::onWriteComplete, this, std::placeholders::_1));
+}
+
+ListenerHandoff::~ListenerHandoff() = default;
+
+void ListenerHandoff::start()
+{
+    server_.start();
+}
+
+void ListenerHandoff::onConnection(const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+    std::vector<int> fds;
+    for (TcpServer *server : servers_)
+    {
+        fds.push_back(server->handOffListener());
+    }
+    // 新进程会在同一个路径上创建自己的ListenerHandoff，这里析构时不能再删除socket文件
+    server_.handOffListener();
+    LOG_INFO("ListenerHandoff: handing %zu listen fds to %s\n", fds.size(), conn->peerAddress().toIpPort().c_str());
+    conn->sendWithFds(kHandoffHeader + std::to_string(fds.size()) + "\n", fds);
+}
+
+void ListenerHandoff::onWriteComplete(const TcpConnectionPtr &conn)
+{
+    // 监听fd已经写入socket，由内核转交给新进程
+    conn->shutdown();
+    if (handoffCallback_)
+    {
+        handoffCallback_();
+    }
+}
+
+bool ListenerHandoff::exportToEnvironment(const std::vector<TcpServer *> &servers)
+{
+    std::string value;
+    for (TcpServer *server : servers)
+    {
+        int fd = server->handOffListener();
+        int flags = ::fcntl(fd, F_GETFD);
+        if (flags < 0 || ::fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) < 0)
+        {
+            LOG_ERROR("ListenerHandoff::exportToEnvironment fcntl fd=%d err:%d\n", fd, errno);
+            return false;
+        }
+        if (!value.empty())
+        {
+            value += ',';
+        }
+        value += std::to_string(fd);
+    }
+    return ::setenv(kEnvironmentName, value.c_str(), 1) == 0;
+}
+
+int ListenerHandoff::receive(const InetAddress &address, double timeoutSeconds)
+{
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_ERROR("ListenerHandoff::receive socket err:%d\n", errno);
+        return -1;
+    }
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutSeconds);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutSeconds - timeout.tv_sec) * 1000000);
+    ::setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    if (::connect(sockfd, address.sockAddr(), address.sockAddrLen()) < 0)
+    {
+        LOG_ERROR("ListenerHandoff::receive connect %s err:%d\n", address.toIpPort().c_str(), errno);
+        ::close(sockfd);
+        return -1;
+    }
+
+    // 旧进程发完之后关闭连接，一直读到EOF
+    Buffer input;
+    std::vector<int> fds;
+    int savedErrno = 0;
+    ssize_t n;
+    while ((n = input.readFd(sockfd, &savedErrno, &fds)) != 0)
+    {
+        if (n < 0 && savedErrno != EINTR)
+        {
+            LOG_ERROR("ListenerHandoff::receive read err:%d\n", savedErrno);
+            ::close(sockfd);
+            closeAll(fds);
+            return -1;
+        }
+    }
+    ::close(sockfd);
+
+    std::string message = input.retrieveAllAsString();
+    const size_t headerLen = sizeof kHandoffHeader - 1;
+    if (message.compare(0, headerLen, kHandoffHeader) != 0 ||
+        static_cast<size_t>(atoi(message.c_str() + headerLen)) != fds.size())
+    {
+        LOG_ERROR("ListenerHandoff::receive bad message from %s, %zu fds\n", address.toIpPort().c_str(), fds.size());
+        closeAll(fds);
+        return -1;
+    }
+    addInherited(fds);
+    LOG_INFO("ListenerHandoff::receive %zu listen fds from %s\n", fds.size(), address.toIpPort().c_str());
+    return static_cast<int>(fds.size());
+}
+
+int ListenerHandoff::inheritFromEnvironment()
+{
+    const char *value = ::getenv(kEnvironmentName);
+    if (value == nullptr)
+    {
+        return 0;
+    }
+    std::vector<int> fds;
+    const char *p = value;
+    while (*p != '\0')
+    {
+        char *end = nullptr;
+        long fd = strtol(p, &end, 10);
+        if (end == p || fd < 0)
+        {
+            LOG_ERROR("ListenerHandoff: bad %s=%s\n", kEnvironmentName, value);
+            break;
+        }
+        // 只在这个进程中使用，不再传给之后exec的程序
+        ::fcntl(static_cast<int>(fd), F_SETFD, FD_CLOEXEC);
+        fds.push_back(static_cast<int>(fd));
+        p = *end == ',' ? end + 1 : end;
+    }
+    ::unsetenv(kEnvironmentName);
+    addInherited(fds);
+    return static_cast<int>(fds.size());
+}
+
+int ListenerHandoff::takeInherited(const InetAddress &listenAddr)
+{
+    std::lock_guard<std::mutex> lock(g_inheritedMutex);
+    const std::string wanted = listenAddr.toIpPort();
+    for (auto it = g_inheritedFds.begin(); it != g_inheritedFds.end(); ++it)
+    {
+        if (InetAddress::localAddressOf(*it).toIpPort() == wanted)
+        {
+            int fd = *it;
+            g_inheritedFds.erase(it);
+            return fd;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "TcpServer.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 监听socket的交接 用于不中断服务的重启
+ * 旧进程: 在AF_UNIX地址上等待新进程，新进程连上后把登记的TcpServer的监听fd通过SCM_RIGHTS发过去，
+ *        发送完成后回调HandoffCallback，通常在回调中调用TcpServer::drain()停止accept并等待已有的连接结束
+ * 新进程: 在创建TcpServer之前调用receive()或者inheritFromEnvironment()，
+ *        之后创建的TcpServer监听地址和收到的fd相同时直接使用这个fd，不再bind
+ * 两个进程持有的是同一个监听socket，交接期间到达的连接留在监听队列中由新进程accept，不会被拒绝
+ */
+class ListenerHandoff : noncopyable
+{
+public:
+    using HandoffCallback = std::function<void()>;
+
+    // 环境变量的名字，值是逗号分隔的fd，例如"3,4"
+    static const char kEnvironmentName[];
+
+    // 旧进程 address是AF_UNIX地址，见InetAddress::fromUnixPath
+    ListenerHandoff(EventLoop *loop, const InetAddress &address);
+    ~ListenerHandoff();
+
+    // 以下在start()之前调用
+    void addServer(TcpServer *server) { servers_.push_back(server); }
+    void setHandoffCallback(const HandoffCallback &cb) { handoffCallback_ = cb; }
+    void start();
+
+    // 旧进程fork+exec新进程之前调用：清除监听fd的FD_CLOEXEC并写入环境变量
+    static bool exportToEnvironment(const std::vector<TcpServer *> &servers);
+
+    // 新进程 连接旧进程的address，收下监听fd，返回收到的个数，失败返回-1
+    static int receive(const InetAddress &address, double timeoutSeconds = 5.0);
+    // 新进程 收下环境变量中的监听fd，返回个数，没有设置环境变量时返回0
+    static int inheritFromEnvironment();
+    // 取走监听地址为listenAddr的fd，没有返回-1 由Acceptor调用
+    static int takeInherited(const InetAddress &listenAddr);
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onWriteComplete(const TcpConnectionPtr &conn);
+
+    TcpServer server_;
+    std::vector<TcpServer *> servers_;
+    HandoffCallback handoffCallback_;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * 只由一个线程写的计数器 写入是relaxed的load再store，不用fetch_add，x86上和普通变量一样是一条mov；
+ * 其他线程可以随时读取，读到的值可能稍旧，但不会是写了一半的值
+ */
+class LocalCounter
+{
+public:
+    LocalCounter() : value_(0) {}
+
+    void add(int64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void set(int64_t n) { value_.store(n, std::memory_order_relaxed); }
+    int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_;
+};
@@ -0,0 +1,142 @@
+#include "LogFile.h"
+
+#include <unistd.h>
+
+LogFile::LogFile(const std::string &basename,
+                 off_t rollSize,
+                 int flushInterval,
+                 int rollInterval)
+    : basename_(basename),
+      rollSize_(rollSize),
+      flushInterval_(flushInterval),
+      rollInterval_(rollInterval),
+      fp_(nullptr),
+      writtenBytes_(0),
+      startOfPeriod_(0),
+      lastRoll_(0),
+      lastFlush_(0)
+{
+    rollFile();
+}
+
+LogFile::~LogFile()
+{
+    if (fp_ != nullptr)
+    {
+        ::fclose(fp_);
+    }
+}
+
+void LogFile::append(const char *logline, size_t len)
+{
+    if (fp_ == nullptr)
+    {
+        return;
+    }
+
+    // 后端线程独占fp_，使用不加锁的版本
+    size_t written = 0;
+    while (written != len)
+    {
+        size_t n = ::fwrite_unlocked(logline + written, 1, len - written, fp_);
+        if (n == 0)
+        {
+            fprintf(stderr, "LogFile::append() failed %d\n", ferror(fp_));
+            break;
+        }
+        written += n;
+    }
+    writtenBytes_ += written;
+
+    if (writtenBytes_ > rollSize_)
+    {
+        rollFile();
+    }
+    else
+    {
+        time_t now = ::time(NULL);
+        time_t thisPeriod = now / rollInterval_ * rollInterval_;
+        if (thisPeriod != startOfPeriod_)
+        {
+            rollFile();
+        }
+        else if (now - lastFlush_ > flushInterval_)
+        {
+            lastFlush_ = now;
+            flush();
+        }
+    }
+}
+
+void LogFile::flush()
+{
+    if (fp_ != nullptr)
+    {
+        ::fflush(fp_);
+    }
+}
+
+// 关闭当前文件，新建一个以当前时间命名的日志文件
+bool LogFile::rollFile()
+{
+    time_t now = 0;
+    std::string filename = getLogFileName(basename_, &now);
+    time_t start = now / rollInterval_ * rollInterval_;
+
+    // 同一秒内多次滚动会得到同名文件，此时继续写当前文件
+    if (now > lastRoll_)
+    {
+        FILE *fp = ::fopen(filename.c_str(), "ae");  // 'e' O_CLOEXEC
+        if (fp == nullptr)
+        {
+            fprintf(stderr, "LogFile::rollFile() open %s failed\n", filename.c_str());
+            return false;
+        }
+        if (fp_ != nullptr)
+        {
+            ::fclose(fp_);
+        }
+        fp_ = fp;
+        ::setbuffer(fp_, buffer_, sizeof buffer_);
+
+        lastRoll_ = now;
+        lastFlush_ = now;
+        startOfPeriod_ = start;
+        writtenBytes_ = 0;
+        return true;
+    }
+    return false;
+}
+
+// basename.20210302-153000.hostname.pid.log
+std::string LogFile::getLogFileName(const std::string &basename, time_t *now)
+{
+    std::string filename;
+    filename.reserve(basename.size() + 64);
+    filename = basename;
+
+    char timebuf[32] = {0};
+    struct tm tm;
+    *now = ::time(NULL);
+    ::gmtime_r(now, &tm);
+    strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm);
+    filename += timebuf;
+
+    char hostname[256] = {0};
+    if (::gethostname(hostname, sizeof hostname) == 0)
+    {
+        hostname[sizeof hostname - 1] = '\0';
+        filename += hostname;
+    }
+    else
+    {
+        filename += "unknownhost";
+    }
+
+    char pidbuf[32] = {0};
+    snprintf(pidbuf, sizeof pidbuf, ".%d", ::getpid());
+    filename += pidbuf;
+    filename += ".log";
+
+    return filename;
+}
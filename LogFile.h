@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <string>
+
+#include "noncopyable.h"
+
+/**
+ * 日志文件 按大小和时间滚动
+ * 只在AsyncLogging的后端线程中使用，不是线程安全的
+ */
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string &basename,
+            off_t rollSize,
+            int flushInterval = 3,
+            int rollInterval = 60 * 60 * 24);
+    ~LogFile();
+
+    void append(const char *logline, size_t len);
+    void flush();
+    bool rollFile();
+
+private:
+    static std::string getLogFileName(const std::string &basename, time_t *now);
+
+    const std::string basename_;
+    const off_t rollSize_;     // 单个日志文件写满rollSize_字节后滚动
+    const int flushInterval_;  // 距离上一次flush超过flushInterval_秒再flush
+    const int rollInterval_;   // 跨过一个rollInterval_秒的周期后滚动
+
+    FILE *fp_;
+    off_t writtenBytes_;
+    time_t startOfPeriod_;
+    time_t lastRoll_;
+    time_t lastFlush_;
+
+    char buffer_[64 * 1024];  // fp_的用户态缓冲区
+};
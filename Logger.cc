@@ -1,9 +1,29 @@
 #include "Logger.h"
 
-#include <iostream>
+#include <stdio.h>
+#include <string.h>
 
 #include "Timestamp.h"
 
+// 默认输出到stdout，不再每条日志都flush
+static void defaultOutput(const char *msg, int len)
+{
+    ::fwrite(msg, 1, len, stdout);
+}
+
+static void defaultFlush()
+{
+    ::fflush(stdout);
+}
+
+std::atomic_int Logger::logLevel_ = {MUDUO_COMPILE_LOG_LEVEL};
+
+Logger::Logger()
+    : output_(defaultOutput),
+      flush_(defaultFlush)
+{
+}
+
 // 获取日志类的唯一实例对象
 Logger &Logger::instance()
 {
@@ -11,34 +31,52 @@ Logger &Logger::instance()
     return logger;
 }
 
-// 设置日志级别
-void Logger::setLogLevel(int level)
-{
-    logLevel_ = level;
-}
-
 // 写日志
-void Logger::log(std::string msg)
+void Logger::log(int level, const char *msg, int len)
 {
-    switch (logLevel_)
+    const char *levelTag = "";
+    switch (level)
     {
     case INFO:
-        std::cout << "[INFO]";
+        levelTag = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        levelTag = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
+        levelTag = "[FATAL]";
         break;
     case DEBUG:
-        std::cout << "[DEBUG]";
+        levelTag = "[DEBUG]";
         break;
     default:
         break;
     }
 
-    // 打印时间和msg
-    std::cout << "print time"
-              << " : " << Timestamp::now().toString() << msg << std::endl;
-}
\ No newline at end of file
+    // msg被截断时snprintf返回的是完整长度
+    if (len < 0)
+    {
+        len = 0;
+    }
+    else if (len > 1023)
+    {
+        len = 1023;
+    }
+
+    // 打印时间和msg 先拼接成一整行再交给output_，异步日志的前端只需要一次内存拷贝
+    char line[1280];
+    int n = snprintf(line, sizeof line, "%sprint time : ", levelTag);
+    n += Timestamp::now().formatTo(line + n, sizeof line - n);
+    memcpy(line + n, msg, len);
+    n += len;
+    if (line[n - 1] != '\n')
+    {
+        line[n++] = '\n';
+    }
+    output_(line, n);
+
+    if (level == FATAL)
+    {
+        flush_();
+    }
+}
@@ -1,76 +1,108 @@
 #pragma once
 
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <functional>
 #include <string>
 
 #include "noncopyable.h"
 
+/**
+ * 编译期日志级别 低于该级别的日志宏直接展开为空，不产生任何代码
+ * 0:DEBUG 1:INFO 2:ERROR 3:FATAL，LOG_FATAL会退出进程所以不会被去掉
+ * 编译时可以通过 -DMUDUO_COMPILE_LOG_LEVEL=2 只保留ERROR及以上的日志
+ */
+#ifndef MUDUO_COMPILE_LOG_LEVEL
+#ifdef MUDEBUG
+#define MUDUO_COMPILE_LOG_LEVEL 0
+#else
+#define MUDUO_COMPILE_LOG_LEVEL 1
+#endif
+#endif
+
+// 运行期先检查日志级别，级别不够时不做任何格式化
+#define LOG_IMPL(level, logmsgFormat, ...)                                     \
+    do                                                                         \
+    {                                                                          \
+        if (Logger::logLevel() <= level)                                       \
+        {                                                                      \
+            char buf[1024];                                                    \
+            int len = snprintf(buf, sizeof buf, logmsgFormat, ##__VA_ARGS__); \
+            Logger::instance().log(level, buf, len);                           \
+        }                                                                      \
+    } while (0)
+
 // LOG_INFO("%d %s, arg1, arg2...")
-#define LOG_INFO(logmsgFormat, ...)                       \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(INFO);                         \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+#if MUDUO_COMPILE_LOG_LEVEL <= 1
+#define LOG_INFO(logmsgFormat, ...) LOG_IMPL(INFO, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_INFO(logmsgFormat, ...) \
+    do                              \
+    {                               \
     } while (0)
+#endif
 
-#define LOG_ERROR(logmsgFormat, ...)                      \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(ERROR);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+#if MUDUO_COMPILE_LOG_LEVEL <= 2
+#define LOG_ERROR(logmsgFormat, ...) LOG_IMPL(ERROR, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(logmsgFormat, ...) \
+    do                               \
+    {                                \
     } while (0)
+#endif
 
 #define LOG_FATAL(logmsgFormat, ...)                      \
     do                                                    \
     {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(FATAL);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+        LOG_IMPL(FATAL, logmsgFormat, ##__VA_ARGS__);     \
         exit(-1);                                         \
     } while (0)
 
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)                      \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(DEBUG);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-    } while (0)
+#if MUDUO_COMPILE_LOG_LEVEL <= 0
+#define LOG_DEBUG(logmsgFormat, ...) LOG_IMPL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 #else
-#define LOG_DEBUG(logmsgFormat, ...)
+#define LOG_DEBUG(logmsgFormat, ...) \
+    do                               \
+    {                                \
+    } while (0)
 #endif
 
-// 定义日志级别
+// 定义日志级别 按严重程度从低到高排列
 enum LogLevel
 {
+    DEBUG,  //调试信息
     INFO,   // 普通信息
     ERROR,  // 错误信息
     FATAL,  //core信息
-    DEBUG,  //调试信息
 };
 
 // 输出一个日志类
 class Logger : noncopyable
 {
 public:
+    // 日志的输出目的地，默认写到stdout，可以替换为AsyncLogging::append
+    using OutputFunc = std::function<void(const char *msg, int len)>;
+    using FlushFunc = std::function<void()>;
+
     // 获取日志类的唯一实例对象
     static Logger &instance();
-    // 设置日志级别
-    void setLogLevel(int level);
-    // 写日志
-    void log(std::string msg);
+
+    // 运行期的最低日志级别，低于该级别的日志在格式化之前就被丢弃
+    static int logLevel() { return logLevel_.load(std::memory_order_relaxed); }
+    static void setLogLevel(int level) { logLevel_.store(level, std::memory_order_relaxed); }
+
+    // 写日志 级别随日志一起传入，不修改共享状态
+    void log(int level, const char *msg, int len);
+
+    // 需要在其他线程开始写日志之前设置
+    void setOutput(OutputFunc out) { output_ = std::move(out); }
+    void setFlush(FlushFunc flush) { flush_ = std::move(flush); }
 
 private:
-    int logLevel_;
-    Logger() {}
-};
\ No newline at end of file
+    static std::atomic_int logLevel_;
+    OutputFunc output_;
+    FlushFunc flush_;
+    Logger();
+};
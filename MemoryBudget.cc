@@ -0,0 +1,235 @@
+#include "MemoryBudget.h"
+
+#include <unordered_map>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+// 一个loop的用量 计数只由这个loop写，其他线程只读
+struct MemoryBudgetShard
+{
+    explicit MemoryBudgetShard(EventLoop *loopArg)
+        : loop(loopArg),
+          inputBytes(0),
+          outputBytes(0),
+          connections(0),
+          resumeTimerArmed(false)
+    {
+    }
+
+    struct Tracked
+    {
+        std::weak_ptr<TcpConnection> conn;
+        int64_t bytes;
+        int64_t victimBytes;  // 大于0表示已经选中关闭，选中时的字节数计入releasing_
+    };
+
+    EventLoop *const loop;
+    std::atomic<int64_t> inputBytes;
+    std::atomic<int64_t> outputBytes;
+    std::atomic<int64_t> connections;
+
+    // 只在loop线程中访问
+    std::vector<std::function<void()>> paused;
+    bool resumeTimerArmed;
+
+    std::mutex mutex;
+    std::unordered_map<TcpConnection *, Tracked> tracked;  // 受mutex保护
+};
+
+// 等待恢复读取时检查用量的间隔(秒)
+static const double kResumeCheckInterval = 0.05;
+
+MemoryBudget::MemoryBudget(const MemoryBudgetOptions &options)
+    : options_(options),
+      shardCount_(0),
+      releasing_(0),
+      rejected_(0),
+      closed_(0),
+      paused_(0)
+{
+}
+
+MemoryBudget::~MemoryBudget() = default;
+
+MemoryBudget::Shard *MemoryBudget::shardFor(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int count = shardCount_.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i)
+    {
+        if (shards_[i]->loop == loop)
+        {
+            return shards_[i].get();
+        }
+    }
+    if (count == kMaxShards)
+    {
+        LOG_FATAL("MemoryBudget: more than %d loops share one budget\n", kMaxShards);
+    }
+    shards_[count].reset(new MemoryBudgetShard(loop));
+    shardCount_.store(count + 1, std::memory_order_release);
+    return shards_[count].get();
+}
+
+int64_t MemoryBudget::used() const
+{
+    int64_t total = 0;
+    int count = shardCount_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        total += shards_[i]->inputBytes.load(std::memory_order_relaxed) +
+                 shards_[i]->outputBytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+MemoryBudget::Usage MemoryBudget::usage() const
+{
+    Usage usage;
+    usage.limitBytes = static_cast<int64_t>(options_.limitBytes);
+    usage.usedBytes = 0;
+    usage.rejectedConnections = rejected_;
+    usage.closedConnections = closed_;
+    usage.pausedReads = paused_;
+    int count = shardCount_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        const Shard &shard = *shards_[i];
+        LoopUsage loop{shard.loop, shard.inputBytes.load(std::memory_order_relaxed),
+                       shard.outputBytes.load(std::memory_order_relaxed),
+                       shard.connections.load(std::memory_order_relaxed)};
+        usage.usedBytes += loop.inputBytes + loop.outputBytes;
+        usage.loops.push_back(loop);
+    }
+    return usage;
+}
+
+void MemoryBudget::account(Shard *shard, int64_t inputDelta, int64_t outputDelta, size_t before, size_t after)
+{
+    if (inputDelta != 0)
+    {
+        shard->inputBytes.fetch_add(inputDelta, std::memory_order_relaxed);
+    }
+    if (outputDelta != 0)
+    {
+        shard->outputBytes.fetch_add(outputDelta, std::memory_order_relaxed);
+    }
+    if ((before == 0) != (after == 0))
+    {
+        shard->connections.fetch_add(after > 0 ? 1 : -1, std::memory_order_relaxed);
+    }
+}
+
+void MemoryBudget::track(Shard *shard, const TcpConnectionPtr &conn, size_t after)
+{
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if (after >= options_.trackAbove)
+    {
+        Shard::Tracked &entry = shard->tracked[conn.get()];
+        if (entry.conn.expired())
+        {
+            entry.conn = conn;
+            entry.victimBytes = 0;
+        }
+        entry.bytes = static_cast<int64_t>(after);
+        return;
+    }
+    auto it = shard->tracked.find(conn.get());
+    if (it != shard->tracked.end())
+    {
+        releasing_ -= it->second.victimBytes;
+        shard->tracked.erase(it);
+    }
+}
+
+void MemoryBudget::closeLargest()
+{
+    const int64_t limit = static_cast<int64_t>(options_.limitBytes);
+    while (used() - releasing_ > limit)
+    {
+        Shard *victimShard = nullptr;
+        TcpConnection *victim = nullptr;
+        int64_t victimBytes = 0;
+        int count = shardCount_.load(std::memory_order_acquire);
+        for (int i = 0; i < count; ++i)
+        {
+            Shard *shard = shards_[i].get();
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (auto &entry : shard->tracked)
+            {
+                if (entry.second.victimBytes == 0 && entry.second.bytes > victimBytes)
+                {
+                    victimShard = shard;
+                    victim = entry.first;
+                    victimBytes = entry.second.bytes;
+                }
+            }
+        }
+        if (victim == nullptr)
+        {
+            // 剩下的都是缓冲很少的连接，不再挑选
+            return;
+        }
+
+        TcpConnectionPtr conn;
+        {
+            std::lock_guard<std::mutex> lock(victimShard->mutex);
+            auto it = victimShard->tracked.find(victim);
+            if (it == victimShard->tracked.end() || it->second.victimBytes != 0)
+            {
+                continue;  // 挑选期间已经释放或者被其他线程选中
+            }
+            it->second.victimBytes = it->second.bytes;
+            releasing_ += it->second.bytes;
+            conn = it->second.conn.lock();
+        }
+        ++closed_;
+        if (conn)
+        {
+            LOG_ERROR("MemoryBudget: over %zu bytes, closing %s holding %ld bytes\n", options_.limitBytes,
+                      conn->name().c_str(), static_cast<long>(victimBytes));
+            conn->forceClose();
+        }
+    }
+}
+
+void MemoryBudget::resumeWhenBelow(Shard *shard, std::function<void()> resume)
+{
+    ++paused_;
+    shard->paused.push_back(std::move(resume));
+    if (!shard->resumeTimerArmed)
+    {
+        armResumeCheck(shard);
+    }
+}
+
+void MemoryBudget::armResumeCheck(Shard *shard)
+{
+    shard->resumeTimerArmed = true;
+    std::weak_ptr<MemoryBudget> weakBudget(shared_from_this());
+    shard->loop->runAfter(kResumeCheckInterval, [weakBudget, shard]() {
+        MemoryBudgetPtr budget = weakBudget.lock();
+        if (budget)
+        {
+            budget->checkResume(shard);
+        }
+    });
+}
+
+void MemoryBudget::checkResume(Shard *shard)
+{
+    shard->resumeTimerArmed = false;
+    if (used() > static_cast<int64_t>(options_.limitBytes * options_.resumeRatio))
+    {
+        armResumeCheck(shard);
+        return;
+    }
+    std::vector<std::function<void()>> paused;
+    paused.swap(shard->paused);
+    for (const std::function<void()> &resume : paused)
+    {
+        resume();
+    }
+}
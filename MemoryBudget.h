@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Callbacks.h"
+#include "noncopyable.h"
+
+class EventLoop;
+struct MemoryBudgetShard;
+
+struct MemoryBudgetOptions
+{
+    enum Policy
+    {
+        kRejectSends,   // 超出预算后，还要往输出缓冲区追加数据的连接不再接受新的数据，发完已有的数据后关闭
+        kCloseLargest,  // 超出预算后，强制关闭缓冲数据最多的连接，直到回到预算以内
+        kPauseReads,    // 超出预算后，缓冲数据还在增长的连接停止读取，降到limitBytes * resumeRatio以下再恢复
+    };
+
+    size_t limitBytes = 256 * 1024 * 1024;  // 所有连接输入、输出缓冲区中数据的总量上限
+    Policy policy = kPauseReads;
+    double resumeRatio = 0.8;
+    size_t trackAbove = 64 * 1024;  // 缓冲超过这个值的连接才参与kCloseLargest的挑选
+};
+
+/**
+ * 全局的缓冲区内存预算 同一个预算可以由多个TcpServer/TcpClient共享
+ * 连接在自己的loop线程中上报输入、输出缓冲区中数据量的变化，计数按loop分片，各个loop只写自己的分片；
+ * 统计的是缓冲区中还没有处理/发送的数据，sendFile()排队的文件段不占用内存，不计入
+ * usage()可以在任意线程中调用，得到每个loop的用量和各个策略触发的次数
+ * 需要通过std::make_shared创建，等待恢复读取的定时器只持有weak_ptr
+ */
+class MemoryBudget : noncopyable, public std::enable_shared_from_this<MemoryBudget>
+{
+public:
+    struct LoopUsage
+    {
+        EventLoop *loop;
+        int64_t inputBytes;
+        int64_t outputBytes;
+        int64_t connections;  // 缓冲区中有数据的连接数
+    };
+
+    struct Usage
+    {
+        int64_t limitBytes;
+        int64_t usedBytes;
+        int64_t rejectedConnections;  // kRejectSends拒绝继续发送的连接数
+        int64_t closedConnections;    // kCloseLargest关闭的连接数
+        int64_t pausedReads;          // kPauseReads停止读取的次数
+        std::vector<LoopUsage> loops;
+    };
+
+    explicit MemoryBudget(const MemoryBudgetOptions &options = MemoryBudgetOptions());
+    ~MemoryBudget();
+
+    const MemoryBudgetOptions &options() const { return options_; }
+    int64_t used() const;
+    bool exceeded() const { return used() > static_cast<int64_t>(options_.limitBytes); }
+    Usage usage() const;
+
+    // 以下由TcpConnection在所属的loop线程中调用
+    using Shard = MemoryBudgetShard;
+    Shard *shardFor(EventLoop *loop);
+    // 连接缓冲的数据从before变为after
+    void account(Shard *shard, int64_t inputDelta, int64_t outputDelta, size_t before, size_t after);
+    // 更新大连接的记录 after小于trackAbove时不再跟踪
+    void track(Shard *shard, const TcpConnectionPtr &conn, size_t after);
+    // kCloseLargest 挑出缓冲最多的连接强制关闭，直到扣除正在关闭的连接后回到预算以内
+    void closeLargest();
+    // kPauseReads 用量降到恢复线以下时在shard的loop线程中调用resume
+    void resumeWhenBelow(Shard *shard, std::function<void()> resume);
+    void countRejected() { ++rejected_; }
+
+private:
+    void armResumeCheck(Shard *shard);
+    void checkResume(Shard *shard);
+
+    static const int kMaxShards = 256;
+
+    const MemoryBudgetOptions options_;
+    std::mutex mutex_;  // 保护新增分片
+    std::unique_ptr<Shard> shards_[kMaxShards];
+    std::atomic_int shardCount_;
+    std::atomic<int64_t> releasing_;  // 已经选中关闭、还没有释放的字节数
+    std::atomic<int64_t> rejected_;
+    std::atomic<int64_t> closed_;
+    std::atomic<int64_t> paused_;
+};
+
+using MemoryBudgetPtr = std::shared_ptr<MemoryBudget>;
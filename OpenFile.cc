@@ -0,0 +1,31 @@
+#include "OpenFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+std::shared_ptr<OpenFile> OpenFile::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    return std::shared_ptr<OpenFile>(new OpenFile(fd, st));
+}
+
+OpenFile::OpenFile(int fd, const struct stat &st)
+    : fd_(fd),
+      stat_(st)
+{
+}
+
+OpenFile::~OpenFile()
+{
+    ::close(fd_);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
+#include "noncopyable.h"
+
+/**
+ * 只读打开的文件 最后一个shared_ptr释放时关闭fd
+ * 文件缓存和正在用sendfile发送它的连接共享同一个对象，缓存淘汰时不会关闭还在发送的fd
+ */
+class OpenFile : noncopyable
+{
+public:
+    // 打开失败返回nullptr，errno保留open/fstat的错误
+    static std::shared_ptr<OpenFile> open(const std::string &path);
+
+    ~OpenFile();
+
+    int fd() const { return fd_; }
+    // 打开时fstat的结果
+    const struct stat &stat() const { return stat_; }
+    off_t size() const { return stat_.st_size; }
+
+private:
+    OpenFile(int fd, const struct stat &st);
+
+    const int fd_;
+    const struct stat stat_;
+};
@@ -0,0 +1,320 @@
+#include "RpcClient.h"
+
+#include <limits.h>
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 客户端的全部状态 连接回调、定时器和跨线程投递的任务只持有weak_ptr
+struct RpcClient::State
+{
+    State(EventLoop *loopArg, const RpcClientOptions &optionsArg)
+        : loop(loopArg),
+          options(optionsArg),
+          nextCallId(1),
+          flushQueued(false),
+          timerArmed(false)
+    {
+    }
+
+    struct Call
+    {
+        RpcCallback callback;
+        Timestamp deadline;
+    };
+
+    // 其他线程发起的调用 参数拷贝一份交给loop线程
+    struct QueuedCall
+    {
+        std::string method;
+        std::string request;
+        Timestamp deadline;
+        RpcCallback callback;
+    };
+
+    EventLoop *loop;
+    const RpcClientOptions options;
+    ConnectionCallback connectionCallback;
+
+    // 以下只在loop线程中访问
+    TcpConnectionPtr conn;
+    Buffer unsent;  // 连接建立之前发起的调用
+    uint64_t nextCallId;
+    std::unordered_map<uint64_t, Call> pending;  // 已经发起还没有结束的调用
+    bool flushQueued;
+    bool timerArmed;
+
+    std::mutex mutex;
+    std::vector<QueuedCall> incoming;  // 受mutex保护 由空变为非空时才queueInLoop一次
+};
+
+RpcClient::RpcClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &name,
+                     const RpcClientOptions &options)
+    : client_(loop, serverAddr, name),
+      state_(std::make_shared<State>(loop, options))
+{
+    std::weak_ptr<State> weakState(state_);
+    client_.setConnectionCallback([weakState](const TcpConnectionPtr &conn) {
+        RpcClient::onConnection(weakState, conn);
+    });
+    client_.setMessageCallback([weakState](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        RpcClient::onMessage(weakState, conn, buf);
+    });
+}
+
+// state_先于client_析构，TcpClient析构时连接只剩它自己持有，会被关闭
+RpcClient::~RpcClient() = default;
+
+void RpcClient::setConnectionCallback(const ConnectionCallback &cb)
+{
+    state_->connectionCallback = cb;
+}
+
+void RpcClient::call(const std::string &method, const StringPiece &request, double timeout, const RpcCallback &cb)
+{
+    call(method, request, timeout > 0 ? addTime(Timestamp::now(), timeout) : Timestamp::invalid(), cb);
+}
+
+void RpcClient::call(const std::string &method, const StringPiece &request, Timestamp deadline,
+                     const RpcCallback &cb)
+{
+    if (method.size() > UINT16_MAX)
+    {
+        LOG_ERROR("RpcClient::call method name too long: %zu bytes\n", method.size());
+        return;
+    }
+    EventLoop *loop = state_->loop;
+    if (loop->isInLoopThread())
+    {
+        callInLoop(state_, method, request, deadline, cb);
+        return;
+    }
+
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        wasEmpty = state_->incoming.empty();
+        state_->incoming.push_back(State::QueuedCall{method, request.asString(), deadline, cb});
+    }
+    if (wasEmpty)
+    {
+        std::weak_ptr<State> weakState(state_);
+        loop->queueInLoop([weakState]() {
+            StatePtr state = weakState.lock();
+            if (state)
+            {
+                drainIncoming(state);
+            }
+        });
+    }
+}
+
+void RpcClient::callInLoop(const StatePtr &state, const StringPiece &method, const StringPiece &request,
+                           Timestamp deadline, const RpcCallback &cb)
+{
+    uint32_t timeoutMs = 0;
+    if (deadline.valid())
+    {
+        int64_t remaining = deadline.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+        if (remaining <= 0)
+        {
+            // 期限已过的调用不再发出 回调推迟执行，不在call()里面直接回调
+            std::weak_ptr<State> weakState(state);
+            state->loop->queueInLoop([weakState, cb]() {
+                if (weakState.lock())
+                {
+                    cb(kRpcDeadlineExceeded, StringPiece());
+                }
+            });
+            return;
+        }
+        timeoutMs = static_cast<uint32_t>(std::min<int64_t>((remaining + 999) / 1000, UINT32_MAX));
+    }
+
+    uint64_t callId = state->nextCallId++;
+    State::Call &call = state->pending[callId];
+    call.callback = cb;
+    call.deadline = deadline;
+
+    bool connected = state->conn && state->conn->connected();
+    Buffer *out = connected ? state->conn->outputBuffer() : &state->unsent;
+    RpcCodec::appendRequest(out, callId, timeoutMs, method, request);
+    if (deadline.valid())
+    {
+        armTimer(state);
+    }
+    if (connected)
+    {
+        scheduleFlush(state);
+    }
+}
+
+void RpcClient::drainIncoming(const StatePtr &state)
+{
+    std::vector<State::QueuedCall> calls;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        calls.swap(state->incoming);
+    }
+    for (const State::QueuedCall &call : calls)
+    {
+        callInLoop(state, call.method, call.request, call.deadline, call.callback);
+    }
+    // 一批调用已经都在输出缓冲区里，直接发出
+    if (state->conn)
+    {
+        state->conn->flushOutput();
+    }
+}
+
+void RpcClient::scheduleFlush(const StatePtr &state)
+{
+    if (state->flushQueued)
+    {
+        return;
+    }
+    // loop线程中的queueInLoop在这一轮循环末尾执行，这一轮中发起的调用合并成一次write
+    state->flushQueued = true;
+    std::weak_ptr<State> weakState(state);
+    state->loop->queueInLoop([weakState]() {
+        StatePtr s = weakState.lock();
+        if (s)
+        {
+            s->flushQueued = false;
+            if (s->conn)
+            {
+                s->conn->flushOutput();
+            }
+        }
+    });
+}
+
+void RpcClient::armTimer(const StatePtr &state)
+{
+    if (state->timerArmed)
+    {
+        return;
+    }
+    // 一个周期性检查的定时器，而不是每个调用一个定时器
+    state->timerArmed = true;
+    std::weak_ptr<State> weakState(state);
+    state->loop->runAfter(state->options.timeoutCheckInterval, [weakState]() {
+        StatePtr s = weakState.lock();
+        if (s)
+        {
+            s->timerArmed = false;
+            checkTimeouts(s);
+        }
+    });
+}
+
+void RpcClient::checkTimeouts(const StatePtr &state)
+{
+    Timestamp now = Timestamp::now();
+    std::vector<RpcCallback> expired;
+    bool remaining = false;
+    for (auto it = state->pending.begin(); it != state->pending.end();)
+    {
+        const Timestamp &deadline = it->second.deadline;
+        if (deadline.valid() && deadline < now)
+        {
+            expired.push_back(std::move(it->second.callback));
+            it = state->pending.erase(it);
+            continue;
+        }
+        remaining = remaining || deadline.valid();
+        ++it;
+    }
+    if (remaining)
+    {
+        armTimer(state);
+    }
+    for (const RpcCallback &cb : expired)
+    {
+        cb(kRpcDeadlineExceeded, StringPiece());
+    }
+}
+
+void RpcClient::failAll(const StatePtr &state, RpcStatus status)
+{
+    std::unordered_map<uint64_t, State::Call> calls;
+    calls.swap(state->pending);
+    for (auto &entry : calls)
+    {
+        entry.second.callback(status, StringPiece());
+    }
+}
+
+void RpcClient::onConnection(const std::weak_ptr<State> &weakState, const TcpConnectionPtr &conn)
+{
+    StatePtr state = weakState.lock();
+    if (!state)
+    {
+        return;
+    }
+    if (conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        state->conn = conn;
+        if (state->unsent.readableBytes() > 0)
+        {
+            conn->outputBuffer()->append(state->unsent.peek(), state->unsent.readableBytes());
+            state->unsent.retrieveAll();
+            conn->flushOutput();
+        }
+    }
+    else
+    {
+        state->conn.reset();
+        failAll(state, kRpcConnectionClosed);
+    }
+    if (state->connectionCallback)
+    {
+        state->connectionCallback(conn);
+    }
+}
+
+void RpcClient::onMessage(const std::weak_ptr<State> &weakState, const TcpConnectionPtr &conn, Buffer *buf)
+{
+    StatePtr state = weakState.lock();
+    if (!state)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    while (true)
+    {
+        RpcFrame frame;
+        RpcCodec::DecodeResult result = RpcCodec::decode(buf, state->options.maxFrameBytes, &frame);
+        if (result == RpcCodec::kNeedMore)
+        {
+            break;
+        }
+        if (result == RpcCodec::kError || frame.type != RpcFrame::kResponse)
+        {
+            LOG_ERROR("RpcClient bad frame from %s, closing\n", conn->peerAddress().toIpPort().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        // 超时的调用已经结束，迟到的应答直接丢弃
+        auto it = state->pending.find(frame.callId);
+        if (it != state->pending.end())
+        {
+            RpcCallback cb(std::move(it->second.callback));
+            state->pending.erase(it);
+            // response指向输入缓冲区，回调返回后才retrieve
+            cb(static_cast<RpcStatus>(frame.status), frame.payload);
+        }
+        buf->retrieve(frame.length);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "Callbacks.h"
+#include "RpcCodec.h"
+#include "TcpClient.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+struct RpcClientOptions
+{
+    size_t maxFrameBytes = 16 * 1024 * 1024;  // 超过时关闭连接
+    double timeoutCheckInterval = 0.01;       // 检查超时调用的间隔(秒)，超时的判定最多晚这么久
+};
+
+// 调用结束时在RpcClient的loop线程中执行 response只在回调期间有效
+// status不是kRpcOk时，kRpcApplicationError的response是错误信息，其他情况为空
+using RpcCallback = std::function<void(RpcStatus status, const StringPiece &response)>;
+
+/**
+ * 多路复用的RPC客户端 所有调用共享一个TcpConnection，请求带callId，应答可以乱序返回
+ * - loop线程中发起的调用直接编码进输出缓冲区，同一轮循环中发起的调用(包括在应答回调里发起的)
+ *   在这一轮结束前合并成一次write；其他线程发起的调用攒成一批投递给loop
+ * - 每个调用可以带期限，期限随请求发给服务端；到期还没有应答时以kRpcDeadlineExceeded结束，
+ *   之后到达的应答被丢弃
+ * - 连接建立之前发起的调用先缓存，连接建立后一起发出；连接断开时所有未结束的调用以kRpcConnectionClosed结束
+ * - RpcClient析构之后不再执行任何回调，需要在loop线程中析构
+ */
+class RpcClient : noncopyable
+{
+public:
+    RpcClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &name,
+              const RpcClientOptions &options = RpcClientOptions());
+    ~RpcClient();
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+    void enableRetry() { client_.enableRetry(); }
+    // 通过TLS连接服务端，在connect()之前设置
+    void setTlsContext(const TlsContextPtr &context, const std::string &serverName = "")
+    {
+        client_.setTlsContext(context, serverName);
+    }
+    // 非线程安全 需要在connect()之前设置
+    void setConnectionCallback(const ConnectionCallback &cb);
+
+    // 以下可以在任意线程调用 方法名最长65535字节
+    // timeout秒后还没有应答则超时，timeout<=0表示没有期限
+    void call(const std::string &method, const StringPiece &request, double timeout, const RpcCallback &cb);
+    // 使用绝对期限，例如服务端处理函数发起下游调用时传入RpcResponder::deadline()
+    // 无效的Timestamp表示没有期限
+    void call(const std::string &method, const StringPiece &request, Timestamp deadline, const RpcCallback &cb);
+
+    EventLoop *getLoop() const { return client_.getLoop(); }
+    TcpConnectionPtr connection() { return client_.connection(); }
+
+private:
+    struct State;
+    using StatePtr = std::shared_ptr<State>;
+
+    static void onConnection(const std::weak_ptr<State> &weakState, const TcpConnectionPtr &conn);
+    static void onMessage(const std::weak_ptr<State> &weakState, const TcpConnectionPtr &conn, Buffer *buf);
+    static void callInLoop(const StatePtr &state, const StringPiece &method, const StringPiece &request,
+                           Timestamp deadline, const RpcCallback &cb);
+    static void drainIncoming(const StatePtr &state);
+    static void scheduleFlush(const StatePtr &state);
+    static void armTimer(const StatePtr &state);
+    static void checkTimeouts(const StatePtr &state);
+    static void failAll(const StatePtr &state, RpcStatus status);
+
+    TcpClient client_;
+    StatePtr state_;  // 连接回调和定时器只持有weak_ptr，RpcClient析构后它们什么也不做
+};
@@ -0,0 +1,112 @@
+#include "RpcCodec.h"
+
+#include <endian.h>
+#include <string.h>
+
+#include "Buffer.h"
+
+const char *rpcStatusName(int status)
+{
+    switch (status)
+    {
+    case kRpcOk:
+        return "OK";
+    case kRpcMethodNotFound:
+        return "MethodNotFound";
+    case kRpcDeadlineExceeded:
+        return "DeadlineExceeded";
+    case kRpcApplicationError:
+        return "ApplicationError";
+    case kRpcConnectionClosed:
+        return "ConnectionClosed";
+    default:
+        return "Unknown";
+    }
+}
+
+static uint16_t readUint16(const char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof v);
+    return be16toh(v);
+}
+
+static uint32_t readUint32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return be32toh(v);
+}
+
+static uint64_t readUint64(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return be64toh(v);
+}
+
+static void writeHeader(Buffer *buf, RpcFrame::Type type, uint8_t status, uint64_t callId, uint32_t timeoutMs,
+                        const StringPiece &method, const StringPiece &payload)
+{
+    size_t bodyLength = RpcCodec::kHeaderLength - 4 + method.size() + payload.size();
+    buf->ensureWriteableBytes(4 + bodyLength);
+    char *p = buf->beginWrite();
+    uint32_t length = htobe32(static_cast<uint32_t>(bodyLength));
+    uint16_t methodLength = htobe16(static_cast<uint16_t>(method.size()));
+    uint64_t id = htobe64(callId);
+    uint32_t timeout = htobe32(timeoutMs);
+    memcpy(p, &length, 4);
+    p[4] = static_cast<char>(type);
+    p[5] = static_cast<char>(status);
+    memcpy(p + 6, &methodLength, 2);
+    memcpy(p + 8, &id, 8);
+    memcpy(p + 16, &timeout, 4);
+    buf->hasWritten(RpcCodec::kHeaderLength);
+}
+
+namespace RpcCodec
+{
+DecodeResult decode(const Buffer *buf, size_t maxFrameBytes, RpcFrame *frame)
+{
+    if (buf->readableBytes() < kHeaderLength)
+    {
+        return kNeedMore;
+    }
+    const char *p = buf->peek();
+    size_t bodyLength = readUint32(p);
+    size_t methodLength = readUint16(p + 6);
+    uint8_t type = static_cast<uint8_t>(p[4]);
+    // 头部长度已经确定时就可以判断出错误，不必等整帧到齐
+    if (bodyLength + 4 > maxFrameBytes || bodyLength < kHeaderLength - 4 ||
+        methodLength > bodyLength - (kHeaderLength - 4) || type > RpcFrame::kResponse)
+    {
+        return kError;
+    }
+    if (buf->readableBytes() < bodyLength + 4)
+    {
+        return kNeedMore;
+    }
+    frame->type = static_cast<RpcFrame::Type>(type);
+    frame->status = static_cast<uint8_t>(p[5]);
+    frame->callId = readUint64(p + 8);
+    frame->timeoutMs = readUint32(p + 16);
+    frame->method = StringPiece(p + kHeaderLength, methodLength);
+    frame->payload = StringPiece(p + kHeaderLength + methodLength, bodyLength + 4 - kHeaderLength - methodLength);
+    frame->length = bodyLength + 4;
+    return kGotFrame;
+}
+
+void appendRequest(Buffer *buf, uint64_t callId, uint32_t timeoutMs,
+                   const StringPiece &method, const StringPiece &payload)
+{
+    writeHeader(buf, RpcFrame::kRequest, 0, callId, timeoutMs, method, payload);
+    buf->append(method.data(), method.size());
+    buf->append(payload.data(), payload.size());
+}
+
+void appendResponse(Buffer *buf, uint64_t callId, RpcStatus status, const StringPiece &payload)
+{
+    writeHeader(buf, RpcFrame::kResponse, static_cast<uint8_t>(status), callId, 0, StringPiece(), payload);
+    buf->append(payload.data(), payload.size());
+}
+}  // namespace RpcCodec
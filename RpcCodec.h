@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "StringPiece.h"
+
+class Buffer;
+
+// 调用的结果 由服务端写在应答帧中，kRpcConnectionClosed和客户端超时由客户端本地产生
+enum RpcStatus
+{
+    kRpcOk = 0,
+    kRpcMethodNotFound = 1,
+    kRpcDeadlineExceeded = 2,  // 客户端等待超时，或者服务端应答时已经过了调用方的期限
+    kRpcApplicationError = 3,  // 处理函数返回的错误，payload是错误信息
+    kRpcConnectionClosed = 4,  // 应答到达之前连接断开
+};
+
+const char *rpcStatusName(int status);
+
+// 解码出的一帧 method和payload指向输入缓冲区，处理完之后再retrieve(length)
+struct RpcFrame
+{
+    enum Type
+    {
+        kRequest = 0,
+        kResponse = 1,
+    };
+
+    Type type;
+    uint8_t status;
+    uint64_t callId;
+    uint32_t timeoutMs;
+    StringPiece method;
+    StringPiece payload;
+    size_t length;  // 整帧的字节数
+};
+
+/**
+ * RPC的二进制帧格式 整数都是网络字节序
+ *   uint32 length     之后的字节数(头部剩下的16字节 + method + payload)
+ *   uint8  type       kRequest / kResponse
+ *   uint8  status     应答的RpcStatus，请求中为0
+ *   uint16 methodLen  请求的方法名长度，应答中为0
+ *   uint64 callId     由客户端分配，应答原样带回，一个连接上同时在途的多个调用靠它对应
+ *   uint32 timeoutMs  请求发出时调用方剩余的期限(毫秒)，0表示没有期限
+ *   method payload
+ * 编码直接写入Buffer的可写区域，解码直接读输入缓冲区，都不经过中间string
+ */
+namespace RpcCodec
+{
+const size_t kHeaderLength = 20;
+
+enum DecodeResult
+{
+    kNeedMore,
+    kGotFrame,
+    kError,  // 长度超过maxFrameBytes或者格式错误，连接应当关闭
+};
+
+DecodeResult decode(const Buffer *buf, size_t maxFrameBytes, RpcFrame *frame);
+
+void appendRequest(Buffer *buf, uint64_t callId, uint32_t timeoutMs,
+                   const StringPiece &method, const StringPiece &payload);
+void appendResponse(Buffer *buf, uint64_t callId, RpcStatus status, const StringPiece &payload);
+}  // namespace RpcCodec
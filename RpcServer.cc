@@ -0,0 +1,155 @@
+#include "RpcServer.h"
+
+#include "Logger.h"
+
+// start()时固定下来的方法表和参数 连接持有一份引用，RpcServer先析构也不影响还没有完成的应答
+struct RpcServer::Handlers
+{
+    std::unordered_map<std::string, RpcMethod> methods;
+    RpcServerOptions options;
+};
+
+// 每个连接的状态 保存在TcpConnection的context中，只在连接所属的loop线程中访问
+struct RpcServer::Session
+{
+    explicit Session(const std::shared_ptr<const Handlers> &handlersArg)
+        : handlers(handlersArg),
+          processing(false),
+          flushQueued(false)
+    {
+    }
+
+    std::shared_ptr<const Handlers> handlers;
+    std::string method;  // 复用的方法名，查表时不必每次构造string
+    bool processing;     // 正在onMessage中，应答由它最后统一flush
+    bool flushQueued;    // 已经queueInLoop了一次flush
+};
+
+void RpcResponder::send(RpcStatus status, const StringPiece &payload) const
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn)
+    {
+        return;
+    }
+    bool late = deadline_.valid() && deadline_ < Timestamp::now();
+    if (late)
+    {
+        status = kRpcDeadlineExceeded;
+    }
+    StringPiece data = late ? StringPiece() : payload;
+
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        RpcServer::Session *session = static_cast<RpcServer::Session *>(conn->getContext().get());
+        if (session != nullptr && conn->connected())
+        {
+            RpcCodec::appendResponse(conn->outputBuffer(), callId_, status, data);
+            RpcServer::scheduleFlush(conn, session);
+        }
+    }
+    else
+    {
+        // 在当前线程编码，loop线程只需要拷贝到输出缓冲区
+        std::shared_ptr<Buffer> frame = std::make_shared<Buffer>(RpcCodec::kHeaderLength + data.size());
+        RpcCodec::appendResponse(frame.get(), callId_, status, data);
+        loop->queueInLoop([conn, frame]() {
+            RpcServer::Session *session = static_cast<RpcServer::Session *>(conn->getContext().get());
+            if (session != nullptr && conn->connected())
+            {
+                conn->outputBuffer()->append(frame->peek(), frame->readableBytes());
+                RpcServer::scheduleFlush(conn, session);
+            }
+        });
+    }
+}
+
+RpcServer::RpcServer(EventLoop *loop,
+                     const InetAddress &listenAddr,
+                     const std::string &name,
+                     TcpServer::Option option)
+    : server_(loop, listenAddr, name, option)
+{
+    server_.setConnectionCallback(std::bind(&RpcServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&RpcServer::onMessage, this,
+                                         std::placeholders::_1,
+                                         std::placeholders::_2,
+                                         std::placeholders::_3));
+}
+
+RpcServer::~RpcServer() = default;
+
+void RpcServer::start()
+{
+    std::shared_ptr<Handlers> handlers = std::make_shared<Handlers>();
+    handlers->methods = methods_;
+    handlers->options = options_;
+    handlers_ = handlers;
+    server_.start();
+}
+
+void RpcServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        // 应答已经按批合并，不需要Nagle再合并
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<Session>(handlers_));
+    }
+}
+
+void RpcServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    Session *session = static_cast<Session *>(conn->getContext().get());
+    const Handlers &handlers = *session->handlers;
+    session->processing = true;
+    while (true)
+    {
+        RpcFrame frame;
+        RpcCodec::DecodeResult result = RpcCodec::decode(buf, handlers.options.maxFrameBytes, &frame);
+        if (result == RpcCodec::kNeedMore)
+        {
+            break;
+        }
+        if (result == RpcCodec::kError || frame.type != RpcFrame::kRequest)
+        {
+            LOG_ERROR("RpcServer bad frame from %s, closing\n", conn->peerAddress().toIpPort().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        // 期限从收到请求的时刻开始计算，不依赖两端的时钟一致
+        Timestamp deadline = frame.timeoutMs > 0 ? addTime(receiveTime, frame.timeoutMs / 1000.0)
+                                                 : Timestamp::invalid();
+        session->method.assign(frame.method.data(), frame.method.size());
+        auto it = handlers.methods.find(session->method);
+        if (it == handlers.methods.end())
+        {
+            RpcCodec::appendResponse(conn->outputBuffer(), frame.callId, kRpcMethodNotFound, StringPiece());
+        }
+        else
+        {
+            it->second(frame.payload, RpcResponder(conn, frame.callId, deadline));
+        }
+        buf->retrieve(frame.length);
+    }
+    session->processing = false;
+    conn->flushOutput();
+}
+
+void RpcServer::scheduleFlush(const TcpConnectionPtr &conn, Session *session)
+{
+    if (session->processing || session->flushQueued)
+    {
+        return;
+    }
+    // 同一轮循环中的多个应答(定时器、其他线程投递回来的结果)合并成一次write
+    session->flushQueued = true;
+    conn->getLoop()->queueInLoop([conn]() {
+        Session *s = static_cast<Session *>(conn->getContext().get());
+        s->flushQueued = false;
+        conn->flushOutput();
+    });
+}
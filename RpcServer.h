@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "RpcCodec.h"
+#include "TcpServer.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+struct RpcServerOptions
+{
+    size_t maxFrameBytes = 16 * 1024 * 1024;  // 超过时关闭连接
+};
+
+/**
+ * 一次调用的应答句柄 处理函数可以直接应答，也可以把它交给其他线程或者下游调用，完成后再应答
+ * 每个调用必须且只能应答一次；连接已经关闭时什么也不做
+ * 已经过了调用方的期限时，应答改为不带数据的kRpcDeadlineExceeded(调用方已经放弃等待)
+ */
+class RpcResponder
+{
+public:
+    RpcResponder() : callId_(0) {}
+
+    // 可以在任意线程调用
+    void reply(const StringPiece &response) const { send(kRpcOk, response); }
+    void fail(const StringPiece &message) const { send(kRpcApplicationError, message); }
+
+    // 调用方的期限 请求没有携带期限时返回无效的Timestamp
+    // 处理函数发起下游调用时把它传给RpcClient::call，期限就沿着调用链传递下去
+    Timestamp deadline() const { return deadline_; }
+    bool expired() const { return deadline_.valid() && deadline_ < Timestamp::now(); }
+
+private:
+    friend class RpcServer;
+    RpcResponder(const TcpConnectionPtr &conn, uint64_t callId, Timestamp deadline)
+        : conn_(conn),
+          callId_(callId),
+          deadline_(deadline)
+    {
+    }
+
+    void send(RpcStatus status, const StringPiece &payload) const;
+
+    std::weak_ptr<TcpConnection> conn_;
+    uint64_t callId_;
+    Timestamp deadline_;
+};
+
+/**
+ * 基于TcpServer的多路复用RPC服务器 帧格式见RpcCodec.h
+ * - 一个连接上可以同时有任意多个调用在途，应答用callId对应，先完成的先发，不需要排序
+ * - 请求直接从输入缓冲区解码，request指向输入缓冲区，只在处理函数执行期间有效
+ * - 一次onMessage中解码出的所有请求的应答写入输出缓冲区，最后合并成一次write；
+ *   其他线程发来的应答在loop中攒到一起，下一轮循环开始前一次flush
+ * - 方法表在start()时固定，按方法名查找
+ */
+class RpcServer : noncopyable
+{
+public:
+    using RpcMethod = std::function<void(const StringPiece &request, const RpcResponder &responder)>;
+
+    RpcServer(EventLoop *loop,
+              const InetAddress &listenAddr,
+              const std::string &name,
+              TcpServer::Option option = TcpServer::kNoReusePort);
+    ~RpcServer();
+
+    // 以下设置需要在start()之前调用
+    void registerMethod(const std::string &name, const RpcMethod &method) { methods_[name] = method; }
+    void setOptions(const RpcServerOptions &options) { options_ = options; }
+    void setThreadInitCallback(const TcpServer::ThreadInitCallback &cb) { server_.setThreadInitCallback(cb); }
+    void setThreadNumber(int numThreads) { server_.setThreadNumber(numThreads); }
+    // 只接受TLS连接，在start()之前设置
+    void setTlsContext(const TlsContextPtr &context) { server_.setTlsContext(context); }
+    void setFlowControl(const TcpFlowControl &flowControl) { server_.setFlowControl(flowControl); }
+    void setMemoryBudget(const MemoryBudgetPtr &budget) { server_.setMemoryBudget(budget); }
+    void setSocketOptions(const SocketOptions &options) { server_.setSocketOptions(options); }
+
+    void start();
+    void drain(double deadlineSeconds, const TcpServer::DrainedCallback &cb) { server_.drain(deadlineSeconds, cb); }
+    // 交给ListenerHandoff登记
+    TcpServer *tcpServer() { return &server_; }
+
+private:
+    struct Handlers;
+    struct Session;
+    friend class RpcResponder;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    static void scheduleFlush(const TcpConnectionPtr &conn, Session *session);
+
+    TcpServer server_;
+    RpcServerOptions options_;
+    std::unordered_map<std::string, RpcMethod> methods_;
+    std::shared_ptr<const Handlers> handlers_;  // start()时创建，所有连接共享
+};
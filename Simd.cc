@@ -0,0 +1,400 @@
+#include "Simd.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MYMUDUO_SIMD_X86 1
+#endif
+
+// 把掩码转动offset个字节，转动后的掩码从data[0]开始按4字节对齐使用
+static uint32_t rotateKey(uint32_t key, size_t offset)
+{
+    unsigned char bytes[4];
+    unsigned char rotated[4];
+    memcpy(bytes, &key, 4);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        rotated[i] = bytes[(offset + i) & 3];
+    }
+    uint32_t result;
+    memcpy(&result, rotated, 4);
+    return result;
+}
+
+static void maskScalar(char *data, size_t len, uint32_t key)
+{
+    unsigned char bytes[8];
+    memcpy(bytes, &key, 4);
+    memcpy(bytes + 4, &key, 4);
+    uint64_t key8;
+    memcpy(&key8, bytes, 8);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= key8;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i)
+    {
+        data[i] ^= bytes[i & 3];
+    }
+}
+
+// 返回下一个字符的起始位置，编码不合法时返回nullptr
+static const unsigned char *skipUtf8Sequence(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char c = *p;
+    size_t continuations;
+    unsigned char low = 0x80;  // 第二个字节的合法范围，排除超长编码、代理区和超过U+10FFFF的码点
+    unsigned char high = 0xBF;
+    if (c < 0x80)
+    {
+        return p + 1;
+    }
+    else if (c < 0xC2)
+    {
+        return nullptr;
+    }
+    else if (c < 0xE0)
+    {
+        continuations = 1;
+    }
+    else if (c < 0xF0)
+    {
+        continuations = 2;
+        if (c == 0xE0)
+            low = 0xA0;
+        else if (c == 0xED)
+            high = 0x9F;
+    }
+    else if (c < 0xF5)
+    {
+        continuations = 3;
+        if (c == 0xF0)
+            low = 0x90;
+        else if (c == 0xF4)
+            high = 0x8F;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    if (static_cast<size_t>(end - p) <= continuations || p[1] < low || p[1] > high)
+    {
+        return nullptr;
+    }
+    for (size_t i = 2; i <= continuations; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            return nullptr;
+        }
+    }
+    return p + continuations + 1;
+}
+
+static bool utf8Scalar(const unsigned char *p, size_t len)
+{
+    const unsigned char *end = p + len;
+    while (p < end)
+    {
+        // 8个字节都是ASCII时一次跳过
+        if (end - p >= 8)
+        {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            if ((v & 0x8080808080808080ULL) == 0)
+            {
+                p += 8;
+                continue;
+            }
+        }
+        p = skipUtf8Sequence(p, end);
+        if (p == nullptr)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef MYMUDUO_SIMD_X86
+
+static void maskSse2(char *data, size_t len, uint32_t key)
+{
+    const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), k));
+    }
+    maskScalar(data + i, len - i, key);
+}
+
+// SSE2没有pshufb，不能用查表法校验多字节字符；只用SIMD跳过ASCII，遇到非ASCII字符时逐个标量校验
+static bool utf8Sse2(const unsigned char *p, size_t len)
+{
+    const unsigned char *end = p + len;
+    while (end - p >= 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        if (mask == 0)
+        {
+            p += 16;
+            continue;
+        }
+        p += __builtin_ctz(mask);
+        do
+        {
+            p = skipUtf8Sequence(p, end);
+            if (p == nullptr)
+            {
+                return false;
+            }
+        } while (p < end && *p >= 0x80);
+    }
+    return utf8Scalar(p, end - p);
+}
+
+__attribute__((target("avx2"))) static void maskAvx2(char *data, size_t len, uint32_t key)
+{
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), k));
+    }
+    maskSse2(data + i, len - i, key);
+}
+
+/**
+ * AVX2查表法校验UTF-8 (Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte")
+ * 每个字节和它前面的字节组成一对，用两个字节的高4位和前一个字节的低4位查三张表，
+ * 三个结果按位与之后每一位代表一类错误；三、四字节字符的后续字节由前2、3个字节单独判断
+ * 一次处理32个字节，块之间通过上一块的最后3个字节衔接
+ */
+static const uint8_t kTooShort = 1 << 0;     // 11______ 0_______ 或 11______ 11______
+static const uint8_t kTooLong = 1 << 1;      // 0_______ 10______
+static const uint8_t kOverlong3 = 1 << 2;    // 11100000 100_____
+static const uint8_t kTooLarge = 1 << 3;     // 11110100 1001____ 等大于U+10FFFF的码点
+static const uint8_t kSurrogate = 1 << 4;    // 11101101 101_____
+static const uint8_t kOverlong2 = 1 << 5;    // 1100000_ 10______
+static const uint8_t kTooLarge1000 = 1 << 6; // 11110101 1000____ 等
+static const uint8_t kOverlong4 = 1 << 6;    // 11110000 1000____
+static const uint8_t kTwoConts = 1 << 7;     // 10______ 10______
+static const uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+static const uint8_t kByte1High[16] = {
+    // 0_______ ASCII
+    kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+    // 10______ 后续字节
+    kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+    // 1100____
+    kTooShort | kOverlong2,
+    // 1101____
+    kTooShort,
+    // 1110____
+    kTooShort | kOverlong3 | kSurrogate,
+    // 1111____
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+static const uint8_t kByte1Low[16] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,  // ____0000
+    kCarry | kOverlong2,                            // ____0001
+    kCarry,                                         // ____001_
+    kCarry,
+    kCarry | kTooLarge,                             // ____0100
+    kCarry | kTooLarge | kTooLarge1000,             // ____0101
+    kCarry | kTooLarge | kTooLarge1000,             // ____011_
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,             // ____1___
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000 | kSurrogate,  // ____1101
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+};
+
+static const uint8_t kByte2High[16] = {
+    // ________ 0_______
+    kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+    // ________ 1000____
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+    // ________ 1001____
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+    // ________ 101_____
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    // ________ 11______
+    kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+// 最后3个字节是多字节字符的开头时，字符在下一块中继续
+static const uint8_t kIncompleteMax[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+__attribute__((target("avx2"))) static inline __m256i loadTable(const uint8_t *table)
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+}
+
+// 把prev的最后n个字节和input的前32-n个字节拼接起来，即每个字节前面第n个字节
+template <int N>
+__attribute__((target("avx2"))) static inline __m256i previous(__m256i input, __m256i prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2"))) static inline __m256i checkUtf8Block(__m256i input, __m256i prevInput,
+                                                              __m256i byte1High, __m256i byte1Low,
+                                                              __m256i byte2High)
+{
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = previous<1>(input, prevInput);
+    __m256i specialCases = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble)),
+                         _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, lowNibble))),
+        _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble)));
+
+    // 前2个字节是1110____或者前3个字节是11110___时，当前字节必须是后续字节(此时kTwoConts位应为1)
+    __m256i prev2 = previous<2>(input, prevInput);
+    __m256i prev3 = previous<3>(input, prevInput);
+    __m256i isThirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i isFourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThirdByte, isFourthByte),
+                                      _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23, specialCases);
+}
+
+__attribute__((target("avx2"))) static bool utf8Avx2(const unsigned char *p, size_t len)
+{
+    const __m256i byte1High = loadTable(kByte1High);
+    const __m256i byte1Low = loadTable(kByte1Low);
+    const __m256i byte2High = loadTable(kByte2High);
+    const __m256i incompleteMax = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(kIncompleteMax));
+
+    const unsigned char *end = p + len;
+    __m256i error = _mm256_setzero_si256();
+    __m256i prevInput = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+    while (end - p >= 32)
+    {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            // 整块ASCII 只需要检查上一块末尾是否有没结束的字符
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            error = _mm256_or_si256(error, checkUtf8Block(input, prevInput, byte1High, byte1Low, byte2High));
+            prevIncomplete = _mm256_subs_epu8(input, incompleteMax);
+        }
+        prevInput = input;
+        p += 32;
+    }
+
+    // 剩余不足32字节的部分补0(ASCII)后再检查一块，末尾不完整的字符会被当成后面跟着ASCII而报错
+    unsigned char tail[32] = {0};
+    memcpy(tail, p, end - p);
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail));
+    if (_mm256_movemask_epi8(input) == 0)
+    {
+        error = _mm256_or_si256(error, prevIncomplete);
+    }
+    else
+    {
+        error = _mm256_or_si256(error, checkUtf8Block(input, prevInput, byte1High, byte1Low, byte2High));
+    }
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif  // MYMUDUO_SIMD_X86
+
+struct Kernels
+{
+    Simd::Level level;
+    void (*mask)(char *data, size_t len, uint32_t key);
+    bool (*utf8)(const unsigned char *data, size_t len);
+};
+
+static const Kernels kKernels[] = {
+    {Simd::kScalar, maskScalar, utf8Scalar},
+#ifdef MYMUDUO_SIMD_X86
+    {Simd::kSse2, maskSse2, utf8Sse2},
+    {Simd::kAvx2, maskAvx2, utf8Avx2},
+#endif
+};
+
+static Simd::Level supportedLevel()
+{
+#ifdef MYMUDUO_SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? Simd::kAvx2 : Simd::kSse2;
+#else
+    return Simd::kScalar;
+#endif
+}
+
+static std::atomic<const Kernels *> &currentKernels()
+{
+    static std::atomic<const Kernels *> kernels(&kKernels[supportedLevel()]);
+    return kernels;
+}
+
+namespace Simd
+{
+
+Level level()
+{
+    return currentKernels().load(std::memory_order_relaxed)->level;
+}
+
+Level setLevel(Level level)
+{
+    Level supported = supportedLevel();
+    if (level > supported)
+    {
+        level = supported;
+    }
+    currentKernels().store(&kKernels[level], std::memory_order_relaxed);
+    return level;
+}
+
+const char *levelName(Level level)
+{
+    switch (level)
+    {
+    case kScalar: return "scalar";
+    case kSse2: return "sse2";
+    case kAvx2: return "avx2";
+    default: return "unknown";
+    }
+}
+
+void maskBytes(char *data, size_t len, uint32_t key, size_t offset)
+{
+    currentKernels().load(std::memory_order_relaxed)->mask(data, len, rotateKey(key, offset));
+}
+
+bool isValidUtf8(const char *data, size_t len)
+{
+    return currentKernels().load(std::memory_order_relaxed)->utf8(reinterpret_cast<const unsigned char *>(data), len);
+}
+
+}  // namespace Simd
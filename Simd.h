@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 协议层热点循环的SIMD实现 按CPU在运行时选择AVX2、SSE2或者标量实现
+ * 编译时不需要-mavx2，AVX2函数单独用target属性编译，不支持AVX2的CPU上不会执行到
+ */
+namespace Simd
+{
+
+enum Level
+{
+    kScalar,
+    kSse2,
+    kAvx2,
+};
+
+// 当前使用的实现
+Level level();
+// 基准测试用 超过CPU支持的级别时使用CPU支持的最高级别，返回实际使用的级别
+Level setLevel(Level level);
+const char *levelName(Level level);
+
+// WebSocket掩码 data[i] ^= key[(offset + i) % 4]，key是帧中4个字节的掩码原样memcpy得到的值
+// offset是data第一个字节在整个payload中的位置，分多次去掩码时使用
+void maskBytes(char *data, size_t len, uint32_t key, size_t offset);
+
+// 是否是合法的UTF-8(RFC 3629)：不允许超长编码、代理区码点和大于U+10FFFF的码点
+bool isValidUtf8(const char *data, size_t len);
+
+}  // namespace Simd
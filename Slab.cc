@@ -0,0 +1,94 @@
+#include "Slab.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+// block按最大的基本类型对齐，放得下任意对象
+static const size_t kAlignment = alignof(std::max_align_t);
+
+static size_t roundUp(size_t size)
+{
+    return (std::max(size, sizeof(void *)) + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+Slab::Slab(size_t blocksPerChunk)
+    : blocksPerChunk_(blocksPerChunk > 0 ? blocksPerChunk : 1),
+      blockSize_(0),
+      freeList_(nullptr),
+      inUse_(0)
+{
+}
+
+Slab::~Slab()
+{
+    for (char *chunk : chunks_)
+    {
+        ::operator delete(chunk);
+    }
+}
+
+void *Slab::allocate(size_t size)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (blockSize_ == 0)
+        {
+            blockSize_ = roundUp(size);
+        }
+        if (roundUp(size) == blockSize_)
+        {
+            if (freeList_ == nullptr)
+            {
+                addChunk();
+            }
+            FreeBlock *block = freeList_;
+            freeList_ = block->next;
+            ++inUse_;
+            return block;
+        }
+    }
+    return ::operator new(size);
+}
+
+void Slab::deallocate(void *p, size_t size)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (roundUp(size) == blockSize_)
+        {
+            FreeBlock *block = static_cast<FreeBlock *>(p);
+            block->next = freeList_;
+            freeList_ = block;
+            --inUse_;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+size_t Slab::blocksInUse()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return inUse_;
+}
+
+size_t Slab::bytesReserved()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return chunks_.size() * blocksPerChunk_ * blockSize_;
+}
+
+// 调用时已经持有mutex_
+void Slab::addChunk()
+{
+    char *chunk = static_cast<char *>(::operator new(blocksPerChunk_ * blockSize_));
+    chunks_.push_back(chunk);
+    // 倒序链入空闲链表，分配时按地址从低到高使用
+    for (size_t i = blocksPerChunk_; i > 0; --i)
+    {
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(chunk + (i - 1) * blockSize_);
+        block->next = freeList_;
+        freeList_ = block;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "noncopyable.h"
+
+/**
+ * 固定大小内存块的分配器 每次向系统申请一整块chunk，切分成等大的block，释放的block放入空闲链表复用
+ * 用于大量同类对象(例如TcpConnection)的分配，省去每个对象的malloc头部开销，也减少碎片
+ * block的大小由第一次分配决定，之后大小不同的请求直接使用operator new
+ * 可以在任意线程分配和释放，内部用互斥锁保护；chunk在Slab析构时才归还系统
+ */
+class Slab : noncopyable
+{
+public:
+    explicit Slab(size_t blocksPerChunk = 256);
+    ~Slab();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    size_t blockSize() const { return blockSize_; }
+    size_t blocksInUse();
+    size_t bytesReserved();  // 已经向系统申请的chunk总字节数
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    void addChunk();
+
+    const size_t blocksPerChunk_;
+    size_t blockSize_;  // 0表示还没有分配过
+    std::mutex mutex_;
+    FreeBlock *freeList_;
+    size_t inUse_;
+    std::vector<char *> chunks_;
+};
+
+/**
+ * 从Slab中分配内存的标准分配器，配合std::allocate_shared使用，对象和控制块在同一个block中
+ * 分配器持有Slab的shared_ptr，保存在控制块里，Slab的生命周期不短于从它分配出去的对象
+ */
+template <typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<Slab> slab)
+        : slab_(std::move(slab))
+    {
+    }
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U> &other)
+        : slab_(other.slab())
+    {
+    }
+
+    T *allocate(size_t n) { return static_cast<T *>(slab_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { slab_->deallocate(p, n * sizeof(T)); }
+
+    const std::shared_ptr<Slab> &slab() const { return slab_; }
+
+private:
+    std::shared_ptr<Slab> slab_;
+};
+
+template <typename T, typename U>
+bool operator==(const SlabAllocator<T> &lhs, const SlabAllocator<U> &rhs)
+{
+    return lhs.slab() == rhs.slab();
+}
+
+template <typename T, typename U>
+bool operator!=(const SlabAllocator<T> &lhs, const SlabAllocator<U> &rhs)
+{
+    return lhs.slab() != rhs.slab();
+}
@@ -1,5 +1,6 @@
 #include "Socket.h"
 
+#include <errno.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -9,6 +10,15 @@
 #include "Logger.h"
 #include "strings.h"
 
+// value为0时不设置 失败只记录日志，选项不被支持时连接照常工作
+static void setIntOption(int sockfd, int level, int name, int value, const char *what)
+{
+    if (value != 0 && ::setsockopt(sockfd, level, name, &value, static_cast<socklen_t>(sizeof value)) < 0)
+    {
+        LOG_ERROR("setsockopt %s=%d fd=%d err:%d\n", what, value, sockfd, errno);
+    }
+}
+
 Socket::~Socket()
 {
     ::close(sockfd_);
@@ -16,15 +26,15 @@ Socket::~Socket()
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (0 != ::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.sockAddr(), localaddr.sockAddrLen()))
     {
         LOG_FATAL("bind sockfd%d fail\n", sockfd_);
     }
 }
 
-void Socket::listen()
+void Socket::listen(int backlog)
 {
-    if (0 != ::listen(sockfd_, 1024))
+    if (0 != ::listen(sockfd_, backlog))
     {
         LOG_FATAL("listen sockfd%d fail\n", sockfd_);
     }
@@ -32,7 +42,7 @@ void Socket::listen()
 
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;  // 放得下IPv4和AF_UNIX的地址
     socklen_t len = sizeof addr;  // 使用accept必须对len进行初始化成addr的大小
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_,
@@ -41,7 +51,7 @@ int Socket::accept(InetAddress *peeraddr)
                            SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd > 0)
     {
-        peeraddr->setSockaddr(addr);
+        *peeraddr = InetAddress::fromSockAddr((sockaddr *)&addr, len);
     }
     return connfd;
 }
@@ -80,4 +90,35 @@ void Socket::setKeepAlive(bool on)
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE,
                  &optval, static_cast<socklen_t>(sizeof optval));
-}
\ No newline at end of file
+}
+void Socket::applyListenOptions(const SocketOptions &options, bool unixSocket)
+{
+    setIntOption(sockfd_, SOL_SOCKET, SO_RCVBUF, options.receiveBufferBytes, "SO_RCVBUF");
+    setIntOption(sockfd_, SOL_SOCKET, SO_SNDBUF, options.sendBufferBytes, "SO_SNDBUF");
+    if (!unixSocket)
+    {
+        setIntOption(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.deferAcceptSeconds, "TCP_DEFER_ACCEPT");
+        setIntOption(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, options.fastOpenQueueLength, "TCP_FASTOPEN");
+    }
+}
+
+void Socket::applyConnectionOptions(const SocketOptions &options, bool unixSocket)
+{
+    setIntOption(sockfd_, SOL_SOCKET, SO_RCVBUF, options.receiveBufferBytes, "SO_RCVBUF");
+    setIntOption(sockfd_, SOL_SOCKET, SO_SNDBUF, options.sendBufferBytes, "SO_SNDBUF");
+    if (unixSocket)
+    {
+        return;
+    }
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_NODELAY, options.noDelay, "TCP_NODELAY");
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_QUICKACK, options.quickAck, "TCP_QUICKACK");
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notSentLowatBytes, "TCP_NOTSENT_LOWAT");
+    setIntOption(sockfd_, SOL_SOCKET, SO_KEEPALIVE, options.keepAlive, "SO_KEEPALIVE");
+    if (options.keepAlive)
+    {
+        setIntOption(sockfd_, IPPROTO_TCP, TCP_KEEPIDLE, options.keepIdleSeconds, "TCP_KEEPIDLE");
+        setIntOption(sockfd_, IPPROTO_TCP, TCP_KEEPINTVL, options.keepIntervalSeconds, "TCP_KEEPINTVL");
+        setIntOption(sockfd_, IPPROTO_TCP, TCP_KEEPCNT, options.keepCount, "TCP_KEEPCNT");
+    }
+    setIntOption(sockfd_, SOL_SOCKET, SO_BUSY_POLL, options.busyPollMicros, "SO_BUSY_POLL");
+}
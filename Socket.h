@@ -4,6 +4,31 @@
 
 class InetAddress;
 
+/**
+ * 监听socket和连接的选项 由TcpServer/TcpClient设置，取值为0的项不调用setsockopt，使用内核的默认值
+ * 默认值和以前的行为一致：backlog为1024，TCP连接打开keepalive
+ * AF_UNIX socket只使用backlog和收发缓冲区大小
+ */
+struct SocketOptions
+{
+    // 监听socket
+    int backlog = 1024;           // 实际上限还受net.core.somaxconn限制
+    int deferAcceptSeconds = 0;   // TCP_DEFER_ACCEPT 收到数据之后accept才返回，只适合客户端先发送的协议
+    int fastOpenQueueLength = 0;  // TCP_FASTOPEN 允许SYN携带数据，需要net.ipv4.tcp_fastopen打开服务端支持
+
+    // 连接 收发缓冲区大小也设置在监听socket上，窗口扩大因子在握手时就确定了
+    int receiveBufferBytes = 0;  // SO_RCVBUF 设置后内核不再自动调整
+    int sendBufferBytes = 0;     // SO_SNDBUF
+    bool noDelay = false;        // TCP_NODELAY
+    bool quickAck = false;       // TCP_QUICKACK 连接建立时设置一次，内核之后可能退回延迟确认
+    int notSentLowatBytes = 0;   // TCP_NOTSENT_LOWAT 内核中未发送的数据低于这个值才报告可写
+    bool keepAlive = true;       // SO_KEEPALIVE
+    int keepIdleSeconds = 0;     // TCP_KEEPIDLE
+    int keepIntervalSeconds = 0; // TCP_KEEPINTVL
+    int keepCount = 0;           // TCP_KEEPCNT
+    int busyPollMicros = 0;      // SO_BUSY_POLL 读取时轮询网卡队列的微秒数，需要CAP_NET_ADMIN才能调大
+};
+
 class Socket : noncopyable
 {
 public:
@@ -14,7 +39,7 @@ public:
 
     int fd() { return sockfd_; }
     void bindAddress(const InetAddress &localaddr);
-    void listen();
+    void listen(int backlog = 1024);
     int accept(InetAddress *peeraddr);
 
     void shutdownWrite();
@@ -23,6 +48,10 @@ public:
     void setReusePort(bool on);
     void setKeepAlive(bool on);
 
+    // listen()之前调用
+    void applyListenOptions(const SocketOptions &options, bool unixSocket);
+    void applyConnectionOptions(const SocketOptions &options, bool unixSocket);
+
 private:
     const int sockfd_;
 };
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "StaticFileHandler.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace
+{
+
+enum RangeResult
+{
+    kNoRange,        // 没有Range或者不支持的形式(例如多个区间)，返回整个文件
+    kSatisfiable,
+    kUnsatisfiable,  // 416
+};
+
+bool parseNumber(const char *begin, const char *end, off_t *value)
+{
+    if (begin == end)
+    {
+        return false;
+    }
+    off_t result = 0;
+    for (const char *p = begin; p < end; ++p)
+    {
+        if (*p < '0' || *p > '9' || result > (INT64_MAX - 9) / 10)
+        {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+    }
+    *value = result;
+    return true;
+}
+
+// bytes=a-b、bytes=a-、bytes=-n 三种单区间形式
+RangeResult parseRange(const StringPiece &value, off_t size, off_t *begin, off_t *length)
+{
+    static const StringPiece kPrefix("bytes=");
+    if (value.size() <= kPrefix.size() || !StringPiece(value.data(), kPrefix.size()).equalsIgnoreCase(kPrefix))
+    {
+        return kNoRange;
+    }
+    const char *spec = value.data() + kPrefix.size();
+    const char *end = value.end();
+    const char *dash = std::find(spec, end, '-');
+    if (dash == end || std::find(spec, end, ',') != end)
+    {
+        return kNoRange;
+    }
+
+    off_t first = 0;
+    off_t last = 0;
+    if (dash == spec)
+    {
+        // 最后n个字节
+        off_t suffix = 0;
+        if (!parseNumber(dash + 1, end, &suffix))
+        {
+            return kNoRange;
+        }
+        if (suffix == 0 || size == 0)
+        {
+            return kUnsatisfiable;
+        }
+        first = suffix >= size ? 0 : size - suffix;
+        last = size - 1;
+    }
+    else
+    {
+        if (!parseNumber(spec, dash, &first))
+        {
+            return kNoRange;
+        }
+        if (dash + 1 == end)
+        {
+            last = size - 1;
+        }
+        else if (!parseNumber(dash + 1, end, &last) || last < first)
+        {
+            return kNoRange;
+        }
+        if (first >= size)
+        {
+            return kUnsatisfiable;
+        }
+        if (last >= size)
+        {
+            last = size - 1;
+        }
+    }
+    *begin = first;
+    *length = last - first + 1;
+    return kSatisfiable;
+}
+
+// If-None-Match可以是"*"或者逗号分隔的多个ETag，弱ETag带"W/"前缀
+bool etagMatches(const StringPiece &ifNoneMatch, const std::string &etag)
+{
+    if (ifNoneMatch == "*")
+    {
+        return true;
+    }
+    return std::search(ifNoneMatch.begin(), ifNoneMatch.end(), etag.begin(), etag.end()) != ifNoneMatch.end();
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+}  // namespace
+
+StaticFileHandler::StaticFileHandler(const std::string &root, const FileCacheOptions &options)
+    : root_(root.size() > 1 && root[root.size() - 1] == '/' ? root.substr(0, root.size() - 1) : root),
+      indexFile_("index.html"),
+      cache_(options)
+{
+}
+
+void StaticFileHandler::handle(const HttpRequest &req, HttpResponse *resp)
+{
+    if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+    {
+        resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+        resp->addHeader("Allow", "GET, HEAD");
+        return;
+    }
+
+    std::string path;
+    if (!resolvePath(req.path(), &path))
+    {
+        resp->setStatusCode(HttpResponse::k400BadRequest);
+        return;
+    }
+
+    FileCache::EntryPtr entry = cache_.get(path);
+    if (!entry)
+    {
+        resp->setStatusCode(errno == EACCES ? HttpResponse::k403Forbidden : HttpResponse::k404NotFound);
+        return;
+    }
+    resp->addRawHeaders(entry->headers);
+
+    // If-None-Match优先于If-Modified-Since
+    StringPiece ifNoneMatch = req.getHeader("If-None-Match");
+    if (!ifNoneMatch.empty() ? etagMatches(ifNoneMatch, entry->etag)
+                             : req.getHeader("If-Modified-Since") == entry->lastModified)
+    {
+        resp->setStatusCode(HttpResponse::k304NotModified);
+        return;
+    }
+
+    off_t begin = 0;
+    off_t length = entry->size;
+    StringPiece range = req.getHeader("Range");
+    StringPiece ifRange = req.getHeader("If-Range");
+    // If-Range和当前文件不一致时忽略Range，返回整个新文件
+    if (!range.empty() && (ifRange.empty() || ifRange == entry->etag || ifRange == entry->lastModified))
+    {
+        char contentRange[96];
+        RangeResult result = parseRange(range, entry->size, &begin, &length);
+        if (result == kUnsatisfiable)
+        {
+            resp->setStatusCode(HttpResponse::k416RangeNotSatisfiable);
+            snprintf(contentRange, sizeof contentRange, "bytes */%ld", static_cast<long>(entry->size));
+            resp->addHeader("Content-Range", contentRange);
+            return;
+        }
+        if (result == kSatisfiable)
+        {
+            resp->setStatusCode(HttpResponse::k206PartialContent);
+            snprintf(contentRange, sizeof contentRange, "bytes %ld-%ld/%ld", static_cast<long>(begin),
+                     static_cast<long>(begin + length - 1), static_cast<long>(entry->size));
+            resp->addHeader("Content-Range", contentRange);
+        }
+    }
+
+    if (entry->content)
+    {
+        if (length == entry->size)
+        {
+            resp->setSharedBody(entry->content);
+        }
+        else
+        {
+            resp->appendBody(entry->content->data() + begin, length);
+        }
+    }
+    else
+    {
+        resp->setFileBody(entry->file, begin, length);
+    }
+}
+
+// 解码%XX，拒绝NUL和".."段，以'/'结尾的路径加上indexFile_
+bool StaticFileHandler::resolvePath(const StringPiece &urlPath, std::string *path) const
+{
+    std::string decoded;
+    decoded.reserve(urlPath.size());
+    for (size_t i = 0; i < urlPath.size(); ++i)
+    {
+        char c = urlPath[i];
+        if (c == '%')
+        {
+            if (i + 2 >= urlPath.size() || hexValue(urlPath[i + 1]) < 0 || hexValue(urlPath[i + 2]) < 0)
+            {
+                return false;
+            }
+            c = static_cast<char>(hexValue(urlPath[i + 1]) * 16 + hexValue(urlPath[i + 2]));
+            i += 2;
+        }
+        if (c == '\0')
+        {
+            return false;
+        }
+        decoded.push_back(c);
+    }
+    if (decoded.empty() || decoded[0] != '/')
+    {
+        return false;
+    }
+
+    size_t start = 1;
+    while (start <= decoded.size())
+    {
+        size_t slash = decoded.find('/', start);
+        if (slash == std::string::npos)
+        {
+            slash = decoded.size();
+        }
+        if (decoded.compare(start, slash - start, "..") == 0)
+        {
+            return false;
+        }
+        start = slash + 1;
+    }
+
+    *path = root_ + decoded;
+    if (decoded[decoded.size() - 1] == '/')
+    {
+        *path += indexFile_;
+    }
+    return true;
+}
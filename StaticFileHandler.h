@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "FileCache.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "noncopyable.h"
+
+/**
+ * 静态文件处理 把URL路径映射到root目录下的文件，在HttpCallback中调用handle()填写应答
+ * - 文件的fd、stat结果和头部由FileCache缓存，命中时不再open/stat
+ * - 小文件的内容在内存中，正文直接引用缓存；大文件由TcpConnection::sendFile()用sendfile发送
+ * - 支持单个区间的Range请求(206/416)，If-None-Match/If-Modified-Since条件请求(304)
+ * - 只支持GET和HEAD；路径中含有".."段的请求直接拒绝
+ * 可以在多个loop线程中同时调用
+ */
+class StaticFileHandler : noncopyable
+{
+public:
+    explicit StaticFileHandler(const std::string &root,
+                               const FileCacheOptions &options = FileCacheOptions());
+
+    void handle(const HttpRequest &req, HttpResponse *resp);
+
+    // 以'/'结尾的路径映射到这个文件
+    void setIndexFile(const std::string &indexFile) { indexFile_ = indexFile; }
+    FileCache &cache() { return cache_; }
+
+private:
+    bool resolvePath(const StringPiece &urlPath, std::string *path) const;
+
+    const std::string root_;
+    std::string indexFile_;
+    FileCache cache_;
+};
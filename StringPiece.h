@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+/**
+ * 指向一段已有内存的只读视图(指针+长度)，不拥有也不拷贝数据，相当于C++17的std::string_view
+ * 指向的内存失效后视图也随之失效，例如指向连接输入缓冲区的视图只在onMessage回调期间有效
+ */
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr),
+          length_(0)
+    {
+    }
+    StringPiece(const char *str)
+        : ptr_(str),
+          length_(strlen(str))
+    {
+    }
+    StringPiece(const std::string &str)
+        : ptr_(str.data()),
+          length_(str.size())
+    {
+    }
+    StringPiece(const char *data, size_t len)
+        : ptr_(data),
+          length_(len)
+    {
+    }
+
+    const char *data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char *begin() const { return ptr_; }
+    const char *end() const { return ptr_ + length_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void removePrefix(size_t n)
+    {
+        ptr_ += n;
+        length_ -= n;
+    }
+    void removeSuffix(size_t n) { length_ -= n; }
+
+    std::string asString() const { return std::string(ptr_, length_); }
+
+    bool operator==(const StringPiece &other) const
+    {
+        return length_ == other.length_ && memcmp(ptr_, other.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &other) const { return !(*this == other); }
+
+    // HTTP头部字段名等不区分大小写的比较
+    bool equalsIgnoreCase(const StringPiece &other) const
+    {
+        return length_ == other.length_ && strncasecmp(ptr_, other.ptr_, length_) == 0;
+    }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
@@ -0,0 +1,187 @@
+#include "TcpClient.h"
+
+#include <string.h>
+
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Slab.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d TcpClient loop is nullptr\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+// TcpClient析构后连接才关闭，此时不能再回调TcpClient::removeConnection
+static void removeConnectionDetached(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+      connector_(new Connector(loop, serverAddr)),
+      name_(nameArg),
+      retry_(false),
+      connect_(true),
+      nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = std::make_shared<TcpConnectionCallbacks>();
+    callbacks->closeCallback = std::bind(&TcpClient::removeConnection, this, std::placeholders::_1);
+    callbacks_ = callbacks;
+}
+
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+
+    if (conn)
+    {
+        // 连接对象可能比TcpClient活得久，替换掉绑定了this的closeCallback
+        CloseCallback cb = std::bind(&removeConnectionDetached, loop_, std::placeholders::_1);
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::setConnectionCallback(ConnectionCallback cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->connectionCallback = std::move(cb);
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setMessageCallback(MessageCallback cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->messageCallback = std::move(cb);
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setWriteCompleteCallback(WriteCompleteCallback cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->writeCompleteCallback = std::move(cb);
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setFlowControl(const TcpFlowControl &flowControl)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->flowControl = flowControl;
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setMemoryBudget(const MemoryBudgetPtr &budget)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->memoryBudget = budget;
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setTrafficStats(const TrafficStatsPtr &stats)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->trafficStats = stats;
+    callbacks_ = callbacks;
+}
+
+void TcpClient::setCorking(bool on)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->corking = on;
+    callbacks_ = callbacks;
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s\n",
+             name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+// Connector连接建立成功后的回调，在loop线程中执行
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr = InetAddress::peerAddressOf(sockfd);
+    InetAddress localAddr = InetAddress::localAddressOf(sockfd);
+
+    const int connId = nextConnId_++;
+    char buf[64];
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), connId);
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(SlabAllocator<TcpConnection>(loop_->connectionSlab()),
+                                                                loop_,
+                                                                connName,
+                                                                sockfd,
+                                                                localAddr,
+                                                                peerAddr,
+                                                                connId);
+    conn->setCallbacks(callbacks_);
+    conn->applySocketOptions(socketOptions_);
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_, false, tlsServerName_);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - Reconnecting to %s\n",
+                 name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
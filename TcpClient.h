@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "MemoryBudget.h"
+#include "TcpConnection.h"
+#include "TlsContext.h"
+#include "noncopyable.h"
+
+class Connector;
+class EventLoop;
+
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+/**
+ * TCP客户端 在loop上通过Connector异步建立连接，连接建立后和服务端一样使用TcpConnection收发数据
+ * 打开retry后连接断开会自动重连
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    void disconnect();  // 发送完输出缓冲区的数据后关闭连接
+    void stop();        // 停止正在进行的连接
+
+    TcpConnectionPtr connection()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+
+    const std::string &name() const { return name_; }
+
+    // 非线程安全 需要在connect()之前设置
+    void setConnectionCallback(ConnectionCallback cb);
+    void setMessageCallback(MessageCallback cb);
+    void setWriteCompleteCallback(WriteCompleteCallback cb);
+    void setFlowControl(const TcpFlowControl &flowControl);
+    void setMemoryBudget(const MemoryBudgetPtr &budget);
+    // 连接的流量计入stats，例如和TcpServer::trafficStats()合并统计
+    void setTrafficStats(const TrafficStatsPtr &stats);
+    void setCorking(bool on);
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+    // 连接使用TLS，serverName用于SNI和证书的主机名校验
+    void setTlsContext(const TlsContextPtr &context, const std::string &serverName = "")
+    {
+        tlsContext_ = context;
+        tlsServerName_ = serverName;
+    }
+
+private:
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    TcpConnectionCallbacksPtr callbacks_;  // 每次重连建立的连接共享同一份回调
+    TlsContextPtr tlsContext_;             // 为空时不使用TLS
+    SocketOptions socketOptions_;          // 只使用连接的选项
+    std::string tlsServerName_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_;  // 只在loop线程中使用
+    std::mutex mutex_;
+    TcpConnectionPtr connection_;  // 受mutex_保护
+};
@@ -1,13 +1,23 @@
 #include "TcpConnection.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
 #include <functional>
 
-#include "Channel.h"
 #include "EventLoop.h"
 #include "Logger.h"
-#include "Socket.h"
+#include "MemoryBudget.h"
+#include "OpenFile.h"
+#include "TlsSession.h"
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -18,74 +28,335 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+// 等待发送和已经收到还没有被取走的文件描述符，都由连接持有，连接销毁时关闭
+struct TcpConnection::FdPassing
+{
+    struct Pending
+    {
+        size_t offset;  // 这组fd附在输出缓冲区中第offset个字节上
+        std::vector<int> fds;
+    };
+
+    ~FdPassing()
+    {
+        for (Pending &p : pending)
+        {
+            closeAll(p.fds);
+        }
+        closeAll(received);
+    }
+
+    static void closeAll(const std::vector<int> &fds)
+    {
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+    }
+
+    std::vector<Pending> pending;
+    std::vector<int> received;
+};
+
+// 排在输出缓冲区中等待sendfile发送的文件段
+struct TcpConnection::FileSending
+{
+    struct Segment
+    {
+        size_t offset;  // 这个文件段排在输出缓冲区中第offset个字节之前
+        std::shared_ptr<OpenFile> file;
+        off_t fileOffset;
+        size_t remaining;
+    };
+
+    std::deque<Segment> segments;
+};
+
+// 令牌桶 每秒补充rate个令牌，最多攒burst个
+// 读取时先读后扣，令牌数可以是负数，表示超额读取的字节数，还清之前不再读取
+struct TokenBucket
+{
+    double rate = 0;
+    double burst = 0;
+    double tokens = 0;
+    int64_t lastNanos = 0;
+
+    // 参数变化时重新开始计算
+    void configure(double rateArg, double burstArg, int64_t now)
+    {
+        burstArg = std::max(burstArg, 1.0);
+        if (rate != rateArg || burst != burstArg)
+        {
+            rate = rateArg;
+            burst = burstArg;
+            tokens = burst;
+            lastNanos = now;
+        }
+    }
+
+    void refill(int64_t now)
+    {
+        tokens = std::min(burst, tokens + static_cast<double>(now - lastNanos) * rate / 1e9);
+        lastNanos = now;
+    }
+
+    // 令牌数攒到need还需要等待的秒数
+    double delayFor(double need) const { return tokens >= need ? 0 : (need - tokens) / rate; }
+};
+
+// 流量控制的状态
+struct TcpConnection::FlowState
+{
+    TokenBucket readBucket;
+    TokenBucket writeBucket;
+    bool readPausedByOutput = false;  // 输出缓冲区超过pauseReadingAbove
+    bool readPausedByRate = false;    // 读令牌用完，等待定时器恢复
+    bool readPausedByBudget = false;  // 超出MemoryBudget，等待用量降下来
+    bool writeThrottled = false;      // 写令牌用完，等待定时器恢复
+};
+
+// 写令牌用完后至少攒够这么多再继续写，避免每次只写几个字节
+static const double kMinWriteBatch = 16 * 1024;
+
+// 用一个sendmsg发送data并附带fds，返回写入的字节数
+static ssize_t sendWithRights(int sockfd, const char *data, size_t len, const std::vector<int> &fds)
+{
+    if (fds.empty())
+    {
+        return ::write(sockfd, data, len);
+    }
+
+    struct iovec vec;
+    vec.iov_base = const_cast<char *>(data);
+    vec.iov_len = len;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    return ::sendmsg(sockfd, &msg, 0);
+}
+
+// 所有连接在设置回调之前共用的一份空回调
+static const TcpConnectionCallbacksPtr &defaultCallbacks()
+{
+    static const TcpConnectionCallbacksPtr callbacks = std::make_shared<TcpConnectionCallbacks>();
+    return callbacks;
+}
+
 TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &nameArg,
                              int sockfd,
                              const InetAddress localAddr,
-                             const InetAddress peerAddr)
+                             const InetAddress peerAddr,
+                             uint64_t id,
+                             std::shared_ptr<const std::string> namePrefix)
     : loop_(CheckLoopNotNull(loop)),
-      name_(nameArg),
       state_(kConnecting),
       readinig_(true),
-      socket_(new Socket(sockfd)),
-      channel_(new Channel(loop, sockfd)),
+      highWaterMarkReached_(false),
+      corkedFlushQueued_(false),
+      budgetShard_(nullptr),
+      budgetInput_(0),
+      budgetOutput_(0),
+      statsShard_(nullptr),
+      createdMicros_(Timestamp::monotonicMicroSeconds()),
+      requestStartMicros_(0),
+      socket_(sockfd),
+      namePrefix_(std::move(namePrefix)),
+      name_(nameArg),
+      id_(id),
+      channel_(loop, sockfd),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024)  // 64M
+      callbacks_(defaultCallbacks()),
+      inputBuffer_(0),
+      outputBuffer_(0)
 {
     // 给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生后，channel会回调相应的操作函数
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    // 只捕获this的lambda可以放进std::function内部的小对象缓冲区，std::bind成员函数需要额外分配内存
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_DEBUG("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
+}
+
+const std::string &TcpConnection::name() const
+{
+    // name()可能在任意线程调用，只生成一次
+    std::call_once(nameOnce_, [this]() {
+        if (namePrefix_)
+        {
+            name_ = *namePrefix_ + std::to_string(id_);
+        }
+    });
+    return name_;
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnectin::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnectin::dtor[%s] at fd=%d state=%d\n", name().c_str(), channel_.fd(), (int)state_);
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = 0;
+    if (tls_)
+    {
+        // AF_UNIX上的TLS连接同样要先握手、再解密，不支持传递文件描述符
+        if (state_ == kConnecting)
+        {
+            handleTlsHandshake();
+            return;
+        }
+        n = tls_->read(&inputBuffer_, &savedErrno);
+    }
+    else if (localAddr_.isUnix())
+    {
+        // AF_UNIX连接用recvmsg读取，readv会丢弃对端发送的文件描述符
+        std::vector<int> fds;
+        n = inputBuffer_.readFd(channel_.fd(), &savedErrno, &fds);
+        if (!fds.empty())
+        {
+            std::vector<int> &received = fdPassing()->received;
+            received.insert(received.end(), fds.begin(), fds.end());
+        }
+    }
+    else
+    {
+        n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+    }
     if (n > 0)
     {
+        consumeReadTokens(n);
+        countRead(n);
+        // 回调中可能关闭连接，清空statsShard_
+        TrafficStatsShard *shard = statsShard_;
+        int64_t callbackStart = 0;
+        if (shard)
+        {
+            if (requestStartMicros_ == 0)
+            {
+                // receiveTime是墙上时间，会随系统时间调整跳变；用同一时刻缓存的单调时钟
+                requestStartMicros_ = loop_->monotonicMicros();
+            }
+            callbackStart = Timestamp::monotonicMicroSeconds();
+        }
         // 已经建立连接的用户有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        callbacks_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
+        if (shard)
+        {
+            shard->callbackLatency.record(Timestamp::monotonicMicroSeconds() - callbackStart);
+        }
+        // 回调没有取走的输入也计入内存预算
+        accountMemory();
+        if (tls_ && tls_->peerClosed() && state_ != kDisconnected)
+        {
+            // close_notify和最后的数据一起到达，之后socket上可能不会再有可读事件
+            tls_->shutdown();
+            handleClose();
+        }
     }
     else if (n == 0)
     {
+        if (tls_)
+        {
+            // 回应对端的close_notify
+            tls_->shutdown();
+        }
         handleClose();
     }
+    else if (tls_ && savedErrno == EWOULDBLOCK)
+    {
+        // 只收到了不完整的TLS记录或者握手后的控制消息，等待后续数据
+    }
     else
     {
         errno = savedErrno;
         LOG_ERROR("TcpConnection::handleRead");
         handleError();
+        if (tls_)
+        {
+            // TLS记录校验失败后连接不能继续使用，socket上的数据也不会被读走
+            handleClose();
+        }
+    }
+}
+
+// TLS握手 握手期间连接保持kConnecting，由可读/可写事件继续
+void TcpConnection::handleTlsHandshake()
+{
+    switch (tls_->handshake())
+    {
+    case TlsSession::kHandshakeDone:
+        if (channel_.isWriteEvent())
+        {
+            channel_.disableWriting();
+        }
+        LOG_INFO("TcpConnection::handleTlsHandshake[%s] done, kernel tls send=%d recv=%d\n",
+                 name().c_str(), (int)tls_->kernelSend(), (int)tls_->kernelRecv());
+        setState(kConnected);
+        if (callbacks_->connectionCallback)
+        {
+            callbacks_->connectionCallback(shared_from_this());
+        }
+        // 对端可能紧跟着握手发来了数据，已经被SSL读进内部缓冲区，不会再触发可读事件
+        if (state_ == kConnected)
+        {
+            handleRead(Timestamp::now());
+        }
+        break;
+    case TlsSession::kHandshakeWantRead:
+        if (channel_.isWriteEvent())
+        {
+            channel_.disableWriting();
+        }
+        break;
+    case TlsSession::kHandshakeWantWrite:
+        if (!channel_.isWriteEvent())
+        {
+            channel_.enableWriting();
+        }
+        break;
+    case TlsSession::kHandshakeFailed:
+        LOG_ERROR("TcpConnection::handleTlsHandshake[%s] failed, peer %s\n", name().c_str(),
+                  peerAddress().toIpPort().c_str());
+        handleClose();
+        break;
     }
 }
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriteEvent())
+    if (tls_ && state_ == kConnecting)
+    {
+        handleTlsHandshake();
+        return;
+    }
+    if (channel_.isWriteEvent())
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = writeOutput(&savedErrno);
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            checkOutputWatermarks();
+            if (!hasPendingOutput())
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应的thread线程执行相应的回调
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                }
+                channel_.disableWriting();
+                writeCompleted();
                 // shutdown时还有数据未发送会设置kDisconnection等待发送完成后调用shutdownInLoop关闭写端
                 if (kDisconnecting == state_)
                 {
@@ -93,14 +364,14 @@ void TcpConnection::handleWrite()
                 }
             }
         }
-        else
+        else if (!writeThrottled())
         {
             LOG_ERROR("TcpConnection::handleWrite");
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing\n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing\n", channel_.fd());
     }
 }
 
@@ -108,13 +379,23 @@ void TcpConnection::handleWrite()
 // poller -> channel::closeCallback_
 void TcpConnection::handleClose()
 {
-    LOG_INFO("fd=%d, state=%d\n", channel_->fd(), (int)state_);
+    LOG_INFO("fd=%d, state=%d\n", channel_.fd(), (int)state_);
+    // TLS握手没有完成的连接从来没有回调过connectionCallback，关闭时也不回调
+    bool established = state_ != kConnecting;
     setState(kDisconnected);
+    channel_.disableAll();  // 不再关注任何事件，避免LT模式下重复触发关闭
+    accountMemory();        // 缓冲区中的数据不再计入内存预算
+    countClosed();
 
     TcpConnectionPtr connPtr(shared_from_this());  // 获取当前对象
-    connectionCallback_(connPtr);                  // 执行连接关闭的回调
+    // 回调中可能替换callbacks_，先持有一份
+    TcpConnectionCallbacksPtr callbacks(callbacks_);
+    if (established && callbacks->connectionCallback)
+    {
+        callbacks->connectionCallback(connPtr);  // 执行连接关闭的回调
+    }
     // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
-    closeCallback_(connPtr);
+    callbacks->closeCallback(connPtr);
 }
 
 void TcpConnection::handleError()
@@ -122,7 +403,7 @@ void TcpConnection::handleError()
     int optval;
     socklen_t optlen = static_cast<socklen_t>(sizeof optval);
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -130,7 +411,7 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleErrno name:%s - SO_ERRNO:%d\n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleErrno name:%s - SO_ERRNO:%d\n", name().c_str(), err);
 }
 
 void TcpConnection::send(const std::string &buf)
@@ -143,22 +424,550 @@ void TcpConnection::send(const std::string &buf)
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()));
+            // 跨线程发送时buf可能在执行前就被销毁，需要拷贝一份数据绑定到回调中
+            void (TcpConnection::*fp)(const std::string &) = &TcpConnection::sendInLoop;
+            loop_->runInLoop(std::bind(fp, shared_from_this(), buf));
+        }
+    }
+}
+
+void TcpConnection::sendWithFds(const std::string &data, const std::vector<int> &fds)
+{
+    if (tls_)
+    {
+        // SCM_RIGHTS只能随明文的sendmsg发送，TLS连接上没有办法附带fd
+        LOG_ERROR("TcpConnection::sendWithFds[%s] not supported on tls connection\n", name().c_str());
+        return;
+    }
+    if (state_ == kConnected)
+    {
+        // 先复制一份fd，调用者返回后可以马上关闭自己的fd
+        std::vector<int> dups;
+        for (int fd : fds)
+        {
+            int dup = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (dup < 0)
+            {
+                LOG_ERROR("TcpConnection::sendWithFds dup fd=%d err:%d\n", fd, errno);
+                FdPassing::closeAll(dups);
+                return;
+            }
+            dups.push_back(dup);
+        }
+
+        if (loop_->isInLoopThread())
+        {
+            sendWithFdsInLoop(data, dups);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&TcpConnection::sendWithFdsInLoop, shared_from_this(), data, dups));
+        }
+    }
+}
+
+std::vector<int> TcpConnection::takeReceivedFds()
+{
+    std::vector<int> fds;
+    if (fdPassing_)
+    {
+        fds.swap(fdPassing_->received);
+    }
+    return fds;
+}
+
+TcpConnection::FdPassing *TcpConnection::fdPassing()
+{
+    if (!fdPassing_)
+    {
+        fdPassing_.reset(new FdPassing);
+    }
+    return fdPassing_.get();
+}
+
+// 发送已经直接写入outputBuffer_的数据 正在等待EPOLLOUT时由handleWrite()继续发送
+void TcpConnection::flushOutput()
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (!channel_.isWriteEvent() && !writeThrottled() && hasPendingOutput())
+    {
+        int savedErrno = 0;
+        ssize_t n = writeOutput(&savedErrno);
+        if (n > 0)
+        {
+            if (!hasPendingOutput())
+            {
+                writeCompleted();
+            }
+        }
+        else if (n < 0 && savedErrno != EWOULDBLOCK)
+        {
+            errno = savedErrno;
+            LOG_ERROR("TcpConnection::flushOutput");
+            if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+            {
+                return;
+            }
+        }
+
+        if (hasPendingOutput())
+        {
+            ensureWriting();
+        }
+    }
+    // 协议层可能直接往outputBuffer()追加了数据，正在等待EPOLLOUT时也要检查
+    checkOutputWatermarks();
+}
+
+void TcpConnection::sendFile(const std::shared_ptr<OpenFile> &file, off_t offset, size_t count)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(file, offset, count);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), file, offset, count));
+        }
+    }
+}
+
+void TcpConnection::sendFileInLoop(const std::shared_ptr<OpenFile> &file, off_t offset, size_t count)
+{
+    if (state_ == kDisconnected || count == 0)
+    {
+        return;
+    }
+    if (!fileSending_)
+    {
+        fileSending_.reset(new FileSending);
+    }
+    fileSending_->segments.push_back(FileSending::Segment{outputBuffer_.readableBytes(), file, offset, count});
+    if (callbacks_->corking)
+    {
+        scheduleCorkedFlush();
+    }
+    else
+    {
+        flushOutput();
+    }
+}
+
+// 正在等待EPOLLOUT时由handleWrite()发送，不需要再登记
+void TcpConnection::scheduleCorkedFlush()
+{
+    if (!corkedFlushQueued_ && !channel_.isWriteEvent())
+    {
+        corkedFlushQueued_ = true;
+        TcpConnectionPtr conn(shared_from_this());
+        loop_->runBeforePoll([conn]() {
+            conn->corkedFlushQueued_ = false;
+            conn->flushOutput();
+        });
+    }
+}
+
+bool TcpConnection::hasPendingOutput() const
+{
+    return outputBuffer_.readableBytes() > 0 || (fileSending_ && !fileSending_->segments.empty());
+}
+
+// 关注可写事件 写限速正在等待令牌时由定时器恢复
+void TcpConnection::ensureWriting()
+{
+    if (!channel_.isWriteEvent() && !writeThrottled())
+    {
+        channel_.enableWriting();
+    }
+}
+
+// 输出缓冲区变化后检查水位线：回调high/low water mark，按背压设置停止或者恢复读取
+void TcpConnection::checkOutputWatermarks()
+{
+    const TcpConnectionCallbacks &callbacks = *callbacks_;
+    size_t pending = outputBuffer_.readableBytes();
+    if (!highWaterMarkReached_)
+    {
+        if (pending > callbacks.highWaterMark && (callbacks.highWaterMarkCallback || callbacks.lowWaterMarkCallback))
+        {
+            highWaterMarkReached_ = true;
+            if (callbacks.highWaterMarkCallback)
+            {
+                loop_->queueInLoop(std::bind(callbacks.highWaterMarkCallback, shared_from_this(), pending));
+            }
+        }
+    }
+    else if (pending <= callbacks.lowWaterMark)
+    {
+        highWaterMarkReached_ = false;
+        if (callbacks.lowWaterMarkCallback)
+        {
+            loop_->queueInLoop(std::bind(callbacks.lowWaterMarkCallback, shared_from_this(), pending));
+        }
+    }
+
+    const TcpFlowControl &flow = callbacks.flowControl;
+    bool paused = flowState_ && flowState_->readPausedByOutput;
+    if (!paused && flow.pauseReadingAbove > 0 && pending > flow.pauseReadingAbove)
+    {
+        flowState()->readPausedByOutput = true;
+        updateReading();
+    }
+    else if (paused && (pending <= flow.resumeReadingBelow || flow.pauseReadingAbove == 0))
+    {
+        flowState_->readPausedByOutput = false;
+        updateReading();
+    }
+    countOutputBuffer();
+    accountMemory();
+}
+
+// 上报缓冲区中数据量的变化 用量增长而且超出全局预算时按策略处理
+void TcpConnection::accountMemory()
+{
+    MemoryBudget *budget = callbacks_->memoryBudget.get();
+    if (budget == nullptr)
+    {
+        return;
+    }
+    size_t input = state_ == kDisconnected ? 0 : inputBuffer_.readableBytes();
+    size_t output = state_ == kDisconnected ? 0 : outputBuffer_.readableBytes();
+    if (input == budgetInput_ && output == budgetOutput_)
+    {
+        return;
+    }
+    if (budgetShard_ == nullptr)
+    {
+        budgetShard_ = budget->shardFor(loop_);
+    }
+    const MemoryBudgetOptions &options = budget->options();
+    size_t before = budgetInput_ + budgetOutput_;
+    size_t after = input + output;
+    bool outputGrew = output > budgetOutput_;
+    budget->account(budgetShard_, static_cast<int64_t>(input) - static_cast<int64_t>(budgetInput_),
+                    static_cast<int64_t>(output) - static_cast<int64_t>(budgetOutput_), before, after);
+    budgetInput_ = input;
+    budgetOutput_ = output;
+    if (options.policy == MemoryBudgetOptions::kCloseLargest &&
+        (after >= options.trackAbove || before >= options.trackAbove))
+    {
+        budget->track(budgetShard_, shared_from_this(), after);
+    }
+
+    if (after <= before || state_ != kConnected || !budget->exceeded())
+    {
+        return;
+    }
+    switch (options.policy)
+    {
+    case MemoryBudgetOptions::kRejectSends:
+        if (outputGrew)
+        {
+            // 协议层直接追加到outputBuffer()的数据已经收下，之后的send()不再接受
+            budget->countRejected();
+            LOG_ERROR("TcpConnection[%s] memory budget exceeded, shutting down\n", name().c_str());
+            shutdown();
+        }
+        break;
+    case MemoryBudgetOptions::kCloseLargest:
+        budget->closeLargest();
+        break;
+    case MemoryBudgetOptions::kPauseReads:
+        if (!flowState()->readPausedByBudget)
+        {
+            flowState_->readPausedByBudget = true;
+            updateReading();
+            std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+            budget->resumeWhenBelow(budgetShard_, [weakConn]() {
+                TcpConnectionPtr conn = weakConn.lock();
+                if (conn)
+                {
+                    conn->flowState_->readPausedByBudget = false;
+                    conn->updateReading();
+                }
+            });
+        }
+        break;
+    }
+}
+
+void TcpConnection::countRead(ssize_t n)
+{
+    traffic_.countRead(n);
+    if (statsShard_)
+    {
+        statsShard_->traffic.countRead(n);
+    }
+}
+
+// writeOutput()中分几段写出时算作一次 没有全部写出(LT模式下通常不会等到EAGAIN)说明内核发送缓冲区已满
+void TcpConnection::countWrite(ssize_t n, bool sendBufferFull)
+{
+    traffic_.countWrite(n, sendBufferFull);
+    if (statsShard_)
+    {
+        statsShard_->traffic.countWrite(n, sendBufferFull);
+    }
+}
+
+void TcpConnection::countOutputBuffer()
+{
+    int64_t before = traffic_.outputBufferBytes.get();
+    int64_t after = state_ == kDisconnected ? 0 : static_cast<int64_t>(outputBuffer_.readableBytes());
+    if (after != before)
+    {
+        traffic_.outputBufferBytes.set(after);
+        if (statsShard_)
+        {
+            statsShard_->updateOutputBuffer(before, after);
+        }
+    }
+}
+
+// 只计一次 之后不再更新分片的计数
+void TcpConnection::countClosed()
+{
+    countOutputBuffer();
+    if (statsShard_)
+    {
+        statsShard_->countClosed(Timestamp::monotonicMicroSeconds() - createdMicros_);
+        statsShard_ = nullptr;
+    }
+}
+
+// 输出全部写出 记录从收到请求到应答写完的耗时，回调writeCompleteCallback
+void TcpConnection::writeCompleted()
+{
+    if (requestStartMicros_ != 0)
+    {
+        if (statsShard_)
+        {
+            statsShard_->requestLatency.record(Timestamp::monotonicMicroSeconds() - requestStartMicros_);
         }
+        requestStartMicros_ = 0;
+    }
+    if (callbacks_->writeCompleteCallback)
+    {
+        // 唤醒loop_对应的thread线程执行相应的回调
+        loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+    }
+}
+
+TrafficSnapshot TcpConnection::traffic() const
+{
+    TrafficSnapshot snapshot;
+    traffic_.addTo(&snapshot);
+    return snapshot;
+}
+
+double TcpConnection::lifetimeSeconds() const
+{
+    return static_cast<double>(Timestamp::monotonicMicroSeconds() - createdMicros_) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 按流量控制的状态关注或者取消关注可读事件
+void TcpConnection::updateReading()
+{
+    if (state_ == kDisconnected || state_ == kConnecting || !flowState_)
+    {
+        return;
+    }
+    bool reading = !flowState_->readPausedByOutput && !flowState_->readPausedByRate &&
+                   !flowState_->readPausedByBudget;
+    if (reading && !channel_.isReadEvent())
+    {
+        channel_.enableReading();
+    }
+    else if (!reading && channel_.isReadEvent())
+    {
+        channel_.disableReading();
     }
 }
 
+TcpConnection::FlowState *TcpConnection::flowState()
+{
+    if (!flowState_)
+    {
+        flowState_.reset(new FlowState);
+    }
+    return flowState_.get();
+}
+
+bool TcpConnection::writeThrottled() const
+{
+    return flowState_ && flowState_->writeThrottled;
+}
+
+// 这一次最多可以写多少字节 不限速时没有限制
+size_t TcpConnection::writeAllowance()
+{
+    const TcpFlowControl &flow = callbacks_->flowControl;
+    if (flow.writeBytesPerSecond <= 0)
+    {
+        return SIZE_MAX;
+    }
+    TokenBucket &bucket = flowState()->writeBucket;
+    int64_t now = Timestamp::monotonicNanoSeconds();
+    bucket.configure(flow.writeBytesPerSecond, flow.burstBytes, now);
+    bucket.refill(now);
+    return bucket.tokens >= 1 ? static_cast<size_t>(bucket.tokens) : 0;
+}
+
+// 扣除写出的字节 令牌不够而且还有数据没写完时停止关注可写事件，等定时器恢复
+void TcpConnection::consumeWriteTokens(size_t len)
+{
+    if (callbacks_->flowControl.writeBytesPerSecond <= 0 || !flowState_)
+    {
+        return;
+    }
+    FlowState *flow = flowState_.get();
+    TokenBucket &bucket = flow->writeBucket;
+    bucket.tokens -= static_cast<double>(len);
+    if (bucket.tokens >= 1 || !hasPendingOutput() || flow->writeThrottled)
+    {
+        return;
+    }
+
+    flow->writeThrottled = true;
+    if (channel_.isWriteEvent())
+    {
+        channel_.disableWriting();
+    }
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->runAfter(bucket.delayFor(std::min(bucket.burst, kMinWriteBatch)), [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn)
+        {
+            conn->flowState_->writeThrottled = false;
+            // 由handleWrite()继续发送，shutdown()等待发送完成时也由它关闭写端
+            if (conn->state_ != kDisconnected && conn->hasPendingOutput())
+            {
+                conn->ensureWriting();
+            }
+        }
+    });
+}
+
+// 扣除读到的字节 超额后停止读取，等欠下的令牌补回来再恢复
+void TcpConnection::consumeReadTokens(size_t len)
+{
+    const TcpFlowControl &flowControl = callbacks_->flowControl;
+    if (flowControl.readBytesPerSecond <= 0)
+    {
+        return;
+    }
+    FlowState *flow = flowState();
+    TokenBucket &bucket = flow->readBucket;
+    int64_t now = Timestamp::monotonicNanoSeconds();
+    bucket.configure(flowControl.readBytesPerSecond, flowControl.burstBytes, now);
+    bucket.refill(now);
+    bucket.tokens -= static_cast<double>(len);
+    if (bucket.tokens >= 1 || flow->readPausedByRate)
+    {
+        return;
+    }
+
+    flow->readPausedByRate = true;
+    updateReading();
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->runAfter(bucket.delayFor(1), [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn)
+        {
+            conn->flowState_->readPausedByRate = false;
+            conn->updateReading();
+        }
+    });
+}
+
 // 关闭连接
 void TcpConnection::shutdown()
 {
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::setConnectionCallback(const ConnectionCallback &cb)
+{
+    mutableCallbacks()->connectionCallback = cb;
+}
+
+void TcpConnection::setMessageCallback(const MessageCallback &cb)
+{
+    mutableCallbacks()->messageCallback = cb;
+}
+
+void TcpConnection::setWriteCompleteCallback(const WriteCompleteCallback &cb)
+{
+    mutableCallbacks()->writeCompleteCallback = cb;
+}
+
+void TcpConnection::setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
+{
+    TcpConnectionCallbacks *callbacks = mutableCallbacks();
+    callbacks->highWaterMarkCallback = cb;
+    callbacks->highWaterMark = highWaterMark;
+}
+
+void TcpConnection::setLowWaterMarkCallback(const LowWaterMarkCallback &cb, size_t lowWaterMark)
+{
+    TcpConnectionCallbacks *callbacks = mutableCallbacks();
+    callbacks->lowWaterMarkCallback = cb;
+    callbacks->lowWaterMark = lowWaterMark;
+}
+
+void TcpConnection::setFlowControl(const TcpFlowControl &flowControl)
+{
+    mutableCallbacks()->flowControl = flowControl;
+}
+
+void TcpConnection::setCloseCallback(const CloseCallback &cb)
+{
+    mutableCallbacks()->closeCallback = cb;
+}
+
+// 回调可能和其他连接共享，修改前拷贝一份只给当前连接使用
+TcpConnectionCallbacks *TcpConnection::mutableCallbacks()
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks_ = callbacks;
+    return callbacks.get();
+}
+
+void TcpConnection::applySocketOptions(const SocketOptions &options)
+{
+    socket_.applyConnectionOptions(options, localAddr_.isUnix());
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_.setTcpNoDelay(on);
+}
+
+void TcpConnection::forceClose()
+{
+    // TLS握手期间连接还是kConnecting，也可以强制关闭
+    if (state_ == kConnected || state_ == kDisconnecting || (tls_ && state_ == kConnecting))
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting || (tls_ && state_ == kConnecting))
+    {
+        // 和对端关闭连接一样处理
+        handleClose();
     }
 }
 
@@ -166,13 +975,29 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
     // 确保outputBuffer中的数据已经全部发送完成，如果还有正在写的，会等待写完并在sendInLoop再次调用该方法
-    if (!channel_->isWriteEvent())
+    if (!channel_.isWriteEvent())
     {
+        if (hasPendingOutput())
+        {
+            // 直接写入outputBuffer()还没有flush的数据，等handleWrite()发送完再关闭写端
+            ensureWriting();
+            return;
+        }
+        if (tls_)
+        {
+            // 先发送close_notify，对端据此区分正常关闭和数据被截断
+            tls_->shutdown();
+        }
         // 关闭写端，会触发EPOLLHUP事件即调用channel的closeCallback
-        socket_->shutdownWrite();
+        socket_.shutdownWrite();
     }
 }
 
+void TcpConnection::sendInLoop(const std::string &buf)
+{
+    sendInLoop(buf.c_str(), buf.size());
+}
+
 // 发送数据 应用写得快 内核发送数据慢，需要把待发送数据写入缓冲区而且设置了水位线回调
 void TcpConnection::sendInLoop(const void *data, size_t len)
 {
@@ -181,23 +1006,26 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     bool faultError = false;
 
     // 之前调用过该conn的shutdown
-    if (state_ = kDisconnected)
+    if (state_ == kDisconnected)
     {
         LOG_ERROR("disconnected, give up writing");
         return;
     }
 
-    // channel第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriteEvent() && outputBuffer_.readableBytes())
+    // channel第一次开始写数据，而且缓冲区没有待发送数据；写限速时统一由handleWrite()按令牌发送
+    // corking时先攒在输出缓冲区，本轮结束时一起写出
+    if (!channel_.isWriteEvent() && !hasPendingOutput() && callbacks_->flowControl.writeBytesPerSecond <= 0 &&
+        !callbacks_->corking)
     {
-        nwrote = ::write(channel_->fd(), data, len);
-        remaining = len - nwrote;
+        nwrote = writeSocket(data, len);
+        countWrite(nwrote, nwrote < 0 ? errno == EWOULDBLOCK : static_cast<size_t>(nwrote) < len);
         if (nwrote >= 0)
         {
+            remaining = len - nwrote;
             // 若此时已经发送完数据，就不需要再给channel注册EpollOut事件了
-            if (remaining == 0 && writeCompleteCallback_)
+            if (remaining == 0)
             {
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                writeCompleted();
             }
         }
         else
@@ -220,49 +1048,334 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     // 即通过调用TcpConnection::handleWrite方法将缓冲区中的数据全部发送完成
     if (!faultError && remaining > 0)
     {
-        // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining > highWaterMark_ &&
-            oldLen < highWaterMark_ &&
-            highWaterMarkCallback_)
+        MemoryBudget *budget = callbacks_->memoryBudget.get();
+        if (budget && budget->options().policy == MemoryBudgetOptions::kRejectSends && budget->exceeded())
         {
-            loop_->queueInLoop(std::bind(
-                highWaterMarkCallback_,
-                shared_from_this(),
-                oldLen + remaining));
+            // 超出全局预算，剩下的数据不再缓冲。TCP是字节流，丢掉的数据不能跳过：
+            // 一个字节都没写出时发完之前的数据后关闭，已经写出一部分时直接关闭
+            budget->countRejected();
+            LOG_ERROR("TcpConnection[%s] memory budget exceeded, rejecting %zd bytes\n", name().c_str(), remaining);
+            if (nwrote > 0)
+            {
+                forceClose();
+            }
+            else
+            {
+                shutdown();
+            }
+            return;
         }
         outputBuffer_.append((char *)data + nwrote, remaining);  // 待缓冲的长度
-        if (channel_->isWriteEvent())
+        if (callbacks_->corking)
+        {
+            scheduleCorkedFlush();
+        }
+        else
         {
             // 注册channel的写事件否则poller不会给channel通知epollout事件执行回调
-            channel_->enableWriting();
+            ensureWriting();
+        }
+        // 超过水位线时回调highWaterMarkCallback，打开了背压时停止读取
+        checkOutputWatermarks();
+    }
+}
+
+void TcpConnection::sendWithFdsInLoop(const std::string &data, const std::vector<int> &fds)
+{
+    if (state_ == kDisconnected || data.empty())
+    {
+        LOG_ERROR("TcpConnection::sendWithFds give up, state=%d len=%zu\n", (int)state_, data.size());
+        FdPassing::closeAll(fds);
+        return;
+    }
+
+    size_t nwrote = 0;
+    bool fdsSent = false;
+    if (!channel_.isWriteEvent() && !hasPendingOutput() && callbacks_->flowControl.writeBytesPerSecond <= 0)
+    {
+        ssize_t n = sendWithRights(channel_.fd(), data.data(), data.size(), fds);
+        countWrite(n, n < 0 ? errno == EWOULDBLOCK : static_cast<size_t>(n) < data.size());
+        if (n >= 0)
+        {
+            // 内核已经持有这些fd的引用，本端的副本可以关闭
+            FdPassing::closeAll(fds);
+            fdsSent = true;
+            nwrote = n;
+            if (nwrote == data.size())
+            {
+                writeCompleted();
+            }
+        }
+        else if (errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendWithFdsInLoop err:%d\n", errno);
+            FdPassing::closeAll(fds);
+            return;
         }
     }
+
+    if (nwrote < data.size())
+    {
+        if (!fdsSent)
+        {
+            fdPassing()->pending.push_back(FdPassing::Pending{outputBuffer_.readableBytes(), fds});
+        }
+        outputBuffer_.append(data.data() + nwrote, data.size() - nwrote);
+        ensureWriting();
+        checkOutputWatermarks();
+    }
+}
+
+// 把输出缓冲区写入socket，写入的字节已经从输出缓冲区取走
+// 没有fd和文件段时一次writev；否则按它们切成几段，一直写到socket写满或者全部写完
+ssize_t TcpConnection::writeOutput(int *savedErrno)
+{
+    // 写限速时最多写出令牌数那么多字节
+    size_t budget = writeAllowance();
+    if (budget == 0)
+    {
+        consumeWriteTokens(0);
+        *savedErrno = EWOULDBLOCK;
+        return -1;
+    }
+
+    if ((!fdPassing_ || fdPassing_->pending.empty()) && (!fileSending_ || fileSending_->segments.empty()) &&
+        !userspaceTls() && budget >= outputBuffer_.readableBytes())
+    {
+        size_t wanted = outputBuffer_.readableBytes();
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), savedErrno);
+        countWrite(n, n < 0 ? *savedErrno == EWOULDBLOCK : static_cast<size_t>(n) < wanted);
+        if (n > 0)
+        {
+            outputBuffer_.retrieve(n);
+            consumeWriteTokens(n);
+        }
+        return n;
+    }
+
+    ssize_t total = 0;
+    ssize_t n = 0;
+    while (hasPendingOutput() && budget > 0)
+    {
+        n = writeOutputSegment(budget, savedErrno);
+        if (n <= 0)
+        {
+            break;
+        }
+        total += n;
+        budget -= n;
+    }
+    if (total > 0)
+    {
+        consumeWriteTokens(total);
+    }
+    countWrite(total > 0 ? total : n, n < 0 && *savedErrno == EWOULDBLOCK);
+    return total > 0 ? total : n;
+}
+
+// 写一段输出 轮到文件段时用sendfile，每组fd和它所附的字节用一个sendmsg，其余用write
+// 用户态TLS时文件段读出来加密后写入，其余用SSL_write
+ssize_t TcpConnection::writeOutputSegment(size_t budget, int *savedErrno)
+{
+    size_t limit = std::min(outputBuffer_.readableBytes(), budget);
+    if (fileSending_ && !fileSending_->segments.empty())
+    {
+        FileSending::Segment &segment = fileSending_->segments.front();
+        if (segment.offset == 0)
+        {
+            return sendFileSegment(budget, savedErrno);
+        }
+        // 只写到文件段之前
+        limit = std::min(limit, segment.offset);
+    }
+
+    ssize_t n = 0;
+    if (callbacks_->corking && fileSending_ && !fileSending_->segments.empty() &&
+        limit == fileSending_->segments.front().offset && !userspaceTls() && (!fdPassing_ || fdPassing_->pending.empty()))
+    {
+        // 紧接着就是sendfile，MSG_MORE让头部和文件的开头合并成满的TCP段
+        n = ::send(channel_.fd(), outputBuffer_.peek(), limit, MSG_MORE);
+    }
+    else if (fdPassing_ && !fdPassing_->pending.empty())
+    {
+        std::vector<FdPassing::Pending> &pending = fdPassing_->pending;
+        if (pending.front().offset > 0)
+        {
+            // 只写到下一组fd之前
+            n = writeSocket(outputBuffer_.peek(), std::min(limit, pending.front().offset));
+        }
+        else
+        {
+            size_t end = pending.size() > 1 ? pending[1].offset : outputBuffer_.readableBytes();
+            n = sendWithRights(channel_.fd(), outputBuffer_.peek(), std::min(limit, end), pending.front().fds);
+            if (n >= 0)
+            {
+                FdPassing::closeAll(pending.front().fds);
+                pending.erase(pending.begin());
+            }
+        }
+    }
+    else
+    {
+        n = writeSocket(outputBuffer_.peek(), limit);
+    }
+
+    if (n < 0)
+    {
+        *savedErrno = errno;
+        return n;
+    }
+    retrieveOutput(n);
+    return n;
+}
+
+// 从输出缓冲区取走len字节，排在后面的fd和文件段的位置跟着前移
+void TcpConnection::retrieveOutput(size_t len)
+{
+    outputBuffer_.retrieve(len);
+    if (fdPassing_)
+    {
+        for (FdPassing::Pending &p : fdPassing_->pending)
+        {
+            p.offset -= len;
+        }
+    }
+    if (fileSending_)
+    {
+        for (FileSending::Segment &segment : fileSending_->segments)
+        {
+            segment.offset -= len;
+        }
+    }
+}
+
+// 握手完成后发送方向没有交给内核，数据需要经过SSL_write加密
+bool TcpConnection::userspaceTls() const
+{
+    return tls_ && !tls_->kernelSend();
+}
+
+// 写入socket 用户态TLS时先加密，返回值和errno与write(2)一致
+ssize_t TcpConnection::writeSocket(const void *data, size_t len)
+{
+    if (userspaceTls())
+    {
+        return tls_->write(data, len);
+    }
+    return ::write(channel_.fd(), data, len);
+}
+
+ssize_t TcpConnection::sendFileSegment(size_t budget, int *savedErrno)
+{
+    std::deque<FileSending::Segment> &segments = fileSending_->segments;
+    FileSending::Segment &segment = segments.front();
+    // sendfile一次最多发送0x7ffff000字节
+    size_t count = std::min(std::min(segment.remaining, static_cast<size_t>(0x7ffff000)), budget);
+    ssize_t n = 0;
+    if (userspaceTls())
+    {
+        // 页缓存中的明文只能先读出来再加密，每次一个TLS记录；WANT_WRITE之后重读同一段重试
+        char chunk[16 * 1024];
+        n = ::pread(segment.file->fd(), chunk, std::min(count, sizeof chunk), segment.fileOffset);
+        if (n > 0)
+        {
+            n = writeSocket(chunk, n);
+            if (n > 0)
+            {
+                segment.fileOffset += n;
+            }
+        }
+    }
+    else
+    {
+        n = ::sendfile(channel_.fd(), segment.file->fd(), &segment.fileOffset, count);
+    }
+    if (n < 0)
+    {
+        *savedErrno = errno;
+        return n;
+    }
+    if (n == 0)
+    {
+        // 文件在发送过程中被截断，对端收不到承诺的长度，只能关闭连接
+        LOG_ERROR("TcpConnection::sendFileSegment [%s] file fd=%d truncated, %zu bytes missing\n",
+                  name().c_str(), segment.file->fd(), segment.remaining);
+        segments.pop_front();
+        forceClose();
+        *savedErrno = EIO;
+        return -1;
+    }
+
+    segment.remaining -= n;
+    if (segment.remaining == 0)
+    {
+        segments.pop_front();
+    }
+    return n;
 }
 
 // 连接建立
 void TcpConnection::connectEstablished()
 {
-    setState(kConnected);
     // channel中设置弱智能指针的目的：由于TcpConnection是对外提供的，用户可能对其做任何的操作
     // channel的回调方法是TcpConnection绑定的成员方法，为避免发生未知的错误
     // 因此需要tie()使得channel在调用TcpConnection给channel设置的回调方法时，TcpConnection对象存在
-    channel_->tie(shared_from_this());
-    channel_->enableReading();  // 向poller注册epollin事件
+    channel_.tie(shared_from_this());
+    channel_.enableReading();  // 向poller注册epollin事件
+    if (callbacks_->trafficStats)
+    {
+        statsShard_ = callbacks_->trafficStats->shardFor(loop_);
+        statsShard_->connectionsOpened.add(1);
+    }
+    if (tls_)
+    {
+        // 握手完成后才进入kConnected并回调connectionCallback
+        handleTlsHandshake();
+        return;
+    }
+    setState(kConnected);
 
     //新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    if (callbacks_->connectionCallback)
+    {
+        callbacks_->connectionCallback(shared_from_this());
+    }
+}
+
+void TcpConnection::startTls(const std::shared_ptr<TlsContext> &context, bool isServer,
+                             const std::string &serverName)
+{
+    tls_.reset(new TlsSession(context, channel_.fd(), isServer, serverName));
+}
+
+bool TcpConnection::kernelTlsSend() const
+{
+    return tls_ && tls_->kernelSend();
+}
+
+bool TcpConnection::kernelTlsRecv() const
+{
+    return tls_ && tls_->kernelRecv();
 }
 
 // 连接销毁
 void TcpConnection::connectDestroyed()
 {
-    if (state_ == kConnected)
+    // ~TcpServer销毁的连接可能还在kDisconnecting(等待输出写完)或者kConnecting(TLS握手中)，
+    // 同样要把缓冲区的数据从内存预算中扣除(预算可能还由其他服务器共享)，并计入流量统计的关闭数
+    if (state_ != kDisconnected)
     {
+        // TLS握手没有完成的连接从来没有回调过connectionCallback，销毁时也不回调
+        bool established = state_ != kConnecting;
         setState(kDisconnected);
-        channel_->disableAll();  // 把channel所有感兴趣的事件都从poller中del
+        channel_.disableAll();  // 把channel所有感兴趣的事件都从poller中del
+        accountMemory();
+        countClosed();  // 和connectEstablished()中计入的打开数配对
 
-        connectionCallback_(shared_from_this());
+        if (established && callbacks_->connectionCallback)
+        {
+            callbacks_->connectionCallback(shared_from_this());
+        }
     }
-    channel_->remove();  // 把channel从poller中删除
+    channel_.remove();  // 把channel从poller中删除
 }
\ No newline at end of file
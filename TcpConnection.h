@@ -1,51 +1,154 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "Buffer.h"
 #include "Callbacks.h"
+#include "Channel.h"
 #include "InetAddress.h"
+#include "Socket.h"
 #include "Timestamp.h"
+#include "TrafficStats.h"
 #include "noncopyable.h"
 
-class Channel;
 class EventLoop;
-class Socket;
+class MemoryBudget;
+class OpenFile;
+class TlsContext;
+class TlsSession;
+struct MemoryBudgetShard;
+
+/**
+ * 连接的流量控制 默认全部关闭
+ * - 背压：输出缓冲区中待发送的数据超过pauseReadingAbove时停止读取这个连接，
+ *   降到resumeReadingBelow以下再恢复；对端只发请求不读应答时内存不会无限增长。
+ *   sendFile()排队的文件段不占用内存，不计入
+ * - 限速：读和写各一个令牌桶，速率为每秒字节数，容量为burstBytes
+ */
+struct TcpFlowControl
+{
+    size_t pauseReadingAbove = 0;    // 0表示不自动停止读取
+    size_t resumeReadingBelow = 0;   // 应该小于pauseReadingAbove
+    double readBytesPerSecond = 0;   // 0表示不限速
+    double writeBytesPerSecond = 0;  // 0表示不限速
+    double burstBytes = 64 * 1024;
+
+    bool enabled() const { return pauseReadingAbove > 0 || readBytesPerSecond > 0 || writeBytesPerSecond > 0; }
+};
+
+/**
+ * 连接的回调 由TcpServer/TcpClient创建一份，所有连接通过shared_ptr共享，不再每个连接各拷贝一份
+ * 共享出去的回调不再修改，需要修改时先拷贝一份(copy-on-write)，只影响之后使用新拷贝的连接
+ */
+struct TcpConnectionCallbacks
+{
+    ConnectionCallback connectionCallback;        // 有新连接时的回调
+    MessageCallback messageCallback;              // 有读写消息时的回调
+    WriteCompleteCallback writeCompleteCallback;  // 消息发送完成以后的回调
+    HighWaterMarkCallback highWaterMarkCallback;  // 输出缓冲区超过highWaterMark时回调一次
+    LowWaterMarkCallback lowWaterMarkCallback;    // 超过highWaterMark之后又降到lowWaterMark以下时回调一次
+    CloseCallback closeCallback;
+    size_t highWaterMark = 64 * 1024 * 1024;  // 64M
+    size_t lowWaterMark = 0;
+    TcpFlowControl flowControl;
+    std::shared_ptr<MemoryBudget> memoryBudget;  // 为空时不统计缓冲区用量
+    TrafficStatsPtr trafficStats;                // 按loop汇总的流量计数，为空时只有连接自己的计数
+    // send()只追加到输出缓冲区，本轮循环结束、下一次poll之前一次写出，多次send()合并成一次write
+    bool corking = false;
+
+    static std::shared_ptr<TcpConnectionCallbacks> copyOf(const std::shared_ptr<const TcpConnectionCallbacks> &callbacks)
+    {
+        return callbacks ? std::make_shared<TcpConnectionCallbacks>(*callbacks)
+                         : std::make_shared<TcpConnectionCallbacks>();
+    }
+};
+using TcpConnectionCallbacksPtr = std::shared_ptr<const TcpConnectionCallbacks>;
 
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 给出namePrefix时nameArg为空，连接名为*namePrefix加上id，第一次调用name()时才生成，
+    // accept时不需要格式化和分配字符串
     TcpConnection(EventLoop *loop,
                   const std::string &nameArg,
                   int sockfd,
                   const InetAddress localAddr,
-                  const InetAddress peerAddr);
+                  const InetAddress peerAddr,
+                  uint64_t id = 0,
+                  std::shared_ptr<const std::string> namePrefix = std::shared_ptr<const std::string>());
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    const std::string &name() const;
+    // TcpServer/TcpClient内唯一的连接编号
+    uint64_t id() const { return id_; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
     bool disconnected() const { return state_ == kDisconnected; }
 
+    // 这个连接的流量计数，可以在任意线程调用
+    TrafficSnapshot traffic() const;
+    // 从accept/connect成功到现在的秒数
+    double lifetimeSeconds() const;
+
     // 发送数据
     void send(const std::string &buf);
+    // 发送文件[offset, offset + count)的内容，排在之前发送的数据之后
+    // 用sendfile从页缓存直接写入socket，不经过用户态缓冲区；发送完成前连接持有file
+    void sendFile(const std::shared_ptr<OpenFile> &file, off_t offset, size_t count);
+    // 发送数据并附带文件描述符(SCM_RIGHTS)，只用于AF_UNIX连接，TLS连接上调用会被拒绝
+    // fds在调用时被dup，调用者仍然拥有原来的fd；fds随data的第一个字节到达对端，data不能为空
+    void sendWithFds(const std::string &data, const std::vector<int> &fds);
+    // 取走已经收到的文件描述符，按到达顺序排列，所有权交给调用者，在loop线程中调用(例如onMessage中)
+    std::vector<int> takeReceivedFds();
+    // 以下三个只能在loop线程中调用(例如onMessage中)
+    // 协议层可以把应答直接序列化到outputBuffer()中，省掉一次拼接和拷贝，然后调用flushOutput()发送
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    Buffer *outputBuffer() { return &outputBuffer_; }
+    void flushOutput();
+
+    // 协议层保存在连接上的状态，例如HTTP解析器
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
     // 关闭连接
     void shutdown();
-
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
-    void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
-    {
-        highWaterMarkCallback_ = cb;
-        highWaterMark_ = highWaterMark;
-    }
-    void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
+    // 禁用Nagle算法
+    void setTcpNoDelay(bool on);
+    // 由TcpServer/TcpClient在连接建立前调用
+    void applySocketOptions(const SocketOptions &options);
+    // 不等待输出缓冲区发送完成，直接关闭连接
+    void forceClose();
+
+    // 直接使用共享的回调，TcpServer/TcpClient创建连接时使用
+    void setCallbacks(const TcpConnectionCallbacksPtr &callbacks) { callbacks_ = callbacks; }
+    // 单独修改某个回调，会先拷贝一份共享的回调，不影响其他连接
+    void setConnectionCallback(const ConnectionCallback &cb);
+    void setMessageCallback(const MessageCallback &cb);
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb);
+    void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark);
+    void setLowWaterMarkCallback(const LowWaterMarkCallback &cb, size_t lowWaterMark);
+    // 在loop线程中调用，或者在连接建立之前调用
+    void setFlowControl(const TcpFlowControl &flowControl);
+    void setCloseCallback(const CloseCallback &cb);
+
+    // 在这个连接上使用TLS，必须在connectEstablished()之前调用
+    // 握手在loop线程中由可读/可写事件驱动，握手完成后连接才进入connected状态并回调connectionCallback；
+    // 握手失败直接关闭连接，不会回调connectionCallback。之后收到的数据解密后才交给messageCallback，
+    // 发送的数据加密后写入socket。serverName只对客户端有效，用于SNI和证书的主机名校验
+    void startTls(const std::shared_ptr<TlsContext> &context, bool isServer, const std::string &serverName = "");
+    bool secure() const { return tls_ != nullptr; }
+    // 握手完成后加密/解密是否已经交给内核(kTLS)，发送方向交给内核时sendFile()仍然用sendfile零拷贝
+    bool kernelTlsSend() const;
+    bool kernelTlsRecv() const;
 
     // 连接建立
     void connectEstablished();
@@ -66,30 +169,76 @@ private:
     void handleWrite();
     void handleClose();
     void handleError();
+    void handleTlsHandshake();
 
+    void sendInLoop(const std::string &buf);
     void sendInLoop(const void *data, size_t len);
+    void sendWithFdsInLoop(const std::string &data, const std::vector<int> &fds);
+    void sendFileInLoop(const std::shared_ptr<OpenFile> &file, off_t offset, size_t count);
+    bool hasPendingOutput() const;
+    void ensureWriting();
+    void checkOutputWatermarks();
+    void updateReading();
+    bool writeThrottled() const;
+    size_t writeAllowance();
+    void consumeWriteTokens(size_t len);
+    void consumeReadTokens(size_t len);
+    void accountMemory();
+    void countRead(ssize_t n);
+    void countWrite(ssize_t n, bool sendBufferFull);
+    void countOutputBuffer();
+    void countClosed();
+    void writeCompleted();
+    void scheduleCorkedFlush();
+    ssize_t writeOutput(int *savedErrno);
+    ssize_t writeOutputSegment(size_t budget, int *savedErrno);
+    ssize_t sendFileSegment(size_t budget, int *savedErrno);
+    ssize_t writeSocket(const void *data, size_t len);
+    void retrieveOutput(size_t len);
+    bool userspaceTls() const;
 
     void shutdownInLoop();
+    void forceCloseInLoop();
 
+    TcpConnectionCallbacks *mutableCallbacks();
+
+    struct FdPassing;
+    FdPassing *fdPassing();
+    struct FileSending;
+    struct FlowState;
+    FlowState *flowState();
+
+    // 成员按大小排列减少填充，Socket和Channel直接内嵌，不单独分配
     EventLoop *loop_;  // 绝对不是mainLoop，因为TcpConnection都是在subLoop里管理的
-    const std::string name_;
     std::atomic_int state_;
     bool readinig_;
-
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    bool highWaterMarkReached_;  // 已经回调过highWaterMarkCallback，等待降到lowWaterMark
+    bool corkedFlushQueued_;     // corking时已经在loop中登记了本轮结束时的flush
+    MemoryBudgetShard *budgetShard_;  // 第一次上报用量时才查找
+    size_t budgetInput_;              // 已经上报给MemoryBudget的输入、输出缓冲区数据量
+    size_t budgetOutput_;
+    TrafficStatsShard *statsShard_;  // connectEstablished()时查找，关闭时计入关闭数后清空
+    const int64_t createdMicros_;    // 单调时钟
+    int64_t requestStartMicros_;     // 还没有应答完的第一次读取时poll返回的单调时钟，0表示没有
+    Socket socket_;
+    const std::shared_ptr<const std::string> namePrefix_;  // 为空时name_就是构造时给定的名字
+    mutable std::string name_;
+    mutable std::once_flag nameOnce_;
+    const uint64_t id_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
 
-    ConnectionCallback connectionCallback_;        // 有新连接时的回调
-    MessageCallback messageCallback_;              // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成以后的回调
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
+    TcpConnectionCallbacksPtr callbacks_;
+    TrafficCounters traffic_;
 
-    size_t highWaterMark_;
+    Buffer inputBuffer_;   // 接收数据的缓冲区 第一次收到数据时才分配内存
+    Buffer outputBuffer_;  // 发送数据的缓冲区 第一次有数据没有写完时才分配内存
 
-    Buffer inputBuffer_;   // 接收数据的缓冲区
-    Buffer outputBuffer_;  // 发送数据的缓冲区
+    std::unique_ptr<FdPassing> fdPassing_;  // 正在收发的文件描述符，第一次传递fd时才分配
+    std::unique_ptr<FileSending> fileSending_;  // 等待sendfile的文件段，第一次sendFile()时才分配
+    std::unique_ptr<TlsSession> tls_;           // 只有TLS连接才分配
+    std::unique_ptr<FlowState> flowState_;      // 打开了流量控制才分配
+    std::shared_ptr<void> context_;
 };
\ No newline at end of file
@@ -1,8 +1,26 @@
 #include "TcpServer.h"
 
+#include <mutex>
+#include <unordered_map>
+
 #include "Logger.h"
+#include "Slab.h"
+#include "Trace.h"
 #include "strings.h"
 
+// 一个loop上的连接 只有新建连接(baseLoop)、连接关闭(所属loop)和跨线程遍历时加锁，锁几乎没有竞争
+struct TcpServer::ConnectionShard
+{
+    explicit ConnectionShard(EventLoop *loopArg)
+        : loop(loopArg)
+    {
+    }
+
+    EventLoop *const loop;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+};
+
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
     if (loop == nullptr)
@@ -17,36 +35,123 @@ TcpServer::TcpServer(EventLoop *loop,
                      const std::string &nameArg,
                      Option option)
     : loop_(CheckLoopNotNull(loop)),
-      ipPort_(listenAddr.toIpPort()),
+      listenAddr_(listenAddr),
       name_(nameArg),
+      connNamePrefix_(std::make_shared<std::string>(nameArg + "-" + listenAddr.toIpPort() + "#")),
       acceptor_(new Acceptor(loop, listenAddr, option == kNoReusePort)),
       threadPool_(new EventLoopThreadPool(loop, name_)),
-      connectionCallback_(),
-      messageCallback_(),
-      nextConnIds_(1),
-      started_(0)
+      started_(0),
+      nextShard_(0),
+      nextConnId_(1),
+      connectionCount_(0),
+      draining_(false)
 {
     // 当有新用户连接时，会执行TcpServer::newConnection回调 即 Accept::handleRead
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection,
                                                   this,
                                                   std::placeholders::_1,
                                                   std::placeholders::_2));
+
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = std::make_shared<TcpConnectionCallbacks>();
+    // 设置了如何关闭连接的回调
+    callbacks->closeCallback = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
+    callbacks->trafficStats = std::make_shared<TrafficStats>();
+    callbacks_ = callbacks;
 }
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    if (drainedCallback_)
+    {
+        loop_->cancel(drainTimer_);
+    }
+    for (auto &shard : shards_)
     {
-        // 这个局部的shared_ptr智能指针对象出右括号可以自动释放new出来的TcpConnection对象资源
-        TcpConnectionPtr conn(item.second);
-        // TcpServer本身的这个强智能指针不再指向TcpConnection对象
-        item.second.reset();
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+        std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            connections.swap(shard->connections);
+        }
+        for (auto &item : connections)
+        {
+            // 销毁连接 TcpServer不再持有，connectDestroyed执行完之后释放TcpConnection
+            shard->loop->runInLoop(
+                std::bind(&TcpConnection::connectDestroyed, item.second));
+        }
     }
 }
 
+void TcpServer::setConnectionCallback(const ConnectionCallback &cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->connectionCallback = cb;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setMessageCallback(const MessageCallback &cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->messageCallback = cb;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setWriteCompleteCallback(const WriteCompleteCallback &cb)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->writeCompleteCallback = cb;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->highWaterMarkCallback = cb;
+    callbacks->highWaterMark = highWaterMark;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setLowWaterMarkCallback(const LowWaterMarkCallback &cb, size_t lowWaterMark)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->lowWaterMarkCallback = cb;
+    callbacks->lowWaterMark = lowWaterMark;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setFlowControl(const TcpFlowControl &flowControl)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->flowControl = flowControl;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setMemoryBudget(const MemoryBudgetPtr &budget)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->memoryBudget = budget;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setTrafficStats(const TrafficStatsPtr &stats)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->trafficStats = stats;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setCorking(bool on)
+{
+    std::shared_ptr<TcpConnectionCallbacks> callbacks = TcpConnectionCallbacks::copyOf(callbacks_);
+    callbacks->corking = on;
+    callbacks_ = callbacks;
+}
+
+void TcpServer::setSocketOptions(const SocketOptions &options)
+{
+    socketOptions_ = options;
+    acceptor_->setSocketOptions(options);
+}
+
 // 设置subLoop的个数
 void TcpServer::setThreadNumber(int numThreads)
 {
@@ -59,6 +164,10 @@ void TcpServer::start()
     if (started_++ == 0)  // 防止一个TcpServer对象被启动多次
     {
         threadPool_->start(threadInitCallback_);  // 启动底层的loop线程池
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            shards_.emplace_back(new ConnectionShard(ioLoop));
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
@@ -66,60 +175,140 @@ void TcpServer::start()
 // 有一个新的客户端的连接，accepotr会执行这个回调
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
+    TraceScope trace("TcpServer::newConnection", sockfd);
     // 轮询算法，选择一个subLoop来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnIds_);
-    ++nextConnIds_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+    ConnectionShard *shard = shards_[nextShard_].get();
+    nextShard_ = (nextShard_ + 1) % shards_.size();
+    EventLoop *ioLoop = shard->loop;
+    const uint64_t connId = nextConnId_++;
 
     // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    // AF_UNIX连接的本端地址就是监听地址，直接共享，不再为每个连接分配sockaddr_un
+    InetAddress localAddr = listenAddr_.isUnix() ? listenAddr_ : InetAddress::localAddressOf(sockfd);
+
+    // 根据连接成功的sockfd，创建TcpConnection连接对象
+    // 对象和引用计数的控制块一起从ioLoop的slab中分配，只占用一个block
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(SlabAllocator<TcpConnection>(ioLoop->connectionSlab()),
+                                                                ioLoop,
+                                                                std::string(),
+                                                                sockfd,
+                                                                localAddr,
+                                                                peerAddr,
+                                                                connId,
+                                                                connNamePrefix_);
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
+              name_.c_str(), conn->name().c_str(), peerAddr.toIpPort().c_str());
     {
-        LOG_ERROR("sockets::getLocalAddr");
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->connections[connId] = conn;
+    }
+    ++connectionCount_;
+    conn->applySocketOptions(socketOptions_);
+    // 以下回调均为用户设置给TcpServer->TcpConnection->Channel 最后Poller通知Channel执行，所有连接共享同一份
+    conn->setCallbacks(callbacks_);
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_, true);
     }
-    InetAddress localAddr(local);
-
-    // 根据连接成功的sockfd，创建TcpConnection连接对象(可以使用make_shared()节约一次new)
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
-    // 以下回调均为用户设置给TcpServer->TcpConnection->Channel 最后Poller通知Channel执行
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    // 设置了如何关闭连接的回调
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
 
     // 直接调用TcpConnection::connectEstablished方法 (1、tie(), 2、epollin, 3、connectionCallback_())
     ioLoop->runInLoop(
         std::bind(&TcpConnection::connectEstablished, conn));
 }
 
+// 在连接所属的loop中调用
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    LOG_DEBUG("TcpServer::removeConnection [%s] - connection %s\n",
+              name_.c_str(), conn->name().c_str());
+
+    ConnectionShard *shard = shardOf(conn->getLoop());
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->connections.erase(conn->id());
+    }
+    size_t remaining = --connectionCount_;
+    conn->getLoop()->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn));
+    if (remaining == 0 && draining_)
+    {
+        loop_->runInLoop(std::bind(&TcpServer::checkDrained, this));
+    }
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+// loop的个数就是线程数，顺序查找就够了
+TcpServer::ConnectionShard *TcpServer::shardOf(EventLoop *loop) const
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
+    for (const std::unique_ptr<ConnectionShard> &shard : shards_)
+    {
+        if (shard->loop == loop)
+        {
+            return shard.get();
+        }
+    }
+    LOG_FATAL("TcpServer::shardOf [%s] - unknown loop %p\n", name_.c_str(), loop);
+    return nullptr;
+}
 
-    size_t n = connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn));
+void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb) const
+{
+    std::vector<TcpConnectionPtr> connections;
+    for (const std::unique_ptr<ConnectionShard> &shard : shards_)
+    {
+        connections.clear();
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            connections.reserve(shard->connections.size());
+            for (const auto &item : shard->connections)
+            {
+                connections.push_back(item.second);
+            }
+        }
+        for (const TcpConnectionPtr &conn : connections)
+        {
+            cb(conn);
+        }
+    }
+}
+
+void TcpServer::drain(double deadlineSeconds, const DrainedCallback &cb)
+{
+    if (!draining_.exchange(true))
+    {
+        loop_->runInLoop(std::bind(&TcpServer::drainInLoop, this, deadlineSeconds, cb));
+    }
+}
+
+void TcpServer::drainInLoop(double deadlineSeconds, const DrainedCallback &cb)
+{
+    LOG_INFO("TcpServer::drain [%s] - %zu connections, deadline %.1fs\n",
+             name_.c_str(), connectionCount_.load(), deadlineSeconds);
+    acceptor_->stopListening();
+    drainedCallback_ = cb ? cb : [] {};
+    drainTimer_ = loop_->runAfter(deadlineSeconds, std::bind(&TcpServer::drainTimeout, this));
+    checkDrained();
+}
+
+void TcpServer::drainTimeout()
+{
+    LOG_INFO("TcpServer::drain [%s] - deadline reached, closing %zu connections\n",
+             name_.c_str(), connectionCount_.load());
+    forEachConnection([](const TcpConnectionPtr &conn) { conn->forceClose(); });
+}
+
+void TcpServer::checkDrained()
+{
+    if (connectionCount_ == 0 && drainedCallback_)
+    {
+        loop_->cancel(drainTimer_);
+        DrainedCallback cb;
+        cb.swap(drainedCallback_);
+        cb();
+    }
+}
+
+int TcpServer::handOffListener()
+{
+    acceptor_->handOff();
+    return acceptor_->fd();
 }
\ No newline at end of file
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #include "Acceptor.h"
 #include "Buffer.h"
@@ -12,13 +14,17 @@
 #include "EventLoop.h"
 #include "EventLoopThreadPool.h"
 #include "InetAddress.h"
+#include "MemoryBudget.h"
 #include "TcpConnection.h"
+#include "TlsContext.h"
+#include "TrafficStats.h"
 #include "noncopyable.h"
 
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    using DrainedCallback = std::function<void()>;
 
     enum Option
     {
@@ -33,9 +39,25 @@ public:
     ~TcpServer();
 
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 已经建立的连接继续使用原来的回调，之后建立的连接使用新设置的回调
+    void setConnectionCallback(const ConnectionCallback &cb);
+    void setMessageCallback(const MessageCallback &cb);
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb);
+    void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark);
+    void setLowWaterMarkCallback(const LowWaterMarkCallback &cb, size_t lowWaterMark);
+    // 连接的背压和限速，见TcpFlowControl
+    void setFlowControl(const TcpFlowControl &flowControl);
+    // 连接缓冲区中的数据计入全局内存预算，多个TcpServer/TcpClient可以共享同一个预算
+    void setMemoryBudget(const MemoryBudgetPtr &budget);
+    // 默认每个TcpServer有自己的流量统计，多个TcpServer可以设置同一个TrafficStats合并统计；在start()之前设置
+    void setTrafficStats(const TrafficStatsPtr &stats);
+    // 同一轮循环中的多次send()/sendFile()合并，本轮结束时一次写出，适合一条消息分几次send()的协议
+    // 回调中直接调用flushOutput()的协议层(HttpServer、RpcServer)本来就是合并写出的，不需要打开
+    void setCorking(bool on);
+    // 监听socket和之后接受的连接的选项，在start()之前设置
+    void setSocketOptions(const SocketOptions &options);
+    // 之后接受的连接都使用TLS，握手完成后才回调connectionCallback；在start()之前设置
+    void setTlsContext(const TlsContextPtr &context) { tlsContext_ = context; }
 
     // 设置subLoop的个数
     void setThreadNumber(int numThreads);
@@ -43,27 +65,56 @@ public:
     // 开启服务器监听
     void start();
 
+    const std::string &name() const { return name_; }
+    // 连接的流量计数，trafficStats()->snapshot()可以在任意线程调用
+    const TrafficStatsPtr &trafficStats() const { return callbacks_->trafficStats; }
+
+    // 当前的连接数，可以在任意线程调用
+    size_t connectionCount() const { return connectionCount_; }
+    // 在调用线程中对每个连接执行cb，遍历的是各个loop的连接表的快照
+    // cb中只能调用可以跨线程使用的方法，例如send()、shutdown()、forceClose()
+    void forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb) const;
+
+    // 平滑退出：停止accept，已经建立的连接继续服务，全部关闭后在baseLoop中回调cb
+    // 超过deadlineSeconds还没有关闭的连接强制关闭；可以在任意线程调用，只有第一次调用生效
+    void drain(double deadlineSeconds, const DrainedCallback &cb);
+    bool draining() const { return draining_; }
+
+    // 监听fd交给新进程(见ListenerHandoff)，之后析构时不再删除AF_UNIX socket文件
+    int handOffListener();
+
 private:
+    struct ConnectionShard;
+
     void newConnection(int sockfd, const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
-
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    ConnectionShard *shardOf(EventLoop *loop) const;
+    void drainInLoop(double deadlineSeconds, const DrainedCallback &cb);
+    void drainTimeout();
+    void checkDrained();
 
     EventLoop *loop_;  // baseLoop_ 用户定义的loop
-    const std::string ipPort_;
+    const InetAddress listenAddr_;
     const std::string name_;
+    const std::shared_ptr<const std::string> connNamePrefix_;  // "name-ip:port#"，所有连接共享，连接名在用到时才生成
     std::unique_ptr<Acceptor> acceptor_;  // 运行在mainloop_，任务就是监听新连接事件
     std::shared_ptr<EventLoopThreadPool> threadPool_;
 
-    ConnectionCallback connectionCallback_;        // 有新连接时的回调
-    MessageCallback messageCallback_;              // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成以后的回调
+    TcpConnectionCallbacksPtr callbacks_;  // 所有连接共享的回调
+    TlsContextPtr tlsContext_;             // 为空时不使用TLS
+    SocketOptions socketOptions_;
 
     ThreadInitCallback threadInitCallback_;  // loop线程初始化时的回调
 
     std::atomic_int started_;
 
-    int nextConnIds_;
-    ConnectionMap connections_;  // 保存所有的连接
+    // 连接按所属的loop分片保存，关闭时在连接自己的loop中移除，不经过baseLoop
+    std::vector<std::unique_ptr<ConnectionShard>> shards_;  // start()时按loop创建，之后不再变化
+    size_t nextShard_;                                      // 轮询分配，只在baseLoop中访问
+    uint64_t nextConnId_;
+    std::atomic<size_t> connectionCount_;
+
+    std::atomic_bool draining_;
+    DrainedCallback drainedCallback_;  // 以下只在baseLoop中访问
+    TimerId drainTimer_;
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Callbacks.h"
+#include "Channel.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/**
+ * 定时器队列 所有定时器共用一个timerfd，timerfd总是设置为最早到期的定时器的时间
+ * timerfd可读时由所属的EventLoop像普通channel一样处理，执行所有已经到期的定时器
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全 可以在其他线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    void handleRead();  // timerfd可读
+
+    // 移除并返回所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_;  // 按到期时间排序
+
+    // 与timers_保存相同的定时器，按地址排序，用于cancel
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_;  // 到期回调执行过程中被取消的定时器
+};
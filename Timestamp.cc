@@ -1,27 +1,87 @@
 #include "Timestamp.h"
 
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 
+// 每个线程缓存上一次格式化的秒数和对应的日期时间字符串，同一秒内不再调用localtime_r
+__thread time_t t_lastSecond = -1;
+__thread char t_timePrefix[32];
+__thread int t_timePrefixLen = 0;
+
 Timestamp::Timestamp(int64_t microSecondsSinceEpochArg)
-    : microSecondsSinceEpochArg_(microSecondsSinceEpochArg)
+    : microSecondsSinceEpoch_(microSecondsSinceEpochArg)
 {
 }
 
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(NULL));
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+}
+
+int64_t Timestamp::monotonicMicroSeconds()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
+int64_t Timestamp::monotonicNanoSeconds()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+// 只在秒数变化时才重新格式化日期时间
+static void cacheTimePrefix(time_t seconds)
+{
+    if (seconds != t_lastSecond)
+    {
+        t_lastSecond = seconds;
+        struct tm tm_time;
+        ::localtime_r(&seconds, &tm_time);
+        t_timePrefixLen = snprintf(t_timePrefix, sizeof t_timePrefix, "%4d/%02d/%02d %02d:%02d:%02d",
+                                   tm_time.tm_year + 1900,
+                                   tm_time.tm_mon + 1,
+                                   tm_time.tm_mday,
+                                   tm_time.tm_hour,
+                                   tm_time.tm_min,
+                                   tm_time.tm_sec);
+    }
 }
 
 std::string Timestamp::toString() const
 {
-    char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpochArg_);
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d : ",
-             tm_time->tm_year + 1900,
-             tm_time->tm_mon + 1,
-             tm_time->tm_mday,
-             tm_time->tm_hour,
-             tm_time->tm_min,
-             tm_time->tm_sec);
-    return buf;
-}
\ No newline at end of file
+    char buf[64];
+    int len = formatTo(buf, sizeof buf);
+    return std::string(buf, len);
+}
+
+int Timestamp::formatTo(char *buf, int len) const
+{
+    cacheTimePrefix(secondsSinceEpoch());
+    if (len < t_timePrefixLen + 4)
+    {
+        return 0;
+    }
+    memcpy(buf, t_timePrefix, t_timePrefixLen);
+    memcpy(buf + t_timePrefixLen, " : ", 4);
+    return t_timePrefixLen + 3;
+}
+
+std::string Timestamp::toFormattedString(bool showMicroseconds) const
+{
+    cacheTimePrefix(secondsSinceEpoch());
+    char buf[64];
+    int len = t_timePrefixLen;
+    memcpy(buf, t_timePrefix, len);
+    if (showMicroseconds)
+    {
+        int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        len += snprintf(buf + len, sizeof buf - len, ".%06d", microseconds);
+    }
+    return std::string(buf, len);
+}
@@ -1,18 +1,70 @@
 #pragma once
 
+#include <stdint.h>
+#include <time.h>
+
 #include <iostream>
 #include <string>
 
+/**
+ * 时间戳 精度为微秒
+ * now()是墙上时间(CLOCK_REALTIME)，用于日志、定时器和对外展示
+ * monotonicMicroSeconds()/monotonicNanoSeconds()是单调时钟，不受系统时间调整的影响，用于测量耗时
+ */
 class Timestamp
 {
 public:
-    Timestamp() : microSecondsSinceEpochArg_(0)
+    Timestamp() : microSecondsSinceEpoch_(0)
     {
     }
     explicit Timestamp(int64_t microSecondsSinceEpochArg);
+
     static Timestamp now();
+    static Timestamp invalid() { return Timestamp(); }
+
+    static int64_t monotonicMicroSeconds();
+    static int64_t monotonicNanoSeconds();
+
+    // 格式 "2021/03/02 15:30:00 : "，同一线程同一秒内的调用复用缓存的日期时间前缀
     std::string toString() const;
+    // 把toString()的结果写入buf，不分配内存，返回写入的长度
+    int formatTo(char *buf, int len) const;
+    // 格式 "2021/03/02 15:30:00.123456"
+    std::string toFormattedString(bool showMicroseconds = true) const;
+
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const
+    {
+        return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 
 private:
-    int64_t microSecondsSinceEpochArg_;
+    int64_t microSecondsSinceEpoch_;
 };
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间戳的差值 单位秒
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp上增加seconds秒
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
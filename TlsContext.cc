@@ -0,0 +1,123 @@
+#include "TlsContext.h"
+
+#include "Logger.h"
+
+#ifdef MYMUDUO_WITH_TLS
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+void TlsContext::logErrors(const char *what)
+{
+    unsigned long err;
+    bool logged = false;
+    while ((err = ERR_get_error()) != 0)
+    {
+        char message[256];
+        ERR_error_string_n(err, message, sizeof message);
+        LOG_ERROR("%s: %s\n", what, message);
+        logged = true;
+    }
+    if (!logged)
+    {
+        LOG_ERROR("%s failed\n", what);
+    }
+}
+
+static SSL_CTX *newContext(const TlsOptions &options, bool server)
+{
+    SSL_CTX *ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+    if (ctx == nullptr)
+    {
+        TlsContext::logErrors("SSL_CTX_new");
+        return nullptr;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // Buffer扩容时数据会搬家，SSL_write重试时允许传入新的地址；允许部分写入，和write(2)的语义一致
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // 对端不发close_notify直接关闭连接时按正常关闭处理，和普通TCP连接一致
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+    if (options.kernelTls)
+    {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
+    bool ok = true;
+    if (!options.certificateFile.empty())
+    {
+        ok = ok && SSL_CTX_use_certificate_chain_file(ctx, options.certificateFile.c_str()) == 1;
+        ok = ok && SSL_CTX_use_PrivateKey_file(ctx, options.privateKeyFile.c_str(), SSL_FILETYPE_PEM) == 1;
+        ok = ok && SSL_CTX_check_private_key(ctx) == 1;
+    }
+    else if (server)
+    {
+        LOG_ERROR("TlsContext: server requires a certificate\n");
+        ok = false;
+    }
+    if (ok && options.verifyPeer)
+    {
+        ok = options.caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx) == 1
+                                    : SSL_CTX_load_verify_locations(ctx, options.caFile.c_str(), nullptr) == 1;
+        int mode = server ? SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_PEER;
+        SSL_CTX_set_verify(ctx, mode, nullptr);
+    }
+    if (!ok)
+    {
+        TlsContext::logErrors("TlsContext");
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+std::shared_ptr<TlsContext> TlsContext::newServerContext(const TlsOptions &options)
+{
+    SSL_CTX *ctx = newContext(options, true);
+    return ctx ? std::shared_ptr<TlsContext>(new TlsContext(ctx, options, true)) : nullptr;
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClientContext(const TlsOptions &options)
+{
+    SSL_CTX *ctx = newContext(options, false);
+    return ctx ? std::shared_ptr<TlsContext>(new TlsContext(ctx, options, false)) : nullptr;
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(ctx_);
+}
+
+#else
+
+std::shared_ptr<TlsContext> TlsContext::newServerContext(const TlsOptions &options)
+{
+    LOG_ERROR("TlsContext: built without TLS support (MYMUDUO_WITH_TLS)\n");
+    return nullptr;
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClientContext(const TlsOptions &options)
+{
+    LOG_ERROR("TlsContext: built without TLS support (MYMUDUO_WITH_TLS)\n");
+    return nullptr;
+}
+
+TlsContext::~TlsContext() = default;
+
+void TlsContext::logErrors(const char *what)
+{
+    LOG_ERROR("%s failed\n", what);
+}
+
+#endif
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, const TlsOptions &options, bool server)
+    : ctx_(ctx),
+      options_(options),
+      server_(server)
+{
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "noncopyable.h"
+
+struct ssl_ctx_st;
+
+struct TlsOptions
+{
+    std::string certificateFile;  // PEM格式的证书链，服务端必须提供
+    std::string privateKeyFile;   // PEM格式的私钥
+    std::string caFile;           // 校验对端证书使用的CA，为空时使用系统默认的CA路径
+    bool verifyPeer = false;      // 客户端校验服务端的证书和主机名；服务端要求客户端出示证书
+    bool kernelTls = true;        // 握手完成后把密钥交给内核(kTLS)，内核不支持时退回用户态加解密
+};
+
+/**
+ * TLS配置 包装OpenSSL的SSL_CTX，同一个服务器或者客户端的所有连接共享一个
+ * 编译时没有打开MYMUDUO_WITH_TLS(找不到OpenSSL)时，创建函数记录错误并返回nullptr
+ */
+class TlsContext : noncopyable
+{
+public:
+    // 失败时记录错误日志并返回nullptr
+    static std::shared_ptr<TlsContext> newServerContext(const TlsOptions &options);
+    static std::shared_ptr<TlsContext> newClientContext(const TlsOptions &options);
+    ~TlsContext();
+
+    const TlsOptions &options() const { return options_; }
+    bool isServer() const { return server_; }
+    ssl_ctx_st *native() const { return ctx_; }
+
+    // 把当前线程OpenSSL错误队列中的错误全部写入日志并清空
+    static void logErrors(const char *what);
+
+private:
+    TlsContext(ssl_ctx_st *ctx, const TlsOptions &options, bool server);
+
+    ssl_ctx_st *ctx_;
+    const TlsOptions options_;
+    const bool server_;
+};
+
+using TlsContextPtr = std::shared_ptr<TlsContext>;
@@ -0,0 +1,212 @@
+#include "TlsSession.h"
+
+#include <errno.h>
+#include <limits.h>
+
+#include <algorithm>
+
+#include "Buffer.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_WITH_TLS
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+// 每次SSL_read至少预留一个TLS记录的空间
+static const size_t kRecordSize = 16 * 1024;
+
+TlsSession::TlsSession(const TlsContextPtr &context, int sockfd, bool isServer, const std::string &serverName)
+    : context_(context),
+      ssl_(nullptr),
+      kernelSend_(false),
+      kernelRecv_(false),
+      peerClosed_(false)
+{
+    if (!context_)
+    {
+        return;
+    }
+    ssl_ = SSL_new(context_->native());
+    if (ssl_ == nullptr || SSL_set_fd(ssl_, sockfd) != 1)
+    {
+        TlsContext::logErrors("SSL_new");
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+        return;
+    }
+    if (isServer)
+    {
+        SSL_set_accept_state(ssl_);
+        return;
+    }
+    SSL_set_connect_state(ssl_);
+    if (!serverName.empty())
+    {
+        SSL_set_tlsext_host_name(ssl_, serverName.c_str());
+        if (context_->options().verifyPeer)
+        {
+            SSL_set1_host(ssl_, serverName.c_str());
+        }
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    SSL_free(ssl_);
+}
+
+TlsSession::HandshakeResult TlsSession::handshake()
+{
+    if (ssl_ == nullptr)
+    {
+        return kHandshakeFailed;
+    }
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+        // 打开了SSL_OP_ENABLE_KTLS而且内核支持时，OpenSSL在这里已经设置好TCP_ULP "tls"
+        kernelSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        kernelRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+        return kHandshakeDone;
+    }
+    switch (SSL_get_error(ssl_, ret))
+    {
+    case SSL_ERROR_WANT_READ:
+        return kHandshakeWantRead;
+    case SSL_ERROR_WANT_WRITE:
+        return kHandshakeWantWrite;
+    case SSL_ERROR_SYSCALL:
+        if (ERR_peek_error() == 0)
+        {
+            // 握手期间对端关闭了连接
+            LOG_ERROR("TlsSession::handshake peer closed, errno=%d\n", errno);
+            return kHandshakeFailed;
+        }
+        // fall through
+    default:
+        TlsContext::logErrors("TlsSession::handshake");
+        return kHandshakeFailed;
+    }
+}
+
+ssize_t TlsSession::read(Buffer *buf, int *savedErrno)
+{
+    ssize_t total = 0;
+    while (true)
+    {
+        // SSL内部缓存的记录不会再触发可读事件，需要一直读到WANT_READ
+        buf->ensureWriteableBytes(kRecordSize);
+        size_t writable = std::min(buf->writeableBytes(), static_cast<size_t>(INT_MAX));
+        ERR_clear_error();
+        int n = SSL_read(ssl_, buf->beginWrite(), static_cast<int>(writable));
+        if (n > 0)
+        {
+            buf->hasWritten(n);
+            total += n;
+            continue;
+        }
+
+        int err = SSL_get_error(ssl_, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            if (total == 0)
+            {
+                *savedErrno = EWOULDBLOCK;
+                return -1;
+            }
+            return total;
+        }
+        if (err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && ERR_peek_error() == 0 && errno == 0))
+        {
+            // 已经读到的明文先交给上层，调用者再通过peerClosed()关闭连接
+            peerClosed_ = true;
+            return total;
+        }
+        if (err == SSL_ERROR_SYSCALL && ERR_peek_error() == 0)
+        {
+            *savedErrno = errno;
+        }
+        else
+        {
+            TlsContext::logErrors("TlsSession::read");
+            *savedErrno = EPROTO;
+        }
+        return total > 0 ? total : -1;
+    }
+}
+
+ssize_t TlsSession::write(const void *data, size_t len)
+{
+    // 带PARTIAL_WRITE时SSL_write返回已经加密写出的字节数；WANT_WRITE之后用同样的数据重试
+    int count = static_cast<int>(std::min(len, static_cast<size_t>(INT_MAX)));
+    ERR_clear_error();
+    int n = SSL_write(ssl_, data, count);
+    if (n > 0)
+    {
+        return n;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+    {
+        errno = EWOULDBLOCK;
+    }
+    else if (err == SSL_ERROR_SYSCALL && ERR_peek_error() == 0 && errno != 0)
+    {
+        // 保留write(2)的errno，例如EPIPE、ECONNRESET
+    }
+    else
+    {
+        TlsContext::logErrors("TlsSession::write");
+        errno = EPIPE;
+    }
+    return -1;
+}
+
+void TlsSession::shutdown()
+{
+    if (ssl_ != nullptr && SSL_is_init_finished(ssl_))
+    {
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+        ERR_clear_error();
+    }
+}
+
+#else
+
+TlsSession::TlsSession(const TlsContextPtr &context, int sockfd, bool isServer, const std::string &serverName)
+    : context_(context),
+      ssl_(nullptr),
+      kernelSend_(false),
+      kernelRecv_(false),
+      peerClosed_(false)
+{
+}
+
+TlsSession::~TlsSession() = default;
+
+TlsSession::HandshakeResult TlsSession::handshake()
+{
+    LOG_ERROR("TlsSession: built without TLS support (MYMUDUO_WITH_TLS)\n");
+    return kHandshakeFailed;
+}
+
+ssize_t TlsSession::read(Buffer *buf, int *savedErrno)
+{
+    *savedErrno = EPROTO;
+    return -1;
+}
+
+ssize_t TlsSession::write(const void *data, size_t len)
+{
+    errno = EPIPE;
+    return -1;
+}
+
+void TlsSession::shutdown()
+{
+}
+
+#endif
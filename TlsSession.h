@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "TlsContext.h"
+#include "noncopyable.h"
+
+class Buffer;
+struct ssl_st;
+
+/**
+ * 一个连接上的TLS状态 由TcpConnection持有，只在连接所属的loop线程中使用
+ * SSL直接读写socket fd，握手完成后OpenSSL可以把密钥交给内核(kTLS)：
+ * kernelSend()为true时socket上的write/sendfile由内核加密，不再经过SSL_write
+ * read/write的返回值和错误码与read(2)/write(2)一致，不能继续时errno为EWOULDBLOCK
+ */
+class TlsSession : noncopyable
+{
+public:
+    enum HandshakeResult
+    {
+        kHandshakeDone,
+        kHandshakeWantRead,
+        kHandshakeWantWrite,
+        kHandshakeFailed,
+    };
+
+    // serverName只对客户端有效，用于SNI，校验对端证书时也用于匹配主机名
+    TlsSession(const TlsContextPtr &context, int sockfd, bool isServer, const std::string &serverName);
+    ~TlsSession();
+
+    HandshakeResult handshake();
+
+    // 解密socket上所有完整的TLS记录追加到buf，返回读到的明文字节数
+    // 对端发送close_notify或者关闭连接返回0，之前已经读到了明文时返回明文长度并设置peerClosed()
+    // 出错返回-1，错误码写入savedErrno
+    ssize_t read(Buffer *buf, int *savedErrno);
+    // 加密后写入socket，返回写入的明文字节数，失败返回-1并设置errno
+    ssize_t write(const void *data, size_t len);
+    // 发送close_notify，不等待对端的close_notify
+    void shutdown();
+
+    // 握手完成后发送/接收方向是否已经交给内核
+    bool kernelSend() const { return kernelSend_; }
+    bool kernelRecv() const { return kernelRecv_; }
+    bool peerClosed() const { return peerClosed_; }
+
+private:
+    TlsContextPtr context_;  // SSL对象引用SSL_CTX，连接存在期间不能释放
+    ssl_st *ssl_;
+    bool kernelSend_;
+    bool kernelRecv_;
+    bool peerClosed_;
+};
@@ -0,0 +1,126 @@
+#include "Trace.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CurrentThread.h"
+#include "Timestamp.h"
+
+namespace Trace
+{
+    std::atomic_bool g_enabled(false);
+
+    namespace
+    {
+        const size_t kRingSize = 1 << 16;  // 每个线程64K个事件 2MB
+
+        // 单个线程的环形缓冲区，只有所属线程写入，导出时其他线程读取
+        struct Ring
+        {
+            Ring() : head(0), tid(CurrentThread::tid()) {}
+
+            Event events[kRingSize];
+            std::atomic<uint64_t> head;  // 已经写入的事件总数
+            int tid;
+        };
+
+        // 线程退出后环形缓冲区仍然保留，以便导出
+        std::mutex g_ringsMutex;
+        std::vector<std::unique_ptr<Ring>> g_rings;
+
+        __thread Ring *t_ring = nullptr;
+
+        Ring *threadRing()
+        {
+            if (__builtin_expect(t_ring == nullptr, 0))
+            {
+                std::unique_ptr<Ring> ring(new Ring);
+                t_ring = ring.get();
+                std::unique_lock<std::mutex> lock(g_ringsMutex);
+                g_rings.push_back(std::move(ring));
+            }
+            return t_ring;
+        }
+    }  // namespace
+
+    void setEnabled(bool on)
+    {
+        g_enabled.store(on, std::memory_order_relaxed);
+    }
+
+    int64_t nowNs()
+    {
+        return Timestamp::monotonicNanoSeconds();
+    }
+
+    void record(const char *name, int64_t startNs, int64_t durNs, int32_t arg0, int32_t arg1)
+    {
+        Ring *ring = threadRing();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        Event &event = ring->events[head & (kRingSize - 1)];
+        event.startNs = startNs;
+        event.durNs = durNs;
+        event.name = name;
+        event.arg0 = arg0;
+        event.arg1 = arg1;
+        // release保证导出线程看到head时也能看到事件内容
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    std::string toChromeTrace()
+    {
+        std::string json;
+        json.reserve(1024 * 1024);
+        json += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        const int pid = ::getpid();
+        bool first = true;
+        char buf[256];
+
+        std::unique_lock<std::mutex> lock(g_ringsMutex);
+        for (const std::unique_ptr<Ring> &ring : g_rings)
+        {
+            // 只导出最近kRingSize个事件，正在被覆盖的最旧事件可能读到一半，追踪数据允许这种误差
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t begin = head > kRingSize ? head - kRingSize : 0;
+            for (uint64_t i = begin; i < head; ++i)
+            {
+                const Event &event = ring->events[i & (kRingSize - 1)];
+                snprintf(buf, sizeof buf,
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"pid\":%d,\"tid\":%d,\"args\":{\"arg0\":%d,\"arg1\":%d}}",
+                         first ? "" : ",",
+                         event.name,
+                         event.startNs / 1000.0,
+                         event.durNs / 1000.0,
+                         pid,
+                         ring->tid,
+                         event.arg0,
+                         event.arg1);
+                json += buf;
+                first = false;
+            }
+        }
+
+        json += "]}\n";
+        return json;
+    }
+
+    bool dumpChromeTrace(const std::string &path)
+    {
+        std::string json = toChromeTrace();
+        FILE *fp = ::fopen(path.c_str(), "we");
+        if (fp == nullptr)
+        {
+            return false;
+        }
+        bool ok = ::fwrite(json.data(), 1, json.size(), fp) == json.size();
+        ::fclose(fp);
+        return ok;
+    }
+
+}  // namespace Trace
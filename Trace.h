@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "noncopyable.h"
+
+/**
+ * 二进制事件追踪 用于定位EventLoop的延迟毛刺
+ * 每个线程第一次记录事件时分配自己的环形缓冲区，写入定长的二进制事件，只有本线程写，不需要加锁
+ * 环形缓冲区写满后覆盖最旧的事件；未开启时每个追踪点只有一次relaxed load和一次分支
+ * dumpChromeTrace()导出为Chrome/Perfetto可以直接打开的JSON(chrome://tracing、ui.perfetto.dev)
+ */
+namespace Trace
+{
+    // 定长的二进制事件 对应Chrome trace中ph为X的完整事件
+    struct Event
+    {
+        int64_t startNs;   // CLOCK_MONOTONIC 纳秒
+        int64_t durNs;     // 持续时间
+        const char *name;  // 必须是静态字符串
+        int32_t arg0;
+        int32_t arg1;
+    };
+
+    extern std::atomic_bool g_enabled;
+
+    inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool on);
+
+    int64_t nowNs();
+
+    // 向当前线程的环形缓冲区追加一个事件
+    void record(const char *name, int64_t startNs, int64_t durNs, int32_t arg0 = 0, int32_t arg1 = 0);
+
+    // 把所有线程环形缓冲区中的事件导出为Chrome trace JSON，可以在追踪进行中调用
+    std::string toChromeTrace();
+    bool dumpChromeTrace(const std::string &path);
+
+}  // namespace Trace
+
+// 记录一个作用域的开始时间和持续时间
+class TraceScope : noncopyable
+{
+public:
+    explicit TraceScope(const char *name, int32_t arg0 = 0, int32_t arg1 = 0)
+        : name_(name),
+          startNs_(Trace::enabled() ? Trace::nowNs() : 0),
+          arg0_(arg0),
+          arg1_(arg1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (startNs_ != 0)
+        {
+            Trace::record(name_, startNs_, Trace::nowNs() - startNs_, arg0_, arg1_);
+        }
+    }
+
+    void setArg0(int32_t arg) { arg0_ = arg; }
+    void setArg1(int32_t arg) { arg1_ = arg; }
+
+private:
+    const char *name_;
+    int64_t startNs_;  // 为0表示构造时没有开启追踪
+    int32_t arg0_;
+    int32_t arg1_;
+};
@@ -0,0 +1,108 @@
+#include "TrafficStats.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+const double TrafficStats::kLifetimeBounds[kLifetimeBuckets - 1] = {0.01, 0.1, 1, 10, 60, 600, 3600};
+
+void TrafficCounters::addTo(TrafficSnapshot *snapshot) const
+{
+    snapshot->bytesReceived += bytesReceived.get();
+    snapshot->bytesSent += bytesSent.get();
+    snapshot->messagesReceived += messagesReceived.get();
+    snapshot->writes += writes.get();
+    snapshot->eagains += eagains.get();
+    snapshot->outputBufferBytes += outputBufferBytes.get();
+}
+
+void TrafficStatsShard::countClosed(int64_t micros)
+{
+    connectionsClosed.add(1);
+    lifetimeMicros.add(micros);
+    int bucket = 0;
+    while (bucket < kLifetimeBuckets - 1 && micros > TrafficStats::kLifetimeBounds[bucket] * 1000 * 1000)
+    {
+        ++bucket;
+    }
+    lifetimeCounts[bucket].add(1);
+}
+
+void TrafficStatsShard::updateOutputBuffer(int64_t before, int64_t after)
+{
+    traffic.outputBufferBytes.add(after - before);
+    if (after > maxOutputBufferBytes.get())
+    {
+        maxOutputBufferBytes.set(after);
+    }
+}
+
+TrafficStats::TrafficStats()
+    : shardCount_(0)
+{
+}
+
+TrafficStats::~TrafficStats() = default;
+
+TrafficStatsShard *TrafficStats::shardFor(EventLoop *loop)
+{
+    // 分片创建后不再删除，先不加锁查找
+    int count = shardCount_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        if (shards_[i]->loop == loop)
+        {
+            return shards_[i].get();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    count = shardCount_.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i)
+    {
+        if (shards_[i]->loop == loop)
+        {
+            return shards_[i].get();
+        }
+    }
+    if (count == kMaxShards)
+    {
+        LOG_FATAL("TrafficStats: more than %d loops share one TrafficStats\n", kMaxShards);
+    }
+    shards_[count].reset(new TrafficStatsShard(loop));
+    shardCount_.store(count + 1, std::memory_order_release);
+    return shards_[count].get();
+}
+
+TrafficStats::Snapshot TrafficStats::snapshot() const
+{
+    Snapshot snapshot;
+    int64_t lifetimeMicros = 0;
+    int count = shardCount_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        const TrafficStatsShard &shard = *shards_[i];
+        LoopTraffic loop;
+        loop.loop = shard.loop;
+        shard.traffic.addTo(&loop.traffic);
+        loop.connectionsOpened = shard.connectionsOpened.get();
+        loop.connectionsClosed = shard.connectionsClosed.get();
+
+        shard.traffic.addTo(&snapshot.traffic);
+        snapshot.connectionsOpened += loop.connectionsOpened;
+        snapshot.connectionsClosed += loop.connectionsClosed;
+        snapshot.maxOutputBufferBytes = std::max(snapshot.maxOutputBufferBytes, shard.maxOutputBufferBytes.get());
+        for (int b = 0; b < kLifetimeBuckets; ++b)
+        {
+            snapshot.lifetimeCounts[b] += shard.lifetimeCounts[b].get();
+        }
+        lifetimeMicros += shard.lifetimeMicros.get();
+        snapshot.requestLatency.merge(shard.requestLatency);
+        snapshot.callbackLatency.merge(shard.callbackLatency);
+        snapshot.loops.push_back(loop);
+    }
+    // 各个计数分别读取，新关闭的连接可能只计入了一部分，活跃连接数不会小于0
+    snapshot.activeConnections = std::max<int64_t>(snapshot.connectionsOpened - snapshot.connectionsClosed, 0);
+    snapshot.lifetimeSecondsSum = static_cast<double>(lifetimeMicros) / (1000 * 1000);
+    return snapshot;
+}
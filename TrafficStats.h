@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "LocalCounter.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+// 某一时刻的流量计数
+struct TrafficSnapshot
+{
+    int64_t bytesReceived = 0;
+    int64_t bytesSent = 0;
+    int64_t messagesReceived = 0;   // 回调messageCallback的次数
+    int64_t writes = 0;             // 写出了数据的写socket次数
+    int64_t eagains = 0;            // 写socket时内核发送缓冲区已满(EAGAIN或者只写出一部分)的次数
+    int64_t outputBufferBytes = 0;  // 输出缓冲区中待发送的字节数，不含sendFile()排队的文件段
+};
+
+// 连接和loop共用的流量计数 只在所属的loop线程中更新
+struct TrafficCounters
+{
+    LocalCounter bytesReceived;
+    LocalCounter bytesSent;
+    LocalCounter messagesReceived;
+    LocalCounter writes;
+    LocalCounter eagains;
+    LocalCounter outputBufferBytes;
+
+    void countRead(ssize_t n)
+    {
+        bytesReceived.add(n);
+        messagesReceived.add(1);
+    }
+    // n是写socket的结果
+    void countWrite(ssize_t n, bool sendBufferFull)
+    {
+        if (n > 0)
+        {
+            bytesSent.add(n);
+            writes.add(1);
+        }
+        if (sendBufferFull)
+        {
+            eagains.add(1);
+        }
+    }
+    void addTo(TrafficSnapshot *snapshot) const;
+};
+
+// 一个loop上的计数 由TcpConnection在这个loop线程中直接更新
+struct TrafficStatsShard
+{
+    static const int kLifetimeBuckets = 8;
+
+    explicit TrafficStatsShard(EventLoop *loopArg) : loop(loopArg) {}
+
+    void countClosed(int64_t micros);
+    void updateOutputBuffer(int64_t before, int64_t after);
+
+    EventLoop *const loop;
+    TrafficCounters traffic;
+    LocalCounter connectionsOpened;
+    LocalCounter connectionsClosed;
+    LocalCounter maxOutputBufferBytes;  // 单个连接输出缓冲区的历史最大值
+    LocalCounter lifetimeCounts[kLifetimeBuckets];  // 已关闭连接的存活时间分布，见TrafficStats::kLifetimeBounds
+    LocalCounter lifetimeMicros;                    // 已关闭连接的存活时间之和
+    LatencyHistogram requestLatency;   // 从收到数据(poll返回)到应答全部写出(writeComplete)，单调时钟
+    LatencyHistogram callbackLatency;  // messageCallback本身的耗时
+};
+
+/**
+ * 连接的流量统计 TcpServer创建一份，它的所有连接共享，也可以通过TcpClient::setTrafficStats()加入
+ * 计数按loop分片，连接在自己的loop线程中更新自己和所属分片的计数，热路径上没有带锁的原子指令和互斥锁；
+ * snapshot()可以在任意线程调用，读取时把各个分片加起来，耗时直方图也在这时合并
+ */
+class TrafficStats : noncopyable
+{
+public:
+    static const int kLifetimeBuckets = TrafficStatsShard::kLifetimeBuckets;
+    // 存活时间分布的上界(秒)，最后一个桶是+Inf
+    static const double kLifetimeBounds[kLifetimeBuckets - 1];
+
+    struct LoopTraffic
+    {
+        EventLoop *loop;
+        TrafficSnapshot traffic;
+        int64_t connectionsOpened;
+        int64_t connectionsClosed;
+    };
+
+    struct Snapshot
+    {
+        TrafficSnapshot traffic;
+        int64_t connectionsOpened = 0;
+        int64_t connectionsClosed = 0;
+        int64_t activeConnections = 0;
+        int64_t maxOutputBufferBytes = 0;
+        int64_t lifetimeCounts[kLifetimeBuckets] = {};  // 每个桶单独计数，不累加
+        double lifetimeSecondsSum = 0;
+        LatencyHistogram requestLatency;  // 各个loop的直方图合并的结果
+        LatencyHistogram callbackLatency;
+        std::vector<LoopTraffic> loops;
+    };
+
+    TrafficStats();
+    ~TrafficStats();
+
+    Snapshot snapshot() const;
+
+    // 由TcpConnection在loop线程中调用，返回这个loop的分片
+    TrafficStatsShard *shardFor(EventLoop *loop);
+
+private:
+    static const int kMaxShards = 256;
+
+    std::mutex mutex_;  // 保护新增分片
+    std::unique_ptr<TrafficStatsShard> shards_[kMaxShards];
+    std::atomic_int shardCount_;
+};
+
+using TrafficStatsPtr = std::shared_ptr<TrafficStats>;
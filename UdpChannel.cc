@@ -0,0 +1,406 @@
+#include "UdpChannel.h"
+
+#include <errno.h>
+#include <netinet/udp.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 一次可读事件最多读取的轮数，避免一个繁忙的socket饿死同一个loop上的其他fd
+static const int kMaxReadRounds = 8;
+// 开启GRO后内核可能把多个数据报合并成一个，最长不超过一个IP包
+static const size_t kGroSlotSize = 65536;
+// 一次GSO发送最多合并的数据报个数和总长度
+static const int kMaxGsoSegments = 64;
+static const size_t kMaxGsoBytes = 65000;
+// 每一段不能超过出口的MTU，按以太网1500字节MTU下IPv4的UDP载荷计算
+static const size_t kMaxGsoSegmentSize = 1472;
+
+static const size_t kRecvControlSpace = CMSG_SPACE(sizeof(int));
+static const size_t kSendControlSpace = CMSG_SPACE(sizeof(uint16_t));
+
+static int createNonblockingUdp()
+{
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static bool samePeer(const sockaddr_in &lhs, const sockaddr_in &rhs)
+{
+    return lhs.sin_addr.s_addr == rhs.sin_addr.s_addr && lhs.sin_port == rhs.sin_port;
+}
+
+UdpPacketPool::UdpPacketPool(size_t packetSize)
+    : packetSize_(packetSize)
+{
+}
+
+UdpPacketPool::~UdpPacketPool()
+{
+    for (UdpPacket *packet : all_)
+    {
+        ::operator delete(packet);
+    }
+}
+
+UdpPacket *UdpPacketPool::get()
+{
+    if (free_.empty())
+    {
+        // 数据报缓冲区紧跟在结构体后面，一个packet只分配一次
+        UdpPacket *packet = static_cast<UdpPacket *>(::operator new(sizeof(UdpPacket) + packetSize_));
+        packet->data = reinterpret_cast<char *>(packet + 1);
+        all_.push_back(packet);
+        return packet;
+    }
+    UdpPacket *packet = free_.back();
+    free_.pop_back();
+    return packet;
+}
+
+UdpChannel::UdpChannel(EventLoop *loop, const InetAddress &bindAddr, const UdpOptions &options)
+    : loop_(loop),
+      socket_(createNonblockingUdp()),
+      channel_(loop, socket_.fd()),
+      options_(options),
+      gro_(false),
+      gso_(false),
+      recvSlotSize_(options.maxDatagramSize),
+      pool_(options.maxDatagramSize),
+      inRead_(false),
+      flushQueued_(false)
+{
+    socket_.setReuseAddr(true);
+    if (options_.reusePort)
+    {
+        socket_.setReusePort(true);
+    }
+    socket_.bindAddress(bindAddr);
+
+    int on = 1;
+    if (options_.gro && ::setsockopt(socket_.fd(), SOL_UDP, UDP_GRO, &on, sizeof on) == 0)
+    {
+        gro_ = true;
+        recvSlotSize_ = kGroSlotSize;
+    }
+    // 能读取UDP_SEGMENT说明内核支持GSO，实际发送失败时再关闭
+    int segment = 0;
+    socklen_t optlen = sizeof segment;
+    if (options_.gso && ::getsockopt(socket_.fd(), SOL_UDP, UDP_SEGMENT, &segment, &optlen) == 0)
+    {
+        gso_ = true;
+    }
+
+    const int batch = std::max(1, options_.batchSize);
+    recvBuffer_.resize(batch * recvSlotSize_);
+    recvAddrs_.resize(batch);
+    recvIovecs_.resize(batch);
+    recvControl_.resize(batch * kRecvControlSpace);
+    recvMsgs_.resize(batch);
+    sendIovecs_.resize(batch * kMaxGsoSegments);
+    sendControl_.resize(batch * kSendControlSpace);
+    sendMsgs_.resize(batch);
+    sendSegments_.resize(batch);
+
+    for (int i = 0; i < batch; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvBuffer_[i * recvSlotSize_];
+        recvIovecs_[i].iov_len = recvSlotSize_;
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        memset(&hdr, 0, sizeof hdr);
+        hdr.msg_name = &recvAddrs_[i];
+        hdr.msg_iov = &recvIovecs_[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = &recvControl_[i * kRecvControlSpace];
+    }
+
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+
+    LOG_INFO("UdpChannel::ctor fd=%d gro=%d gso=%d\n", socket_.fd(), gro_, gso_);
+}
+
+UdpChannel::~UdpChannel()
+{
+    LOG_INFO("UdpChannel::dtor fd=%d pending=%zu\n", socket_.fd(), pending_.size());
+    // 没有调用stop()时channel还在poller中，不删除的话poller会留下悬空的Channel指针
+    if (loop_->hasChannel(&channel_))
+    {
+        channel_.disableAll();
+        channel_.remove();
+    }
+}
+
+void UdpChannel::start()
+{
+    channel_.enableReading();
+}
+
+void UdpChannel::stop()
+{
+    channel_.disableAll();
+    channel_.remove();
+}
+
+InetAddress UdpChannel::localAddress()
+{
+    return InetAddress::localAddressOf(socket_.fd());
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    const int batch = static_cast<int>(recvMsgs_.size());
+    inRead_ = true;
+    for (int round = 0; round < kMaxReadRounds; ++round)
+    {
+        for (int i = 0; i < batch; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_controllen = kRecvControlSpace;
+            hdr.msg_flags = 0;
+        }
+
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), batch, 0, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpChannel::handleRead fd=%d recvmmsg err:%d\n", socket_.fd(), errno);
+            }
+            break;
+        }
+        ++stats_.recvCalls;
+        for (int i = 0; i < n; ++i)
+        {
+            deliver(recvMsgs_[i], receiveTime);
+        }
+        if (n < batch)
+        {
+            break;
+        }
+    }
+    inRead_ = false;
+
+    // 回调中产生的响应一起发送
+    flush();
+}
+
+void UdpChannel::deliver(const mmsghdr &msg, Timestamp receiveTime)
+{
+    const msghdr &hdr = msg.msg_hdr;
+    if (hdr.msg_flags & MSG_TRUNC)
+    {
+        ++stats_.truncated;
+        return;
+    }
+
+    // GRO合并的数据报通过cmsg给出每一段的长度，除最后一段外长度都相同
+    size_t segmentSize = msg.msg_len;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&hdr), cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int gsoSize = 0;
+            memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof gsoSize);
+            if (gsoSize > 0)
+            {
+                segmentSize = static_cast<size_t>(gsoSize);
+            }
+        }
+    }
+
+    const InetAddress peer(*static_cast<const sockaddr_in *>(hdr.msg_name));
+    const char *data = static_cast<const char *>(hdr.msg_iov[0].iov_base);
+    size_t offset = 0;
+    do
+    {
+        size_t len = std::min(segmentSize, msg.msg_len - offset);
+        offset += len;
+        // 打开GRO时接收槽是kGroSlotSize，超过maxDatagramSize的数据报不会被内核截断，在这里丢弃
+        if (len > options_.maxDatagramSize)
+        {
+            ++stats_.truncated;
+            continue;
+        }
+        ++stats_.recvPackets;
+        if (messageCallback_)
+        {
+            messageCallback_(this, peer, data + offset - len, len, receiveTime);
+        }
+    } while (offset < msg.msg_len);
+}
+
+void UdpChannel::send(const InetAddress &peer, const void *data, size_t len)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(*peer.getSockAddr(), data, len);
+    }
+    else
+    {
+        // 跨线程发送时data可能在执行前就被销毁，需要拷贝一份数据绑定到回调中
+        loop_->runInLoop(std::bind(&UdpChannel::sendCopyInLoop, shared_from_this(), peer,
+                                   std::string(static_cast<const char *>(data), len)));
+    }
+}
+
+void UdpChannel::sendCopyInLoop(const InetAddress &peer, const std::string &data)
+{
+    sendInLoop(*peer.getSockAddr(), data.data(), data.size());
+}
+
+void UdpChannel::sendInLoop(const sockaddr_in &peer, const void *data, size_t len)
+{
+    if (len > pool_.packetSize() || pending_.size() >= options_.maxPendingPackets)
+    {
+        ++stats_.sendDropped;
+        return;
+    }
+
+    UdpPacket *packet = pool_.get();
+    packet->peer = peer;
+    packet->len = len;
+    memcpy(packet->data, data, len);
+    pending_.push_back(packet);
+
+    // handleRead中的数据报在读完这一批以后发送，等待可写时由handleWrite发送，其他情况在loop中排队一次flush
+    if (!inRead_ && !flushQueued_ && !channel_.isWriteEvent())
+    {
+        flushQueued_ = true;
+        loop_->queueInLoop(std::bind(&UdpChannel::queuedFlush, shared_from_this()));
+    }
+}
+
+void UdpChannel::queuedFlush()
+{
+    flushQueued_ = false;
+    flush();
+}
+
+void UdpChannel::handleWrite()
+{
+    flush();
+}
+
+// 丢弃发送队列最前面的packets个数据报
+void UdpChannel::dropFront(int packets)
+{
+    for (int i = 0; i < packets; ++i)
+    {
+        pool_.put(pending_.front());
+        pending_.pop_front();
+    }
+}
+
+void UdpChannel::flush()
+{
+    const int batch = static_cast<int>(sendMsgs_.size());
+    while (!pending_.empty())
+    {
+        // 组装一批消息，GSO开启时发往同一地址的连续等长数据报合并成一个消息，最后一段可以更短
+        int nmsgs = 0;
+        size_t index = 0;
+        size_t iovIndex = 0;
+        while (nmsgs < batch && index < pending_.size())
+        {
+            const UdpPacket *first = pending_[index];
+            int segments = 1;
+            size_t total = first->len;
+            while (gso_ && first->len > 0 && first->len <= kMaxGsoSegmentSize && index + segments < pending_.size() && segments < kMaxGsoSegments)
+            {
+                const UdpPacket *next = pending_[index + segments];
+                if (!samePeer(next->peer, first->peer) || next->len > first->len || next->len == 0 ||
+                    total + next->len > kMaxGsoBytes)
+                {
+                    break;
+                }
+                total += next->len;
+                ++segments;
+                if (next->len < first->len)
+                {
+                    break;
+                }
+            }
+
+            for (int i = 0; i < segments; ++i)
+            {
+                const UdpPacket *packet = pending_[index + i];
+                sendIovecs_[iovIndex + i].iov_base = packet->data;
+                sendIovecs_[iovIndex + i].iov_len = packet->len;
+            }
+
+            msghdr &hdr = sendMsgs_[nmsgs].msg_hdr;
+            memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = const_cast<sockaddr_in *>(&first->peer);
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &sendIovecs_[iovIndex];
+            hdr.msg_iovlen = segments;
+            if (segments > 1)
+            {
+                hdr.msg_control = &sendControl_[nmsgs * kSendControlSpace];
+                hdr.msg_controllen = kSendControlSpace;
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segmentSize = static_cast<uint16_t>(first->len);
+                memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+            }
+
+            sendSegments_[nmsgs] = segments;
+            index += segments;
+            iovIndex += segments;
+            ++nmsgs;
+        }
+
+        int sent = ::sendmmsg(socket_.fd(), sendMsgs_.data(), nmsgs, 0);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // socket发送缓冲区满了，等可写时继续发送
+                if (!channel_.isWriteEvent())
+                {
+                    channel_.enableWriting();
+                }
+                return;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (sendSegments_[0] > 1 && (errno == EIO || errno == EINVAL))
+            {
+                // 网卡或者内核不支持GSO发送，之后逐个发送
+                LOG_ERROR("UdpChannel fd=%d UDP_SEGMENT failed err:%d, disable gso\n", socket_.fd(), errno);
+                gso_ = false;
+                continue;
+            }
+            // 第一个消息发送失败(例如对端不可达)，丢弃后继续发送后面的
+            LOG_ERROR("UdpChannel::flush fd=%d sendmmsg err:%d\n", socket_.fd(), errno);
+            stats_.sendDropped += sendSegments_[0];
+            dropFront(sendSegments_[0]);
+            continue;
+        }
+
+        ++stats_.sendCalls;
+        for (int i = 0; i < sent; ++i)
+        {
+            stats_.sentPackets += sendSegments_[i];
+            dropFront(sendSegments_[i]);
+        }
+    }
+
+    if (channel_.isWriteEvent())
+    {
+        channel_.disableWriting();
+    }
+}
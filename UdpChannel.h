@@ -0,0 +1,136 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Socket.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+// 一个待发送的数据报 data指向紧跟在结构体后面的缓冲区
+struct UdpPacket
+{
+    sockaddr_in peer;
+    size_t len;
+    char *data;
+};
+
+/**
+ * 数据报缓冲区池 只在所属的loop线程中使用，不加锁
+ * 发送完的packet放回空闲列表复用，稳定运行以后收发数据报不再分配内存
+ */
+class UdpPacketPool : noncopyable
+{
+public:
+    explicit UdpPacketPool(size_t packetSize);
+    ~UdpPacketPool();
+
+    UdpPacket *get();
+    void put(UdpPacket *packet) { free_.push_back(packet); }
+
+    size_t packetSize() const { return packetSize_; }
+    size_t allocated() const { return all_.size(); }
+
+private:
+    const size_t packetSize_;
+    std::vector<UdpPacket *> free_;
+    std::vector<UdpPacket *> all_;
+};
+
+struct UdpOptions
+{
+    int batchSize = 32;               // 每次recvmmsg/sendmmsg最多处理的数据报个数
+    size_t maxDatagramSize = 2048;    // 单个数据报的最大长度，接收时更长的数据报被截断后丢弃
+    size_t maxPendingPackets = 4096;  // 发送队列的上限，socket发送缓冲区满时超出的数据报直接丢弃
+    bool reusePort = false;           // 多个socket绑定同一个地址，由内核按四元组分发
+    bool gro = true;                  // 内核支持时开启UDP_GRO，一次读取合并后的多个数据报
+    bool gso = true;                  // 内核支持时用UDP_SEGMENT把发往同一地址的等长数据报合并发送
+};
+
+/**
+ * 绑定在一个EventLoop上的UDP socket
+ * 可读时用recvmmsg批量读取数据报，逐个回调messageCallback_
+ * send()把数据报放入发送队列，本轮读事件处理完成后(或在loop中排队的flush里)用sendmmsg批量发送
+ * 除send()外的方法都只能在loop线程中调用
+ */
+class UdpChannel : noncopyable, public std::enable_shared_from_this<UdpChannel>
+{
+public:
+    struct Stats
+    {
+        uint64_t recvPackets = 0;  // 交给回调的数据报个数，GRO合并的数据报按拆分后计数
+        uint64_t recvCalls = 0;    // recvmmsg成功的次数
+        uint64_t truncated = 0;    // 超过maxDatagramSize被丢弃的数据报
+        uint64_t sentPackets = 0;
+        uint64_t sendCalls = 0;    // sendmmsg成功的次数
+        uint64_t sendDropped = 0;  // 队列满、数据报过长或者发送出错而丢弃的数据报
+    };
+
+    UdpChannel(EventLoop *loop, const InetAddress &bindAddr, const UdpOptions &options);
+    ~UdpChannel();
+
+    void start();  // 开始接收数据报
+    void stop();   // 不再关注任何事件，未发送的数据报随对象一起释放；析构前没有调用时由析构函数执行
+
+    void setMessageCallback(const UdpMessageCallback &cb) { messageCallback_ = cb; }
+
+    // 线程安全 不在loop线程中调用时会拷贝一份数据
+    void send(const InetAddress &peer, const void *data, size_t len);
+
+    EventLoop *getLoop() const { return loop_; }
+    int fd() { return socket_.fd(); }
+    InetAddress localAddress();  // 实际绑定的地址，绑定端口0时可以取得内核分配的端口
+
+    bool groEnabled() const { return gro_; }
+    bool gsoEnabled() const { return gso_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void deliver(const mmsghdr &msg, Timestamp receiveTime);
+
+    void sendInLoop(const sockaddr_in &peer, const void *data, size_t len);
+    void sendCopyInLoop(const InetAddress &peer, const std::string &data);
+    void queuedFlush();
+    void flush();
+    void dropFront(int packets);
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    const UdpOptions options_;
+    bool gro_;
+    bool gso_;
+    UdpMessageCallback messageCallback_;
+
+    // 接收：batchSize个固定的槽位，构造时一次分配
+    size_t recvSlotSize_;
+    std::vector<char> recvBuffer_;
+    std::vector<sockaddr_in> recvAddrs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<char> recvControl_;
+    std::vector<mmsghdr> recvMsgs_;
+
+    // 发送：数据报从pool_中分配，排队等待flush
+    UdpPacketPool pool_;
+    std::deque<UdpPacket *> pending_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<char> sendControl_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<int> sendSegments_;  // 每个消息包含的数据报个数
+
+    bool inRead_;       // handleRead中产生的数据报在读完这一批后统一发送
+    bool flushQueued_;  // 已经在loop中排队了一次flush
+    Stats stats_;
+};
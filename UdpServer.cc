@@ -0,0 +1,68 @@
+#include "UdpServer.h"
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainLoop is nullptr\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop,
+                     const InetAddress &listenAddr,
+                     const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+      listenAddr_(listenAddr),
+      name_(nameArg),
+      threadPool_(new EventLoopThreadPool(loop, name_)),
+      started_(0)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    for (UdpChannelPtr &channel : channels_)
+    {
+        // 在所属的loop中注销channel，回调持有shared_ptr，执行完后才释放
+        channel->getLoop()->runInLoop(std::bind(&UdpChannel::stop, channel));
+        channel.reset();
+    }
+}
+
+void UdpServer::setThreadNumber(int numThreads)
+{
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start()
+{
+    if (started_++ == 0)  // 防止一个UdpServer对象被启动多次
+    {
+        threadPool_->start(threadInitCallback_);
+
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        UdpOptions options = options_;
+        options.reusePort = options.reusePort || loops.size() > 1;
+
+        // 绑定端口0时由第一个socket取得内核分配的端口，其余socket绑定同一个端口
+        InetAddress bindAddr = listenAddr_;
+        for (EventLoop *ioLoop : loops)
+        {
+            UdpChannelPtr channel = std::make_shared<UdpChannel>(ioLoop, bindAddr, options);
+            if (channels_.empty())
+            {
+                bindAddr = channel->localAddress();
+            }
+            channel->setMessageCallback(messageCallback_);
+            channels_.push_back(channel);
+            ioLoop->runInLoop(std::bind(&UdpChannel::start, channel));
+        }
+
+        LOG_INFO("UdpServer::start [%s] - %zu sockets on %s\n",
+                 name_.c_str(), channels_.size(), bindAddr.toIpPort().c_str());
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "UdpChannel.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+using UdpChannelPtr = std::shared_ptr<UdpChannel>;
+
+/**
+ * UDP服务器 没有连接的概念，每个loop上有一个绑定监听地址的UdpChannel
+ * 设置了subLoop时每个subLoop各绑定一个SO_REUSEPORT的socket，由内核按四元组哈希分发数据报
+ * 没有subLoop时只在baseLoop上收发
+ */
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    UdpServer(EventLoop *loop,
+              const InetAddress &listenAddr,
+              const std::string &nameArg);
+    ~UdpServer();
+
+    // 以下设置需要在start()之前调用
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setMessageCallback(const UdpMessageCallback &cb) { messageCallback_ = cb; }
+    void setOptions(const UdpOptions &options) { options_ = options; }
+    void setThreadNumber(int numThreads);
+
+    void start();
+
+    // start()之后有效，用于查询绑定的地址和统计信息
+    const std::vector<UdpChannelPtr> &channels() const { return channels_; }
+
+private:
+    EventLoop *loop_;  // baseLoop_ 用户定义的loop
+    const InetAddress listenAddr_;
+    const std::string name_;
+    std::unique_ptr<EventLoopThreadPool> threadPool_;
+
+    UdpOptions options_;
+    UdpMessageCallback messageCallback_;
+    ThreadInitCallback threadInitCallback_;
+
+    std::atomic_int started_;
+    std::vector<UdpChannelPtr> channels_;
+};
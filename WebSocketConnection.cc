@@ -0,0 +1,183 @@
+#include "WebSocketConnection.h"
+
+#include <string>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+WebSocketConnection::WebSocketConnection(const TcpConnectionPtr &conn,
+                                         const std::shared_ptr<const WebSocketCallbacks> &callbacks)
+    : loop_(conn->getLoop()),
+      conn_(conn),
+      callbacks_(callbacks),
+      parser_(callbacks->maxMessageBytes),
+      state_(kConnecting),
+      processing_(false),
+      peerCloseCode_(WebSocketContext::kAbnormalClosure)
+{
+}
+
+bool WebSocketConnection::open(const HttpRequest &req, const WebSocketOpenCallback &openCallback)
+{
+    // 回调中发送的帧跟在101应答后面，由HttpServer统一flush；拒绝时连同101应答一起撤销
+    state_ = kOpen;
+    processing_ = true;
+    bool accepted = openCallback(req, shared_from_this());
+    processing_ = false;
+    if (!accepted)
+    {
+        state_ = kClosed;
+    }
+    return accepted;
+}
+
+void WebSocketConnection::handleData(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    if (state_ == kClosed)
+    {
+        // close握手已经完成或者协议出错，之后的数据全部丢弃
+        buf->retrieveAll();
+        return;
+    }
+
+    WebSocketConnectionPtr self(shared_from_this());
+    processing_ = true;
+    while (state_ != kClosed)
+    {
+        WebSocketContext::ParseResult result = parser_.parse(buf);
+        if (result == WebSocketContext::kNeedMore)
+        {
+            break;
+        }
+        if (result == WebSocketContext::kError)
+        {
+            LOG_DEBUG("WebSocketConnection protocol error from %s, close code %d\n",
+                      conn->peerAddress().toIpPort().c_str(), parser_.errorCode());
+            failConnection(conn, buf, parser_.errorCode());
+            break;
+        }
+
+        if (result == WebSocketContext::kGotMessage)
+        {
+            // 已经发出close之后收到的消息直接丢弃
+            if (state_ == kOpen && callbacks_->messageCallback)
+            {
+                callbacks_->messageCallback(self, parser_.payload(),
+                                            parser_.opcode() == WebSocketContext::kBinary);
+            }
+        }
+        else if (parser_.opcode() == WebSocketContext::kPing)
+        {
+            // payload指向输入缓冲区，直接拷贝到输出缓冲区
+            sendFrameInLoop(WebSocketContext::kPong, parser_.payload().data(), parser_.payload().size());
+        }
+        else if (parser_.opcode() == WebSocketContext::kClose)
+        {
+            peerCloseCode_ = parser_.closeCode();
+            if (state_ == kOpen)
+            {
+                // 对端发起的close原样回复状态码
+                if (peerCloseCode_ == WebSocketContext::kNoStatusReceived)
+                {
+                    WebSocketContext::appendFrame(conn->outputBuffer(), WebSocketContext::kClose, nullptr, 0);
+                }
+                else
+                {
+                    WebSocketContext::appendCloseFrame(conn->outputBuffer(), peerCloseCode_, StringPiece());
+                }
+            }
+            state_ = kClosed;
+            parser_.finishFrame(buf);
+            buf->retrieveAll();
+            conn->flushOutput();
+            conn->shutdown();
+            break;
+        }
+        parser_.finishFrame(buf);
+    }
+    processing_ = false;
+    conn->flushOutput();
+}
+
+void WebSocketConnection::handleDisconnected()
+{
+    state_ = kClosed;
+    if (callbacks_->closeCallback)
+    {
+        callbacks_->closeCallback(shared_from_this(), peerCloseCode_);
+    }
+}
+
+void WebSocketConnection::failConnection(const TcpConnectionPtr &conn, Buffer *buf, uint16_t code)
+{
+    if (state_ == kOpen)
+    {
+        WebSocketContext::appendCloseFrame(conn->outputBuffer(), code, StringPiece());
+    }
+    state_ = kClosed;
+    buf->retrieveAll();
+    conn->flushOutput();
+    conn->shutdown();
+}
+
+void WebSocketConnection::sendFrame(WebSocketContext::Opcode opcode, const StringPiece &data)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendFrameInLoop(opcode, data.data(), data.size());
+    }
+    else
+    {
+        WebSocketConnectionPtr self(shared_from_this());
+        std::shared_ptr<std::string> copy = std::make_shared<std::string>(data.data(), data.size());
+        loop_->queueInLoop([self, opcode, copy]() {
+            self->sendFrameInLoop(opcode, copy->data(), copy->size());
+        });
+    }
+}
+
+void WebSocketConnection::sendFrameInLoop(WebSocketContext::Opcode opcode, const char *data, size_t len)
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (state_ != kOpen || !conn || !conn->connected())
+    {
+        return;
+    }
+    WebSocketContext::appendFrame(conn->outputBuffer(), opcode, data, len);
+    if (!processing_)
+    {
+        conn->flushOutput();
+    }
+}
+
+void WebSocketConnection::close(uint16_t code, const StringPiece &reason)
+{
+    if (loop_->isInLoopThread())
+    {
+        closeInLoop(code, reason);
+    }
+    else
+    {
+        WebSocketConnectionPtr self(shared_from_this());
+        std::shared_ptr<std::string> copy = std::make_shared<std::string>(reason.data(), reason.size());
+        loop_->queueInLoop([self, code, copy]() { self->closeInLoop(code, *copy); });
+    }
+}
+
+void WebSocketConnection::closeInLoop(uint16_t code, const StringPiece &reason)
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (state_ != kOpen || !conn || !conn->connected())
+    {
+        return;
+    }
+    WebSocketContext::appendCloseFrame(conn->outputBuffer(), code, reason);
+    state_ = kClosing;
+    if (!processing_)
+    {
+        conn->flushOutput();
+    }
+    // 输出缓冲区中还有数据时shutdown会等数据发送完再关闭写端
+    conn->shutdown();
+}
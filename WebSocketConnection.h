@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "WebSocketContext.h"
+#include "noncopyable.h"
+
+class EventLoop;
+class HttpRequest;
+class WebSocketConnection;
+
+using WebSocketConnectionPtr = std::shared_ptr<WebSocketConnection>;
+// 收到升级请求时调用，返回false拒绝升级(应答403) 回调中已经可以发送消息
+using WebSocketOpenCallback = std::function<bool(const HttpRequest &, const WebSocketConnectionPtr &)>;
+// 收到一个完整的消息(分片已经合并) message只在回调期间有效
+using WebSocketMessageCallback =
+    std::function<void(const WebSocketConnectionPtr &, const StringPiece &message, bool binary)>;
+// TCP连接断开时调用一次 code是对端close帧中的状态码，没有经过close握手时为kAbnormalClosure
+using WebSocketCloseCallback = std::function<void(const WebSocketConnectionPtr &, uint16_t code)>;
+
+// 所有WebSocket连接共享的回调和参数 由HttpServer在start()时创建
+struct WebSocketCallbacks
+{
+    WebSocketMessageCallback messageCallback;
+    WebSocketCloseCallback closeCallback;
+    size_t maxMessageBytes = 16 * 1024 * 1024;  // 超过时以1009关闭连接
+};
+
+/**
+ * 升级后的WebSocket连接 由HttpServer在握手成功时创建，通过回调交给用户
+ * 收到ping自动回复pong；收到close回复close后关闭写端；协议错误时发出对应状态码的close后关闭
+ * 在loop线程中发送时帧头和数据直接写入TcpConnection的输出缓冲区，不经过中间string；
+ * 在消息回调中发送的多个帧在这一批输入处理完后合并成一次write
+ */
+class WebSocketConnection : noncopyable, public std::enable_shared_from_this<WebSocketConnection>
+{
+public:
+    WebSocketConnection(const TcpConnectionPtr &conn, const std::shared_ptr<const WebSocketCallbacks> &callbacks);
+
+    // 以下都可以在任意线程调用，在其他线程调用时会拷贝一份数据交给loop线程
+    void sendText(const StringPiece &text) { sendFrame(WebSocketContext::kText, text); }
+    void sendBinary(const StringPiece &data) { sendFrame(WebSocketContext::kBinary, data); }
+    void ping(const StringPiece &payload = StringPiece()) { sendFrame(WebSocketContext::kPing, payload); }
+    // 发出close帧并关闭写端，之后发送的消息都被丢弃
+    void close(uint16_t code = WebSocketContext::kNormalClosure, const StringPiece &reason = StringPiece());
+
+    bool connected() const { return state_ == kOpen; }
+    EventLoop *getLoop() const { return loop_; }
+    TcpConnectionPtr connection() const { return conn_.lock(); }
+
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
+private:
+    friend class HttpServer;
+
+    enum StateE
+    {
+        kConnecting,
+        kOpen,
+        kClosing,  // 已经发出close帧，等待对端的close
+        kClosed,
+    };
+
+    // 以下由HttpServer在loop线程中调用
+    // 调用openCallback，返回false时连接不再可用
+    bool open(const HttpRequest &req, const WebSocketOpenCallback &openCallback);
+    void handleData(const TcpConnectionPtr &conn, Buffer *buf);
+    void handleDisconnected();
+
+    void sendFrame(WebSocketContext::Opcode opcode, const StringPiece &data);
+    void sendFrameInLoop(WebSocketContext::Opcode opcode, const char *data, size_t len);
+    void closeInLoop(uint16_t code, const StringPiece &reason);
+    void failConnection(const TcpConnectionPtr &conn, Buffer *buf, uint16_t code);
+
+    EventLoop *loop_;
+    std::weak_ptr<TcpConnection> conn_;  // TcpConnection的context持有本对象，这里不能再持有它
+    std::shared_ptr<const WebSocketCallbacks> callbacks_;
+    WebSocketContext parser_;
+    std::atomic_int state_;
+    bool processing_;         // 正在处理输入，发送的帧最后统一flush
+    uint16_t peerCloseCode_;  // 对端close帧中的状态码
+    std::shared_ptr<void> context_;
+};
@@ -0,0 +1,445 @@
+#include "WebSocketContext.h"
+
+#include <string.h>
+
+#include "Buffer.h"
+#include "HttpRequest.h"
+#include "Simd.h"
+
+// 分片消息结束后合并缓冲区最多保留的容量
+static const size_t kMaxRetainedFragmentBytes = 64 * 1024;
+// 控制帧的payload上限
+static const size_t kMaxControlPayload = 125;
+
+// 逗号分隔的头部值中是否有token，不区分大小写，例如Connection: keep-alive, Upgrade
+static bool headerHasToken(const StringPiece &value, const char *token)
+{
+    const char *p = value.begin();
+    const char *end = value.end();
+    while (p < end)
+    {
+        const char *comma = static_cast<const char *>(memchr(p, ',', end - p));
+        const char *itemEnd = comma != nullptr ? comma : end;
+        const char *itemBegin = p;
+        while (itemBegin < itemEnd && (*itemBegin == ' ' || *itemBegin == '\t'))
+        {
+            ++itemBegin;
+        }
+        while (itemEnd > itemBegin && (itemEnd[-1] == ' ' || itemEnd[-1] == '\t'))
+        {
+            --itemEnd;
+        }
+        if (StringPiece(itemBegin, itemEnd - itemBegin).equalsIgnoreCase(token))
+        {
+            return true;
+        }
+        p = comma != nullptr ? comma + 1 : end;
+    }
+    return false;
+}
+
+// close帧中允许出现的状态码
+static bool isValidCloseCode(uint16_t code)
+{
+    if (code >= 3000 && code <= 4999)
+    {
+        return true;
+    }
+    return code >= 1000 && code <= 1011 && code != 1004 && code != 1005 && code != 1006;
+}
+
+/**
+ * SHA-1 只用于计算握手的Sec-WebSocket-Accept，输入只有几十个字节，不追求速度
+ */
+static void sha1(const char *data, size_t len, unsigned char digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // 补位：0x80，若干个0，最后8字节是以位为单位的长度
+    std::string message(data, len);
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56)
+    {
+        message.push_back('\0');
+    }
+    uint64_t bits = static_cast<uint64_t>(len) * 8;
+    for (int i = 7; i >= 0; --i)
+    {
+        message.push_back(static_cast<char>(bits >> (i * 8)));
+    }
+
+    for (size_t block = 0; block < message.size(); block += 64)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(message.data() + block);
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (static_cast<uint32_t>(p[i * 4]) << 24) | (static_cast<uint32_t>(p[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(p[i * 4 + 2]) << 8) | p[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            uint32_t v = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (v << 1) | (v >> 31);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+    }
+}
+
+static std::string base64Encode(const unsigned char *data, size_t len)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((len + 2) / 3 * 4);
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < len)
+            v |= static_cast<uint32_t>(data[i + 1]) << 8;
+        if (i + 2 < len)
+            v |= data[i + 2];
+        result.push_back(kAlphabet[(v >> 18) & 0x3F]);
+        result.push_back(kAlphabet[(v >> 12) & 0x3F]);
+        result.push_back(i + 1 < len ? kAlphabet[(v >> 6) & 0x3F] : '=');
+        result.push_back(i + 2 < len ? kAlphabet[v & 0x3F] : '=');
+    }
+    return result;
+}
+
+WebSocketContext::WebSocketContext(size_t maxMessageBytes)
+    : maxMessageBytes_(maxMessageBytes),
+      state_(kExpectHeader),
+      fin_(false),
+      frameOpcode_(kContinuation),
+      maskKey_(0),
+      headerLength_(0),
+      payloadLength_(0),
+      unmasked_(0),
+      fragmented_(false),
+      messageOpcode_(kContinuation),
+      opcode_(kContinuation),
+      closeCode_(kNoStatusReceived),
+      errorCode_(0)
+{
+}
+
+WebSocketContext::ParseResult WebSocketContext::parse(Buffer *buf)
+{
+    while (true)
+    {
+        if (state_ == kExpectHeader)
+        {
+            if (parseHeader(buf) == kError)
+            {
+                return kError;
+            }
+            if (state_ == kExpectHeader)
+            {
+                return kNeedMore;
+            }
+        }
+        if (state_ == kGotFrame)
+        {
+            // 上一帧还没有finishFrame()
+            return kNeedMore;
+        }
+
+        // 只对新到达的数据去掩码，一帧分多次到达时每个字节只处理一次
+        size_t available = buf->readableBytes() - headerLength_;
+        if (available > payloadLength_)
+        {
+            available = payloadLength_;
+        }
+        if (available > unmasked_)
+        {
+            Simd::maskBytes(buf->peek() + headerLength_ + unmasked_, available - unmasked_, maskKey_, unmasked_);
+            unmasked_ = available;
+        }
+        if (unmasked_ < payloadLength_)
+        {
+            return kNeedMore;
+        }
+
+        const char *data = buf->peek() + headerLength_;
+        if (frameOpcode_ & 0x8)
+        {
+            opcode_ = frameOpcode_;
+            payload_ = StringPiece(data, payloadLength_);
+            if (frameOpcode_ == kClose)
+            {
+                closeCode_ = kNoStatusReceived;
+                if (payloadLength_ == 1)
+                {
+                    return fail(kProtocolError);
+                }
+                if (payloadLength_ >= 2)
+                {
+                    closeCode_ = static_cast<uint16_t>((static_cast<unsigned char>(data[0]) << 8) |
+                                                       static_cast<unsigned char>(data[1]));
+                    if (!isValidCloseCode(closeCode_))
+                    {
+                        return fail(kProtocolError);
+                    }
+                    // payload()只留下原因
+                    payload_ = StringPiece(data + 2, payloadLength_ - 2);
+                    if (!Simd::isValidUtf8(payload_.data(), payload_.size()))
+                    {
+                        return fail(kInvalidPayload);
+                    }
+                }
+            }
+            state_ = kGotFrame;
+            return kGotControl;
+        }
+
+        if (!fin_)
+        {
+            // 分片先合并起来，取走这一帧，继续解析下一帧
+            fragments_.append(data, payloadLength_);
+            buf->retrieve(headerLength_ + payloadLength_);
+            state_ = kExpectHeader;
+            continue;
+        }
+
+        if (fragmented_)
+        {
+            fragments_.append(data, payloadLength_);
+            buf->retrieve(headerLength_ + payloadLength_);
+            headerLength_ = 0;
+            payloadLength_ = 0;
+            opcode_ = messageOpcode_;
+            payload_ = StringPiece(fragments_);
+            fragmented_ = false;
+        }
+        else
+        {
+            opcode_ = frameOpcode_;
+            payload_ = StringPiece(data, payloadLength_);
+        }
+        state_ = kGotFrame;
+        if (opcode_ == kText && !Simd::isValidUtf8(payload_.data(), payload_.size()))
+        {
+            return fail(kInvalidPayload);
+        }
+        return kGotMessage;
+    }
+}
+
+WebSocketContext::ParseResult WebSocketContext::parseHeader(Buffer *buf)
+{
+    size_t readable = buf->readableBytes();
+    if (readable < 2)
+    {
+        return kNeedMore;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+    const bool fin = (p[0] & 0x80) != 0;
+    const Opcode opcode = static_cast<Opcode>(p[0] & 0x0F);
+    // 没有协商扩展，RSV位必须为0；客户端发来的帧必须带掩码
+    if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0)
+    {
+        return fail(kProtocolError);
+    }
+
+    uint64_t length = p[1] & 0x7F;
+    size_t headerLength = 2 + 4;
+    if (length == 126)
+    {
+        headerLength += 2;
+    }
+    else if (length == 127)
+    {
+        headerLength += 8;
+    }
+    if (readable < headerLength)
+    {
+        return kNeedMore;
+    }
+    if (length == 126)
+    {
+        length = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+    }
+    else if (length == 127)
+    {
+        length = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            length = (length << 8) | p[2 + i];
+        }
+        if (length >> 63)
+        {
+            return fail(kProtocolError);
+        }
+    }
+
+    if (opcode & 0x8)
+    {
+        if ((opcode != kClose && opcode != kPing && opcode != kPong) || !fin || length > kMaxControlPayload)
+        {
+            return fail(kProtocolError);
+        }
+    }
+    else
+    {
+        if (opcode != kContinuation && opcode != kText && opcode != kBinary)
+        {
+            return fail(kProtocolError);
+        }
+        // 续片必须接在未结束的分片消息后面，新消息不能打断未结束的分片消息
+        if ((opcode == kContinuation) != fragmented_)
+        {
+            return fail(kProtocolError);
+        }
+        size_t received = fragmented_ ? fragments_.size() : 0;
+        if (length > maxMessageBytes_ - received)
+        {
+            return fail(kMessageTooBig);
+        }
+        if (opcode != kContinuation && !fin)
+        {
+            fragmented_ = true;
+            messageOpcode_ = opcode;
+        }
+    }
+
+    memcpy(&maskKey_, p + headerLength - 4, 4);
+    fin_ = fin;
+    frameOpcode_ = opcode;
+    headerLength_ = headerLength;
+    payloadLength_ = static_cast<size_t>(length);
+    unmasked_ = 0;
+    state_ = kExpectPayload;
+    return kNeedMore;
+}
+
+WebSocketContext::ParseResult WebSocketContext::fail(uint16_t code)
+{
+    errorCode_ = code;
+    return kError;
+}
+
+void WebSocketContext::finishFrame(Buffer *buf)
+{
+    if (state_ != kGotFrame)
+    {
+        return;
+    }
+    buf->retrieve(headerLength_ + payloadLength_);
+    if (opcode_ == kText || opcode_ == kBinary)
+    {
+        if (fragments_.capacity() > kMaxRetainedFragmentBytes)
+        {
+            std::string().swap(fragments_);
+        }
+        else
+        {
+            fragments_.clear();
+        }
+    }
+    payload_ = StringPiece();
+    state_ = kExpectHeader;
+}
+
+void WebSocketContext::appendFrame(Buffer *output, Opcode opcode, const char *data, size_t len)
+{
+    unsigned char header[10];
+    size_t headerLength = 2;
+    header[0] = static_cast<unsigned char>(0x80 | opcode);
+    if (len < 126)
+    {
+        header[1] = static_cast<unsigned char>(len);
+    }
+    else if (len <= 0xFFFF)
+    {
+        header[1] = 126;
+        header[2] = static_cast<unsigned char>(len >> 8);
+        header[3] = static_cast<unsigned char>(len);
+        headerLength = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        uint64_t length = len;
+        for (int i = 0; i < 8; ++i)
+        {
+            header[2 + i] = static_cast<unsigned char>(length >> (56 - i * 8));
+        }
+        headerLength = 10;
+    }
+    output->ensureWriteableBytes(headerLength + len);
+    output->append(reinterpret_cast<const char *>(header), headerLength);
+    output->append(data, len);
+}
+
+void WebSocketContext::appendCloseFrame(Buffer *output, uint16_t code, const StringPiece &reason)
+{
+    char payload[kMaxControlPayload];
+    size_t reasonLength = reason.size() < kMaxControlPayload - 2 ? reason.size() : kMaxControlPayload - 2;
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code);
+    if (reasonLength > 0)
+    {
+        memcpy(payload + 2, reason.data(), reasonLength);
+    }
+    appendFrame(output, kClose, payload, 2 + reasonLength);
+}
+
+bool WebSocketContext::isUpgradeRequest(const HttpRequest &req)
+{
+    return req.method() == HttpRequest::kGet && headerHasToken(req.getHeader("Upgrade"), "websocket") &&
+           headerHasToken(req.getHeader("Connection"), "upgrade");
+}
+
+std::string WebSocketContext::acceptKey(const StringPiece &key)
+{
+    static const char kGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::string input(key.data(), key.size());
+    input.append(kGuid, sizeof kGuid - 1);
+    unsigned char digest[20];
+    sha1(input.data(), input.size(), digest);
+    return base64Encode(digest, sizeof digest);
+}
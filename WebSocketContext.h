@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "StringPiece.h"
+#include "noncopyable.h"
+
+class Buffer;
+class HttpRequest;
+
+/**
+ * 每个连接一个的WebSocket(RFC 6455)帧解析器 服务端使用，只接受带掩码的客户端帧
+ * 帧头只解析一次，payload随着数据到达增量地在输入缓冲区中原地去掩码，一帧收齐后不再扫描
+ * 不分片的数据帧直接以指向输入缓冲区的StringPiece交出，不拷贝；分片消息的各片合并到连接内复用的string中
+ * 控制帧(ping/pong/close)可以夹在分片之间，单独交出
+ * 文本消息和close帧的原因在交出前校验UTF-8
+ */
+class WebSocketContext : noncopyable
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA,
+    };
+
+    // close帧的状态码
+    enum CloseCode
+    {
+        kNormalClosure = 1000,
+        kGoingAway = 1001,
+        kProtocolError = 1002,
+        kNoStatusReceived = 1005,  // 只在本地使用，不能出现在close帧中
+        kAbnormalClosure = 1006,   // 只在本地使用，连接没有经过close握手就断开了
+        kInvalidPayload = 1007,
+        kMessageTooBig = 1009,
+        kInternalError = 1011,
+    };
+
+    enum ParseResult
+    {
+        kNeedMore,      // 消息还不完整
+        kGotMessage,    // opcode()为kText/kBinary，payload()中是一个完整的消息
+        kGotControl,    // opcode()为kPing/kPong/kClose，payload()是控制帧的payload
+        kError,         // 违反协议，errorCode()是应该回复的close状态码
+    };
+
+    explicit WebSocketContext(size_t maxMessageBytes);
+
+    // 从buf->peek()开始继续解析，数据帧的分片会被取走，完整的消息和控制帧留在缓冲区中
+    ParseResult parse(Buffer *buf);
+    // parse()返回kGotMessage/kGotControl之后有效，直到调用finishFrame()
+    Opcode opcode() const { return opcode_; }
+    const StringPiece &payload() const { return payload_; }
+    // close帧中的状态码，没有状态码时为kNoStatusReceived
+    uint16_t closeCode() const { return closeCode_; }
+    uint16_t errorCode() const { return errorCode_; }
+    // 取走当前帧占用的字节，准备解析下一帧
+    void finishFrame(Buffer *buf);
+
+    // 服务端发出的帧不带掩码，帧头和payload直接写入output
+    static void appendFrame(Buffer *output, Opcode opcode, const char *data, size_t len);
+    static void appendCloseFrame(Buffer *output, uint16_t code, const StringPiece &reason);
+
+    // GET请求带有Upgrade: websocket和Connection: Upgrade
+    static bool isUpgradeRequest(const HttpRequest &req);
+    // Sec-WebSocket-Accept = base64(SHA-1(Sec-WebSocket-Key + GUID))
+    static std::string acceptKey(const StringPiece &key);
+
+private:
+    enum State
+    {
+        kExpectHeader,
+        kExpectPayload,
+        kGotFrame,
+    };
+
+    ParseResult parseHeader(Buffer *buf);
+    ParseResult fail(uint16_t code);
+
+    const size_t maxMessageBytes_;
+
+    State state_;
+    bool fin_;
+    Opcode frameOpcode_;
+    uint32_t maskKey_;
+    size_t headerLength_;
+    size_t payloadLength_;
+    size_t unmasked_;  // 已经去掩码的payload字节数
+
+    bool fragmented_;         // 正在接收分片消息
+    Opcode messageOpcode_;    // 分片消息第一片的类型
+    std::string fragments_;   // 分片消息已经收到的部分 连接内复用
+
+    Opcode opcode_;
+    StringPiece payload_;
+    uint16_t closeCode_;
+    uint16_t errorCode_;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 基准测试程序共用的小工具
+
+// 日志输出到stderr，stdout只输出结果，方便重定向后用脚本比较
+inline void benchQuietLogging()
+{
+    Logger::setLogLevel(ERROR);
+    Logger::instance().setOutput([](const char *msg, int len) { ::fwrite(msg, 1, len, stderr); });
+}
+
+// 在loop线程中执行cb并等待执行完成
+inline void runInLoopAndWait(EventLoop *loop, std::function<void()> cb)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        cb();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+// 解析 "16,1024,65536" 形式的参数
+inline std::vector<long> parseList(const char *arg)
+{
+    std::vector<long> values;
+    std::string list(arg);
+    size_t start = 0;
+    while (true)
+    {
+        size_t comma = list.find(',', start);
+        std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!item.empty())
+        {
+            values.push_back(atol(item.c_str()));
+        }
+        if (comma == std::string::npos)
+        {
+            break;
+        }
+        start = comma + 1;
+    }
+    return values;
+}
+
+// 已排序的样本中第q分位的值
+template <typename T>
+inline T percentile(const std::vector<T> &sorted, double q)
+{
+    if (sorted.empty())
+    {
+        return T();
+    }
+    size_t index = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
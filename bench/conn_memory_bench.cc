@@ -0,0 +1,170 @@
+/**
+ * 空闲连接的内存占用测试
+ * 同一个进程内启动TcpServer，用原始socket建立N个连接(客户端不使用库中的对象，不计入堆内存)
+ * 所有连接建立后不收发数据，统计服务端每个空闲连接占用的用户态堆内存和RSS，并按线性外推到100万连接
+ * 内核中socket本身占用的内存不在统计范围内
+ *
+ * 输出一行JSON，例如
+ * {"conns":5000,"sizeof_tcpconnection":..,"heap_bytes_per_conn":..,"rss_bytes_per_conn":..,"heap_mb_at_1m":..}
+ *
+ * 用法: conn_memory_bench [--conns 5000] [--threads 1] [--port 19500]
+ * 每个连接在本进程中占用两个fd，连接数受ulimit -n限制
+ */
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "TcpServer.h"
+
+// 当前已经分配出去的堆内存字节数
+static size_t heapInUse()
+{
+    struct mallinfo2 info = ::mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static size_t rssBytes()
+{
+    long pages = 0;
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if (fp != nullptr)
+    {
+        if (::fscanf(fp, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        ::fclose(fp);
+    }
+    return static_cast<size_t>(pages) * ::sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    long conns = 5000;
+    long threads = 1;
+    long port = 19500;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        if (opt == "--conns")
+            conns = atol(argv[i + 1]);
+        else if (opt == "--threads")
+            threads = atol(argv[i + 1]);
+        else if (opt == "--port")
+            port = atol(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    // 尽量把fd上限调到硬限制
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+        long maxConns = static_cast<long>(rl.rlim_cur) / 2 - 64;
+        if (conns > maxConns)
+        {
+            fprintf(stderr, "fd limit %ld allows only %ld connections\n", static_cast<long>(rl.rlim_cur), maxConns);
+            conns = maxConns;
+        }
+    }
+
+    EventLoop mainLoop;
+    auto runMainLoopFor = [&mainLoop](double seconds) {
+        mainLoop.runAfter(seconds, [&mainLoop]() { mainLoop.quit(); });
+        mainLoop.loop();
+    };
+
+    std::atomic_long established(0);
+    TcpServer server(&mainLoop, InetAddress(static_cast<uint16_t>(port)), "MemoryServer");
+    server.setConnectionCallback([&established](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            ++established;
+        }
+        else
+        {
+            --established;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.setThreadNumber(static_cast<int>(threads));
+    server.start();
+    runMainLoopFor(0.1);
+
+    const size_t heapBefore = heapInUse();
+    const size_t rssBefore = rssBytes();
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // 分批建立连接，避免超过监听队列长度
+    std::vector<int> fds;
+    fds.reserve(conns);
+    while (static_cast<long>(fds.size()) < conns)
+    {
+        long batch = std::min(conns - static_cast<long>(fds.size()), 512L);
+        for (long i = 0; i < batch; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                perror("socket");
+                conns = static_cast<long>(fds.size());
+                break;
+            }
+            ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr);
+            fds.push_back(fd);
+        }
+        for (int i = 0; i < 100 && established < static_cast<long>(fds.size()); ++i)
+        {
+            runMainLoopFor(0.01);
+        }
+    }
+    for (int i = 0; i < 500 && established < conns; ++i)
+    {
+        runMainLoopFor(0.01);
+    }
+    if (established < conns)
+    {
+        fprintf(stderr, "only %ld of %ld connections established\n", established.load(), conns);
+    }
+    runMainLoopFor(0.2);
+
+    const long n = std::max(1L, established.load());
+    const double heapPerConn = static_cast<double>(heapInUse() - heapBefore) / n;
+    const double rssPerConn = static_cast<double>(rssBytes() - rssBefore) / n;
+    printf("{\"conns\":%ld,\"sizeof_tcpconnection\":%zu,\"heap_bytes_per_conn\":%.0f,\"rss_bytes_per_conn\":%.0f,"
+           "\"heap_mb_at_1m\":%.0f}\n",
+           n, sizeof(TcpConnection), heapPerConn, rssPerConn, heapPerConn * 1000000 / (1024 * 1024));
+    fflush(stdout);
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    for (int i = 0; i < 500 && established > 0; ++i)
+    {
+        runMainLoopFor(0.01);
+    }
+    return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * HTTP/1.1吞吐和延迟基准测试 客户端相当于进程内的wrk
+ * 同一个进程内启动HttpServer和若干keep-alive客户端连接，全部通过127.0.0.1通信
+ * 每个连接同时有depth个GET请求在途(depth>1即流水线)，收到一个完整应答后立即补发一个请求
+ * 服务端对每个请求返回一个固定的text/plain正文，和TechEmpower plaintext测试相同
+ *
+ * 每组参数先预热再计时，结果每组一行JSON输出到stdout，例如
+ * {"conns":100,"depth":16,"body_size":13,"server_threads":1,"client_threads":1,"seconds":3.00,
+ *  "requests":..,"requests_per_sec":..,"p50_us":..,"p99_us":..,"p999_us":..,"errors":0}
+ *
+ * 用法: http_bench [--conns 1,100,1000] [--depth 1,16] [--body-size 13] [--threads 1]
+ *                  [--client-threads N] [--seconds 3] [--warmup 1] [--port 19100]
+ *                  [--target ip:port]
+ * 指定--target时不启动进程内的服务端，直接压测已经运行的服务器(例如examples/httpserver)，
+ * 也可以用wrk压测同一个服务器来对照: wrk -t1 -c100 -d10s --latency http://127.0.0.1:8080/
+ */
+#include <strings.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "HttpServer.h"
+#include "TcpClient.h"
+
+struct Config
+{
+    long conns;
+    long depth;
+    long bodySize;
+    long serverThreads;
+    long clientThreads;
+};
+
+// 一个keep-alive客户端连接 所有成员只在所属的loop线程中访问
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &addr, const std::string &name,
+            const std::string *request, int depth, std::atomic_int *connected)
+        : client_(loop, addr, name),
+          request_(request),
+          depth_(depth),
+          connected_(connected),
+          measuring_(false),
+          requests_(0),
+          errors_(0)
+    {
+        client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&Session::onMessage, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // 在所属的loop线程中析构，连接可能比Session活得久，先把绑定了this的回调替换掉
+    ~Session()
+    {
+        if (conn_)
+        {
+            conn_->setConnectionCallback(ConnectionCallback());
+            conn_->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+
+    void connect() { client_.connect(); }
+    EventLoop *loop() const { return client_.getLoop(); }
+
+    void startMeasuring()
+    {
+        measuring_ = true;
+        requests_ = 0;
+        errors_ = 0;
+        latencies_.clear();
+    }
+    void stopMeasuring() { measuring_ = false; }
+
+    int64_t requests() const { return requests_; }
+    int64_t errors() const { return errors_; }
+    const std::vector<int64_t> &latencies() const { return latencies_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            conn_ = conn;
+            ++*connected_;
+            // 流水线的请求一次发出，和wrk的pipeline脚本一样
+            std::string batch;
+            for (int i = 0; i < depth_; ++i)
+            {
+                batch += *request_;
+                sendTimes_.push_back(Timestamp::monotonicNanoSeconds());
+            }
+            conn_->send(batch);
+        }
+        else
+        {
+            conn_.reset();
+        }
+    }
+
+    // 只解析状态行和Content-Length，足够切分应答
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while (true)
+        {
+            const char *begin = buf->peek();
+            const char *headerEnd = static_cast<const char *>(memmem(begin, buf->readableBytes(), "\r\n\r\n", 4));
+            if (headerEnd == nullptr)
+            {
+                break;
+            }
+            size_t bodyLen = 0;
+            for (const char *line = begin; line < headerEnd;)
+            {
+                const char *eol = buf->findCRLF(line);
+                static const char kLength[] = "Content-Length:";
+                if (static_cast<size_t>(eol - line) > sizeof kLength - 1 &&
+                    strncasecmp(line, kLength, sizeof kLength - 1) == 0)
+                {
+                    bodyLen = strtoul(line + sizeof kLength - 1, nullptr, 10);
+                }
+                line = eol + 2;
+            }
+            size_t total = headerEnd + 4 - begin + bodyLen;
+            if (buf->readableBytes() < total)
+            {
+                break;
+            }
+            bool ok = buf->readableBytes() > 12 && memcmp(begin + 9, "200", 3) == 0;
+            buf->retrieve(total);
+
+            int64_t now = Timestamp::monotonicNanoSeconds();
+            if (measuring_)
+            {
+                ++requests_;
+                errors_ += ok ? 0 : 1;
+                latencies_.push_back(now - sendTimes_.front());
+            }
+            sendTimes_.pop_front();
+            sendTimes_.push_back(now);
+            conn->send(*request_);
+        }
+    }
+
+    TcpClient client_;
+    TcpConnectionPtr conn_;
+    const std::string *request_;
+    const int depth_;
+    std::atomic_int *connected_;
+
+    std::deque<int64_t> sendTimes_;  // 在途请求的发送时间
+    bool measuring_;
+    int64_t requests_;
+    int64_t errors_;
+    std::vector<int64_t> latencies_;  // 纳秒
+};
+
+static double gSeconds = 3.0;
+static double gWarmup = 1.0;
+
+static void runOne(EventLoop *mainLoop, const Config &config, const InetAddress &addr, bool external)
+{
+    const std::string body(config.bodySize, 'x');
+    const std::string request = "GET / HTTP/1.1\r\nHost: " + addr.toIpPort() + "\r\nAccept: */*\r\n\r\n";
+
+    std::unique_ptr<HttpServer> server;
+    if (!external)
+    {
+        server.reset(new HttpServer(mainLoop, addr, "HttpBenchServer"));
+        server->setHttpCallback([&body](const HttpRequest &, HttpResponse *resp) {
+            resp->setContentType("text/plain");
+            resp->setBody(body);
+        });
+        server->setThreadNumber(static_cast<int>(config.serverThreads));
+        server->start();
+    }
+
+    // 客户端使用独立的loop线程，不和服务端共享
+    EventLoopThreadPool clientPool(mainLoop, "HttpBenchClient");
+    clientPool.setThreadNum(static_cast<int>(config.clientThreads));
+    clientPool.start();
+
+    std::atomic_int connected(0);
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (long i = 0; i < config.conns; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof name, "http%ld", i);
+        sessions.push_back(std::unique_ptr<Session>(new Session(clientPool.getNextLoop(), addr, name, &request,
+                                                                static_cast<int>(config.depth), &connected)));
+        sessions.back()->connect();
+    }
+
+    // 主线程运行着服务端的acceptor，需要在等待期间驱动mainLoop
+    auto runMainLoopFor = [mainLoop](double seconds) {
+        mainLoop->runAfter(seconds, [mainLoop]() { mainLoop->quit(); });
+        mainLoop->loop();
+    };
+    for (int i = 0; i < 600 && connected < config.conns; ++i)
+    {
+        runMainLoopFor(0.05);
+    }
+    if (connected < config.conns)
+    {
+        fprintf(stderr, "only %d of %ld connections established\n", connected.load(), config.conns);
+    }
+
+    runMainLoopFor(gWarmup);
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        s->loop()->runInLoop([s]() { s->startMeasuring(); });
+    }
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    runMainLoopFor(gSeconds);
+
+    std::vector<int64_t> latencies;
+    int64_t requests = 0;
+    int64_t errors = 0;
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&, s]() {
+            s->stopMeasuring();
+            requests += s->requests();
+            errors += s->errors();
+            latencies.insert(latencies.end(), s->latencies().begin(), s->latencies().end());
+        });
+    }
+    double elapsed = (Timestamp::monotonicNanoSeconds() - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("{\"conns\":%ld,\"depth\":%ld,\"body_size\":%ld,\"server_threads\":%ld,\"client_threads\":%ld,"
+           "\"seconds\":%.2f,\"requests\":%ld,\"requests_per_sec\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"errors\":%ld}\n",
+           config.conns, config.depth, config.bodySize, external ? 0L : config.serverThreads,
+           config.clientThreads, elapsed, static_cast<long>(requests), requests / elapsed,
+           percentile(latencies, 0.50) / 1e3, percentile(latencies, 0.99) / 1e3,
+           percentile(latencies, 0.999) / 1e3, static_cast<long>(errors));
+    fflush(stdout);
+
+    // 先在客户端loop中关闭所有连接，再销毁客户端loop线程
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&session]() { session.reset(); });
+    }
+    runMainLoopFor(0.1);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    std::vector<long> conns = {1, 100, 1000};
+    std::vector<long> depths = {1, 16};
+    std::vector<long> threads = {1};
+    long bodySize = 13;
+    long clientThreads = 0;
+    long port = 19100;
+    std::string target;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        const char *value = argv[i + 1];
+        if (opt == "--conns")
+            conns = parseList(value);
+        else if (opt == "--depth")
+            depths = parseList(value);
+        else if (opt == "--body-size")
+            bodySize = atol(value);
+        else if (opt == "--threads")
+            threads = parseList(value);
+        else if (opt == "--client-threads")
+            clientThreads = atol(value);
+        else if (opt == "--seconds")
+            gSeconds = atof(value);
+        else if (opt == "--warmup")
+            gWarmup = atof(value);
+        else if (opt == "--port")
+            port = atol(value);
+        else if (opt == "--target")
+            target = value;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<Config> configs;
+    for (long t : threads)
+    {
+        for (long c : conns)
+        {
+            for (long d : depths)
+            {
+                long ct = clientThreads > 0 ? clientThreads : std::max(1L, t);
+                configs.push_back(Config{c, d, bodySize, t, ct});
+            }
+        }
+    }
+
+    EventLoop mainLoop;
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+        if (!target.empty())
+        {
+            size_t colon = target.rfind(':');
+            InetAddress addr(static_cast<uint16_t>(atoi(target.c_str() + colon + 1)), target.substr(0, colon));
+            runOne(&mainLoop, configs[i], addr, true);
+        }
+        else
+        {
+            // 每组参数使用新的端口，避免上一组残留的连接影响
+            runOne(&mainLoop, configs[i], InetAddress(static_cast<uint16_t>(port + i)), false);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,363 @@
+/**
+ * RESP键值服务器的吞吐和延迟基准测试 客户端相当于进程内的redis-benchmark
+ * 压测已经运行的服务器，例如examples/kvserver(默认地址)，也可以对照压测redis本身
+ * 每个连接同时有depth个命令在途(depth>1即流水线)，收到一个应答后补发一个命令，
+ * 同一次onMessage中补发的命令合并成一次send
+ * 命令是随机key上的GET/SET，SET的比例由--set-ratio指定；计时之前每个连接先SET自己负责的一段key，
+ * 保证GET都能命中
+ *
+ * 对kvserver来说，大部分key不属于连接所在loop的分片，这个测试同时衡量了跨loop投递命令的开销
+ * 和Buffer解析流水线命令的吞吐
+ *
+ * 结果每组一行JSON输出到stdout，例如
+ * {"conns":50,"depth":16,"keys":100000,"value_size":32,"set_ratio":0.10,"client_threads":1,
+ *  "seconds":3.00,"requests":..,"requests_per_sec":..,"p50_us":..,"p99_us":..,"p999_us":..,"errors":0}
+ *
+ * 用法: kv_bench [--target 127.0.0.1:6379] [--conns 1,50] [--depth 1,16] [--keys 100000]
+ *                [--value-size 32] [--set-ratio 0.1] [--client-threads 1] [--seconds 3] [--warmup 1]
+ * 对照: redis-benchmark -p 6379 -t get,set -c 50 -P 16 -r 100000 -d 32 -n 1000000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "TcpClient.h"
+
+struct Config
+{
+    long conns;
+    long depth;
+    long keys;
+    long valueSize;
+    double setRatio;
+    long clientThreads;
+};
+
+// 一个客户端连接 所有成员只在所属的loop线程中访问
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &addr, const std::string &name, const Config &config,
+            long prefillBegin, long prefillEnd, std::atomic_int *connected, std::atomic_int *prefilled)
+        : client_(loop, addr, name),
+          config_(config),
+          value_(config.valueSize, 'x'),
+          nextPrefill_(prefillBegin),
+          prefillEnd_(prefillEnd),
+          prefillPending_(0),
+          connected_(connected),
+          prefilled_(prefilled),
+          seed_(static_cast<uint64_t>(prefillBegin) * 2654435761ULL + 1),
+          measuring_(false),
+          requests_(0),
+          errors_(0)
+    {
+        client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&Session::onMessage, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // 在所属的loop线程中析构，连接可能比Session活得久，先把绑定了this的回调替换掉
+    ~Session()
+    {
+        if (conn_)
+        {
+            conn_->setConnectionCallback(ConnectionCallback());
+            conn_->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+
+    void connect() { client_.connect(); }
+    EventLoop *loop() const { return client_.getLoop(); }
+
+    void startMeasuring()
+    {
+        measuring_ = true;
+        requests_ = 0;
+        errors_ = 0;
+        latencies_.clear();
+    }
+    void stopMeasuring() { measuring_ = false; }
+
+    int64_t requests() const { return requests_; }
+    int64_t errors() const { return errors_; }
+    const std::vector<int64_t> &latencies() const { return latencies_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            conn_ = conn;
+            ++*connected_;
+            if (nextPrefill_ == prefillEnd_)
+            {
+                ++*prefilled_;
+            }
+            std::string batch;
+            for (int i = 0; i < config_.depth; ++i)
+            {
+                appendCommand(&batch);
+            }
+            conn_->send(batch);
+        }
+        else
+        {
+            conn_.reset();
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        std::string batch;
+        while (true)
+        {
+            const char *eol = buf->findCRLF(buf->peek());
+            if (eol == nullptr)
+            {
+                break;
+            }
+            size_t total = eol + 2 - buf->peek();
+            if (*buf->peek() == '$')
+            {
+                long len = atol(buf->peek() + 1);
+                if (len >= 0)
+                {
+                    total += len + 2;
+                }
+            }
+            if (buf->readableBytes() < total)
+            {
+                break;
+            }
+            bool ok = *buf->peek() != '-';
+            buf->retrieve(total);
+
+            int64_t now = Timestamp::monotonicNanoSeconds();
+            if (prefillPending_ > 0)
+            {
+                // 预填充的SET不计入结果
+                if (--prefillPending_ == 0 && nextPrefill_ == prefillEnd_)
+                {
+                    ++*prefilled_;
+                }
+            }
+            else if (measuring_)
+            {
+                ++requests_;
+                errors_ += ok ? 0 : 1;
+                latencies_.push_back(now - sendTimes_.front());
+            }
+            sendTimes_.pop_front();
+            appendCommand(&batch);
+        }
+        if (!batch.empty())
+        {
+            conn->send(batch);
+        }
+    }
+
+    void appendCommand(std::string *out)
+    {
+        long key;
+        bool set;
+        if (nextPrefill_ < prefillEnd_)
+        {
+            key = nextPrefill_++;
+            set = true;
+            ++prefillPending_;
+        }
+        else
+        {
+            key = static_cast<long>(nextRandom() % static_cast<uint64_t>(config_.keys));
+            set = (nextRandom() % 10000) < static_cast<uint64_t>(config_.setRatio * 10000);
+        }
+        char buf[64];
+        int keyLen = snprintf(buf, sizeof buf, "key:%012ld", key);
+        char header[96];
+        int n;
+        if (set)
+        {
+            n = snprintf(header, sizeof header, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%zu\r\n", keyLen, buf,
+                         value_.size());
+            out->append(header, n);
+            out->append(value_);
+            out->append("\r\n", 2);
+        }
+        else
+        {
+            n = snprintf(header, sizeof header, "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", keyLen, buf);
+            out->append(header, n);
+        }
+        sendTimes_.push_back(Timestamp::monotonicNanoSeconds());
+    }
+
+    // xorshift64
+    uint64_t nextRandom()
+    {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 7;
+        seed_ ^= seed_ << 17;
+        return seed_;
+    }
+
+    TcpClient client_;
+    TcpConnectionPtr conn_;
+    const Config config_;
+    const std::string value_;
+    long nextPrefill_;
+    const long prefillEnd_;
+    long prefillPending_;  // 已经发出还没有收到应答的预填充命令
+    std::atomic_int *connected_;
+    std::atomic_int *prefilled_;
+    uint64_t seed_;
+
+    std::deque<int64_t> sendTimes_;  // 在途命令的发送时间
+    bool measuring_;
+    int64_t requests_;
+    int64_t errors_;
+    std::vector<int64_t> latencies_;  // 纳秒
+};
+
+static double gSeconds = 3.0;
+static double gWarmup = 1.0;
+
+static void runOne(EventLoop *mainLoop, const Config &config, const InetAddress &addr)
+{
+    EventLoopThreadPool clientPool(mainLoop, "KvBenchClient");
+    clientPool.setThreadNum(static_cast<int>(config.clientThreads));
+    clientPool.start();
+
+    std::atomic_int connected(0);
+    std::atomic_int prefilled(0);
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (long i = 0; i < config.conns; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof name, "kv%ld", i);
+        long begin = config.keys * i / config.conns;
+        long end = config.keys * (i + 1) / config.conns;
+        sessions.push_back(std::unique_ptr<Session>(new Session(clientPool.getNextLoop(), addr, name, config,
+                                                                begin, end, &connected, &prefilled)));
+        sessions.back()->connect();
+    }
+
+    auto runMainLoopFor = [mainLoop](double seconds) {
+        mainLoop->runAfter(seconds, [mainLoop]() { mainLoop->quit(); });
+        mainLoop->loop();
+    };
+    for (int i = 0; i < 1200 && prefilled < config.conns; ++i)
+    {
+        runMainLoopFor(0.05);
+    }
+    if (prefilled < config.conns)
+    {
+        fprintf(stderr, "only %d of %ld connections established and prefilled\n", prefilled.load(), config.conns);
+    }
+
+    runMainLoopFor(gWarmup);
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        s->loop()->runInLoop([s]() { s->startMeasuring(); });
+    }
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    runMainLoopFor(gSeconds);
+
+    std::vector<int64_t> latencies;
+    int64_t requests = 0;
+    int64_t errors = 0;
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&, s]() {
+            s->stopMeasuring();
+            requests += s->requests();
+            errors += s->errors();
+            latencies.insert(latencies.end(), s->latencies().begin(), s->latencies().end());
+        });
+    }
+    double elapsed = (Timestamp::monotonicNanoSeconds() - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("{\"conns\":%ld,\"depth\":%ld,\"keys\":%ld,\"value_size\":%ld,\"set_ratio\":%.2f,"
+           "\"client_threads\":%ld,\"seconds\":%.2f,\"requests\":%ld,\"requests_per_sec\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"errors\":%ld}\n",
+           config.conns, config.depth, config.keys, config.valueSize, config.setRatio, config.clientThreads,
+           elapsed, static_cast<long>(requests), requests / elapsed, percentile(latencies, 0.50) / 1e3,
+           percentile(latencies, 0.99) / 1e3, percentile(latencies, 0.999) / 1e3, static_cast<long>(errors));
+    fflush(stdout);
+
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&session]() { session.reset(); });
+    }
+    runMainLoopFor(0.1);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    std::vector<long> conns = {1, 50};
+    std::vector<long> depths = {1, 16};
+    long keys = 100000;
+    long valueSize = 32;
+    double setRatio = 0.1;
+    long clientThreads = 1;
+    std::string target = "127.0.0.1:6379";
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        const char *value = argv[i + 1];
+        if (opt == "--conns")
+            conns = parseList(value);
+        else if (opt == "--depth")
+            depths = parseList(value);
+        else if (opt == "--keys")
+            keys = atol(value);
+        else if (opt == "--value-size")
+            valueSize = atol(value);
+        else if (opt == "--set-ratio")
+            setRatio = atof(value);
+        else if (opt == "--client-threads")
+            clientThreads = atol(value);
+        else if (opt == "--seconds")
+            gSeconds = atof(value);
+        else if (opt == "--warmup")
+            gWarmup = atof(value);
+        else if (opt == "--target")
+            target = value;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    size_t colon = target.rfind(':');
+    InetAddress addr(static_cast<uint16_t>(atoi(target.c_str() + colon + 1)), target.substr(0, colon));
+    EventLoop mainLoop;
+    for (long c : conns)
+    {
+        for (long d : depths)
+        {
+            runOne(&mainLoop, Config{c, d, std::max(1L, keys), valueSize, setRatio, clientThreads}, addr);
+        }
+    }
+    return 0;
+}
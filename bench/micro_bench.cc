@@ -0,0 +1,390 @@
+/**
+ * 热点原语的微基准测试
+ *  buffer_*        Buffer::append/retrieve/makeSpace 的典型使用方式
+ *  readfd_*        Buffer::readFd 在不同可写空间大小下从socketpair读取(包含一次write系统调用)
+ *  queueinloop_*   跨线程 EventLoop::queueInLoop 到回调执行的延迟和吞吐
+ *  channel_*       Channel::handleEvent 的分发开销，包括tie_的weak_ptr提升
+ *  poll_*          EPollPoller::poll 在N个活跃fd下的开销
+ *  ws_*            WebSocket去掩码和UTF-8校验在标量/SSE2/AVX2实现下每字节的开销
+ *
+ * 每项先执行warmup次预热，再固定迭代次数计时，重复--runs轮，输出每轮中位数和最小值，每项一行JSON
+ * 用法: micro_bench [--filter buffer] [--runs 5] [--scale 1.0]
+ * 比较优化前后的结果时请使用Release构建(cmake -DCMAKE_BUILD_TYPE=Release)
+ */
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "Buffer.h"
+#include "Channel.h"
+#include "EPollPoller.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Simd.h"
+
+static std::string gFilter;
+static int gRuns = 5;
+static double gScale = 1.0;
+
+// 阻止编译器把基准测试的结果优化掉
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * 固定迭代次数的计时
+ * op在循环中被直接调用(模板参数，可以内联)，不引入std::function的间接调用
+ * opsPerCall为每次调用op包含的操作数，结果按单个操作平均
+ */
+template <typename Op>
+static void runBench(const char *name, long iters, Op op, long opsPerCall = 1)
+{
+    if (!gFilter.empty() && std::string(name).find(gFilter) == std::string::npos)
+    {
+        return;
+    }
+    iters = std::max(1L, static_cast<long>(iters * gScale));
+
+    long warmup = std::max(1L, iters / 10);
+    for (long i = 0; i < warmup; ++i)
+    {
+        op();
+    }
+
+    std::vector<double> samples;
+    for (int run = 0; run < gRuns; ++run)
+    {
+        int64_t start = Timestamp::monotonicNanoSeconds();
+        for (long i = 0; i < iters; ++i)
+        {
+            op();
+        }
+        int64_t elapsed = Timestamp::monotonicNanoSeconds() - start;
+        samples.push_back(static_cast<double>(elapsed) / (iters * opsPerCall));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    printf("{\"bench\":\"%s\",\"iters\":%ld,\"runs\":%d,\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f}\n",
+           name, iters, gRuns, percentile(samples, 0.5), samples.front());
+    fflush(stdout);
+}
+
+static void benchBuffer()
+{
+    const std::string small(64, 'x');
+    const std::string large(16 * 1024, 'x');
+
+    {
+        Buffer buf;
+        runBench("buffer_append_retrieve_64", 5000000, [&]() {
+            buf.append(small.data(), small.size());
+            buf.retrieve(small.size());
+            doNotOptimize(buf.peek());
+        });
+    }
+    {
+        Buffer buf;
+        runBench("buffer_append_retrieve_16k", 500000, [&]() {
+            buf.append(large.data(), large.size());
+            buf.retrieve(large.size());
+            doNotOptimize(buf.peek());
+        });
+    }
+    {
+        // 连续追加16条小消息后一次取出，模拟流水线请求
+        Buffer buf;
+        runBench("buffer_append16_retrieveall_64", 500000, [&]() {
+            for (int i = 0; i < 16; ++i)
+            {
+                buf.append(small.data(), small.size());
+            }
+            doNotOptimize(buf.peek());
+            buf.retrieveAll();
+        });
+    }
+    {
+        // 保留256字节未读数据，每次append都需要makeSpace把剩余数据挪到前面
+        Buffer buf;
+        buf.append(large.data(), 768);
+        runBench("buffer_makespace_move_256", 1000000, [&]() {
+            buf.retrieve(512);
+            buf.append(large.data(), 512);
+            doNotOptimize(buf.peek());
+        });
+    }
+    {
+        // 每次新建Buffer，首次写入超过初始大小时扩容
+        runBench("buffer_new_grow_16k", 200000, [&]() {
+            Buffer buf;
+            buf.append(large.data(), large.size());
+            doNotOptimize(buf.peek());
+        });
+    }
+    {
+        Buffer buf;
+        runBench("buffer_retrieve_as_string_64", 2000000, [&]() {
+            buf.append(small.data(), small.size());
+            std::string s = buf.retrieveAllAsString();
+            doNotOptimize(s.data());
+        });
+    }
+}
+
+static void benchReadFd()
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0)
+    {
+        perror("socketpair");
+        return;
+    }
+    int sndbuf = 4 * 1024 * 1024;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+    ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof sndbuf);
+
+    const size_t sizes[] = {64, 4096, 65536};
+    const size_t writables[] = {0, 1024, 128 * 1024};  // Buffer的初始可写空间
+    std::string payload(65536, 'x');
+
+    for (size_t msg : sizes)
+    {
+        for (size_t writable : writables)
+        {
+            char name[64];
+            snprintf(name, sizeof name, "readfd_msg%zu_writable%zu", msg, writable);
+            // Buffer扩容后不会缩小，每次迭代重新构造才能保持初始可写空间不变，计时包含构造的开销
+            runBench(name, msg >= 65536 ? 20000 : 200000, [&]() {
+                ssize_t n = ::write(fds[0], payload.data(), msg);
+                doNotOptimize(n);
+                Buffer buf(writable);
+                int savedErrno = 0;
+                buf.readFd(fds[1], &savedErrno);
+                doNotOptimize(buf.peek());
+            });
+        }
+    }
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+static void benchQueueInLoop()
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+
+    // 延迟：每次投递一个回调，等待它在loop线程中执行后再投递下一个
+    if (gFilter.empty() || std::string("queueinloop_latency").find(gFilter) != std::string::npos)
+    {
+        const long iters = std::max(1L, static_cast<long>(20000 * gScale));
+        std::atomic<int64_t> executedAt(0);
+        std::vector<int64_t> latencies;
+        latencies.reserve(iters);
+        for (long i = 0; i < iters + iters / 10; ++i)
+        {
+            executedAt = 0;
+            int64_t postedAt = Timestamp::monotonicNanoSeconds();
+            loop->queueInLoop([&]() { executedAt = Timestamp::monotonicNanoSeconds(); });
+            while (executedAt == 0)
+            {
+                std::this_thread::yield();
+            }
+            if (i >= iters / 10)
+            {
+                latencies.push_back(executedAt - postedAt);
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        printf("{\"bench\":\"queueinloop_latency\",\"iters\":%ld,\"p50_ns\":%ld,\"p99_ns\":%ld,\"p999_ns\":%ld}\n",
+               iters, static_cast<long>(percentile(latencies, 0.5)), static_cast<long>(percentile(latencies, 0.99)),
+               static_cast<long>(percentile(latencies, 0.999)));
+        fflush(stdout);
+    }
+
+    // 吞吐：连续投递一批回调，等待全部执行完成，按单个回调平均
+    {
+        const long batch = 1000;
+        std::atomic<long> executed(0);
+        runBench("queueinloop_throughput_batch1000", 200, [&]() {
+            executed = 0;
+            for (long i = 0; i < batch; ++i)
+            {
+                loop->queueInLoop([&]() { ++executed; });
+            }
+            while (executed < batch)
+            {
+                std::this_thread::yield();
+            }
+        }, batch);
+    }
+}
+
+static void benchChannel()
+{
+    EventLoop loop;
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    long counter = 0;
+    Timestamp now = Timestamp::now();
+
+    {
+        Channel channel(&loop, fd);
+        channel.setReadCallback([&](Timestamp) { ++counter; });
+        channel.set_revents(EPOLLIN);
+        runBench("channel_handle_event_untied", 5000000, [&]() { channel.handleEvent(now); });
+    }
+    {
+        // TcpConnection使用的路径：每次分发都要把weak_ptr提升为shared_ptr
+        Channel channel(&loop, fd);
+        std::shared_ptr<int> owner(new int(0));
+        channel.tie(owner);
+        channel.setReadCallback([&](Timestamp) { ++counter; });
+        channel.set_revents(EPOLLIN);
+        runBench("channel_handle_event_tied", 5000000, [&]() { channel.handleEvent(now); });
+    }
+    {
+        Channel channel(&loop, fd);
+        channel.setReadCallback([&](Timestamp) { ++counter; });
+        channel.setWriteCallback([&]() { ++counter; });
+        channel.set_revents(EPOLLIN | EPOLLOUT);
+        runBench("channel_handle_event_read_write", 5000000, [&]() { channel.handleEvent(now); });
+    }
+    doNotOptimize(counter);
+    ::close(fd);
+}
+
+static void benchPoll()
+{
+    EventLoop loop;
+    const int counts[] = {1, 16, 256, 1024};
+    for (int n : counts)
+    {
+        // 计数不为0的eventfd在LT模式下一直可读，每次poll都返回n个活跃fd
+        std::vector<int> fds;
+        std::vector<std::unique_ptr<Channel>> channels;
+        EPollPoller poller(&loop);
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+            fds.push_back(fd);
+            Channel *channel = new Channel(&loop, fd);
+            channels.push_back(std::unique_ptr<Channel>(channel));
+            // enableReading会注册到loop自己的poller上，这里重置index后再注册到被测的poller
+            channel->enableReading();
+            channel->set_index(-1);
+            poller.updateChannel(channel);
+        }
+
+        char name[64];
+        snprintf(name, sizeof name, "poll_active_fds_%d", n);
+        Poller::ChannelList active;
+        active.reserve(n);
+        runBench(name, 200000 / n + 100, [&]() {
+            active.clear();
+            poller.poll(0, &active);
+            doNotOptimize(active.data());
+        });
+
+        for (auto &channel : channels)
+        {
+            poller.removeChannel(channel.get());
+            channel->set_index(1);  // 恢复为已添加到loop的poller的状态
+            channel->disableAll();
+            channel->remove();
+        }
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+    }
+}
+
+static void benchWebSocket()
+{
+    // 纯ASCII和中英文混合(大部分是3字节字符)两种文本
+    std::string ascii;
+    std::string mixed;
+    while (mixed.size() < 65536)
+    {
+        ascii.append("{\"type\":\"update\",\"price\":1234.5,\"symbol\":\"ABC\"}");
+        mixed.append("行情更新 price=1234.5 成交量");
+    }
+
+    const Simd::Level levels[] = {Simd::kScalar, Simd::kSse2, Simd::kAvx2};
+    const size_t sizes[] = {128, 16384};
+    for (Simd::Level level : levels)
+    {
+        if (Simd::setLevel(level) != level)
+        {
+            continue;  // CPU不支持
+        }
+        for (size_t size : sizes)
+        {
+            char name[64];
+            std::string payload(ascii, 0, size);
+            snprintf(name, sizeof name, "ws_mask_%s_%zu", Simd::levelName(level), size);
+            runBench(name, 20000000 / size + 100, [&]() {
+                Simd::maskBytes(&payload[0], payload.size(), 0x5a3c96e1, 1);
+                doNotOptimize(payload.data());
+            }, size);
+
+            std::string json(ascii, 0, size);
+            snprintf(name, sizeof name, "ws_utf8_ascii_%s_%zu", Simd::levelName(level), size);
+            runBench(name, 20000000 / size + 100, [&]() {
+                bool valid = Simd::isValidUtf8(json.data(), json.size());
+                doNotOptimize(valid);
+            }, size);
+
+            // 截断在字符边界上
+            std::string text(mixed, 0, size);
+            while (!text.empty() && !Simd::isValidUtf8(text.data(), text.size()))
+            {
+                text.resize(text.size() - 1);
+            }
+            snprintf(name, sizeof name, "ws_utf8_mixed_%s_%zu", Simd::levelName(level), size);
+            runBench(name, 20000000 / size + 100, [&]() {
+                bool valid = Simd::isValidUtf8(text.data(), text.size());
+                doNotOptimize(valid);
+            }, text.size());
+        }
+    }
+    Simd::setLevel(Simd::kAvx2);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        if (opt == "--filter")
+            gFilter = argv[i + 1];
+        else if (opt == "--runs")
+            gRuns = std::max(1, atoi(argv[i + 1]));
+        else if (opt == "--scale")
+            gScale = atof(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    benchBuffer();
+    benchReadFd();
+    benchQueueInLoop();
+    benchChannel();
+    benchPoll();
+    benchWebSocket();
+    return 0;
+}
@@ -0,0 +1,307 @@
+/**
+ * ping-pong / echo 吞吐和延迟基准测试
+ * 同一个进程内启动TcpServer(echo)和若干客户端连接，全部通过127.0.0.1通信
+ *
+ * pingpong: 每个连接同时只有一个消息在途，收到完整回显后立即发送下一条，测量往返延迟
+ * echo:     每个连接同时有depth个消息在途(流水线)，测量流水线下的吞吐和延迟
+ *
+ * 每组参数先预热再计时，结果每组一行JSON输出到stdout，例如
+ * {"mode":"pingpong","msg_size":1024,"conns":100,"server_threads":1,"client_threads":1,"depth":1,
+ *  "seconds":3.00,"msgs":..,"msgs_per_sec":..,"bytes_per_sec":..,"p50_us":..,"p99_us":..,"p999_us":..}
+ *
+ * 用法: pingpong_bench [--mode pingpong|echo|all] [--sizes 16,1024,65536,1048576] [--conns 1,100,1000]
+ *                      [--threads 1,4] [--client-threads N] [--depth 16] [--seconds 3] [--warmup 1] [--port 19000]
+ * 比较优化前后的结果时请使用Release构建(cmake -DCMAKE_BUILD_TYPE=Release)，并保持相同的参数
+ * 10k连接需要先调大文件描述符上限(ulimit -n)，客户端和服务端各占用一个fd
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "TcpClient.h"
+#include "TcpServer.h"
+
+struct Config
+{
+    std::string mode;
+    long msgSize;
+    long conns;
+    long serverThreads;
+    long clientThreads;
+    long depth;
+};
+
+// 一个客户端连接 所有成员只在所属的loop线程中访问
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &addr, const std::string &name,
+            const std::string *message, int depth, std::atomic_int *connected)
+        : client_(loop, addr, name),
+          message_(message),
+          depth_(depth),
+          connected_(connected),
+          received_(0),
+          measuring_(false),
+          msgs_(0)
+    {
+        client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&Session::onMessage, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // 在所属的loop线程中析构，连接可能比Session活得久，先把绑定了this的回调替换掉
+    ~Session()
+    {
+        if (conn_)
+        {
+            conn_->setConnectionCallback(ConnectionCallback());
+            conn_->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+
+    void connect() { client_.connect(); }
+    EventLoop *loop() const { return client_.getLoop(); }
+
+    // 预热结束后开始统计
+    void startMeasuring()
+    {
+        measuring_ = true;
+        msgs_ = 0;
+        latencies_.clear();
+    }
+    void stopMeasuring() { measuring_ = false; }
+
+    int64_t msgs() const { return msgs_; }
+    const std::vector<int64_t> &latencies() const { return latencies_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            conn_ = conn;
+            ++*connected_;
+            for (int i = 0; i < depth_; ++i)
+            {
+                sendOne();
+            }
+        }
+        else
+        {
+            conn_.reset();
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+    {
+        received_ += buf->readableBytes();
+        buf->retrieveAll();
+
+        const size_t msgSize = message_->size();
+        while (received_ >= msgSize)
+        {
+            received_ -= msgSize;
+            int64_t now = Timestamp::monotonicNanoSeconds();
+            if (measuring_)
+            {
+                ++msgs_;
+                latencies_.push_back(now - sendTimes_.front());
+            }
+            sendTimes_.pop_front();
+            sendOne();
+        }
+    }
+
+    void sendOne()
+    {
+        if (conn_)
+        {
+            sendTimes_.push_back(Timestamp::monotonicNanoSeconds());
+            conn_->send(*message_);
+        }
+    }
+
+    TcpClient client_;
+    TcpConnectionPtr conn_;
+    const std::string *message_;
+    const int depth_;
+    std::atomic_int *connected_;
+
+    size_t received_;                // 还没有凑满一条消息的字节数
+    std::deque<int64_t> sendTimes_;  // 在途消息的发送时间
+    bool measuring_;
+    int64_t msgs_;
+    std::vector<int64_t> latencies_;  // 纳秒
+};
+
+static double gSeconds = 3.0;
+static double gWarmup = 1.0;
+
+static void runOne(EventLoop *mainLoop, const Config &config, uint16_t port)
+{
+    const std::string message(config.msgSize, 'x');
+    const InetAddress addr(port);
+
+    TcpServer server(mainLoop, addr, "PingPongServer");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.setThreadNumber(static_cast<int>(config.serverThreads));
+    server.start();
+
+    // 客户端使用独立的loop线程，不和服务端共享
+    EventLoopThreadPool clientPool(mainLoop, "PingPongClient");
+    clientPool.setThreadNum(static_cast<int>(config.clientThreads));
+    clientPool.start();
+
+    std::atomic_int connected(0);
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (long i = 0; i < config.conns; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof name, "session%ld", i);
+        sessions.push_back(std::unique_ptr<Session>(new Session(clientPool.getNextLoop(), addr, name, &message,
+                                                                static_cast<int>(config.depth), &connected)));
+        sessions.back()->connect();
+    }
+
+    // 主线程运行着服务端的acceptor，需要在等待期间驱动mainLoop
+    auto runMainLoopFor = [mainLoop](double seconds) {
+        mainLoop->runAfter(seconds, [mainLoop]() { mainLoop->quit(); });
+        mainLoop->loop();
+    };
+    for (int i = 0; i < 600 && connected < config.conns; ++i)
+    {
+        runMainLoopFor(0.05);
+    }
+    if (connected < config.conns)
+    {
+        fprintf(stderr, "only %d of %ld connections established\n", connected.load(), config.conns);
+    }
+
+    runMainLoopFor(gWarmup);
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        s->loop()->runInLoop([s]() { s->startMeasuring(); });
+    }
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    runMainLoopFor(gSeconds);
+
+    std::vector<int64_t> latencies;
+    int64_t msgs = 0;
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&, s]() {
+            s->stopMeasuring();
+            msgs += s->msgs();
+            latencies.insert(latencies.end(), s->latencies().begin(), s->latencies().end());
+        });
+    }
+    double elapsed = (Timestamp::monotonicNanoSeconds() - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("{\"mode\":\"%s\",\"msg_size\":%ld,\"conns\":%ld,\"server_threads\":%ld,\"client_threads\":%ld,"
+           "\"depth\":%ld,\"seconds\":%.2f,\"msgs\":%ld,\"msgs_per_sec\":%.0f,\"bytes_per_sec\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+           config.mode.c_str(), config.msgSize, config.conns, config.serverThreads, config.clientThreads,
+           config.depth, elapsed, static_cast<long>(msgs), msgs / elapsed, msgs * config.msgSize / elapsed,
+           percentile(latencies, 0.50) / 1e3, percentile(latencies, 0.99) / 1e3,
+           percentile(latencies, 0.999) / 1e3);
+    fflush(stdout);
+
+    // 先在客户端loop中关闭所有连接，再销毁客户端loop线程
+    for (auto &session : sessions)
+    {
+        Session *s = session.get();
+        runInLoopAndWait(s->loop(), [&session]() { session.reset(); });
+    }
+    runMainLoopFor(0.1);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    std::string mode = "all";
+    std::vector<long> sizes = {16, 1024, 64 * 1024, 1024 * 1024};
+    std::vector<long> conns = {1, 100, 1000};
+    std::vector<long> threads = {1};
+    long clientThreads = 0;
+    long depth = 16;
+    long port = 19000;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        const char *value = argv[i + 1];
+        if (opt == "--mode")
+            mode = value;
+        else if (opt == "--sizes")
+            sizes = parseList(value);
+        else if (opt == "--conns")
+            conns = parseList(value);
+        else if (opt == "--threads")
+            threads = parseList(value);
+        else if (opt == "--client-threads")
+            clientThreads = atol(value);
+        else if (opt == "--depth")
+            depth = atol(value);
+        else if (opt == "--seconds")
+            gSeconds = atof(value);
+        else if (opt == "--warmup")
+            gWarmup = atof(value);
+        else if (opt == "--port")
+            port = atol(value);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<Config> configs;
+    for (long t : threads)
+    {
+        for (long c : conns)
+        {
+            for (long s : sizes)
+            {
+                long ct = clientThreads > 0 ? clientThreads : std::max(1L, t);
+                if (mode == "pingpong" || mode == "all")
+                {
+                    configs.push_back(Config{"pingpong", s, c, t, ct, 1});
+                }
+                if (mode == "echo" || mode == "all")
+                {
+                    configs.push_back(Config{"echo", s, c, t, ct, depth});
+                }
+            }
+        }
+    }
+
+    EventLoop mainLoop;
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+        // 每组参数使用新的端口，避免上一组残留的连接影响
+        runOne(&mainLoop, configs[i], static_cast<uint16_t>(port + i));
+    }
+    return 0;
+}
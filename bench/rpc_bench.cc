@@ -0,0 +1,262 @@
+/**
+ * 多路复用RPC的吞吐和延迟基准测试
+ * 同一个进程内启动RpcServer(一个echo方法)和若干RpcClient，全部通过127.0.0.1通信
+ * 每个连接同时有depth个调用在途，一个调用结束后在回调里立即发起下一个；depth=1就是严格串行的调用，
+ * 和depth>1对比可以看出在一个连接上复用多个在途调用、按批合并write带来的差别
+ *
+ * 每组参数先预热再计时，结果每组一行JSON输出到stdout，例如
+ * {"conns":10,"depth":64,"payload":64,"server_threads":1,"client_threads":1,"seconds":3.00,
+ *  "calls":..,"calls_per_sec":..,"p50_us":..,"p99_us":..,"p999_us":..,"errors":0}
+ *
+ * 用法: rpc_bench [--conns 1,10] [--depth 1,16,128] [--payload 64] [--threads 1]
+ *                 [--client-threads N] [--timeout 0] [--seconds 3] [--warmup 1] [--port 19200]
+ * --timeout大于0时每个调用都带期限(秒)，可以看出超时检查的开销
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchCommon.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "RpcClient.h"
+#include "RpcServer.h"
+
+struct Config
+{
+    long conns;
+    long depth;
+    long payload;
+    long serverThreads;
+    long clientThreads;
+};
+
+// 一个客户端连接 所有成员只在所属的loop线程中访问
+class Caller : noncopyable
+{
+public:
+    Caller(EventLoop *loop, const InetAddress &addr, const std::string &name,
+           const std::string *payload, int depth, double timeout, std::atomic_int *connected)
+        : client_(loop, addr, name),
+          payload_(payload),
+          depth_(depth),
+          timeout_(timeout),
+          connected_(connected),
+          running_(true),
+          measuring_(false),
+          calls_(0),
+          errors_(0)
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                ++*connected_;
+                for (int i = 0; i < depth_; ++i)
+                {
+                    issue();
+                }
+            }
+        });
+    }
+
+    void connect() { client_.connect(); }
+    EventLoop *loop() const { return client_.getLoop(); }
+
+    void startMeasuring()
+    {
+        measuring_ = true;
+        calls_ = 0;
+        errors_ = 0;
+        latencies_.clear();
+    }
+    // 不再发起新的调用，之后可以在loop线程中析构
+    void stop()
+    {
+        measuring_ = false;
+        running_ = false;
+    }
+
+    int64_t calls() const { return calls_; }
+    int64_t errors() const { return errors_; }
+    const std::vector<int64_t> &latencies() const { return latencies_; }
+
+private:
+    void issue()
+    {
+        int64_t start = Timestamp::monotonicNanoSeconds();
+        client_.call("echo", *payload_, timeout_, [this, start](RpcStatus status, const StringPiece &response) {
+            if (measuring_)
+            {
+                ++calls_;
+                errors_ += status == kRpcOk && response.size() == payload_->size() ? 0 : 1;
+                latencies_.push_back(Timestamp::monotonicNanoSeconds() - start);
+            }
+            if (running_)
+            {
+                issue();
+            }
+        });
+    }
+
+    RpcClient client_;
+    const std::string *payload_;
+    const int depth_;
+    const double timeout_;
+    std::atomic_int *connected_;
+
+    bool running_;
+    bool measuring_;
+    int64_t calls_;
+    int64_t errors_;
+    std::vector<int64_t> latencies_;  // 纳秒
+};
+
+static double gSeconds = 3.0;
+static double gWarmup = 1.0;
+static double gTimeout = 0;
+
+static void runOne(EventLoop *mainLoop, const Config &config, const InetAddress &addr)
+{
+    const std::string payload(config.payload, 'x');
+
+    RpcServer server(mainLoop, addr, "RpcBenchServer");
+    server.registerMethod("echo", [](const StringPiece &request, const RpcResponder &responder) {
+        responder.reply(request);
+    });
+    server.setThreadNumber(static_cast<int>(config.serverThreads));
+    server.start();
+
+    // 客户端使用独立的loop线程，不和服务端共享
+    EventLoopThreadPool clientPool(mainLoop, "RpcBenchClient");
+    clientPool.setThreadNum(static_cast<int>(config.clientThreads));
+    clientPool.start();
+
+    std::atomic_int connected(0);
+    std::vector<std::unique_ptr<Caller>> callers;
+    for (long i = 0; i < config.conns; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof name, "rpc%ld", i);
+        callers.push_back(std::unique_ptr<Caller>(new Caller(clientPool.getNextLoop(), addr, name, &payload,
+                                                             static_cast<int>(config.depth), gTimeout,
+                                                             &connected)));
+        callers.back()->connect();
+    }
+
+    // 主线程运行着服务端的acceptor，需要在等待期间驱动mainLoop
+    auto runMainLoopFor = [mainLoop](double seconds) {
+        mainLoop->runAfter(seconds, [mainLoop]() { mainLoop->quit(); });
+        mainLoop->loop();
+    };
+    for (int i = 0; i < 600 && connected < config.conns; ++i)
+    {
+        runMainLoopFor(0.05);
+    }
+    if (connected < config.conns)
+    {
+        fprintf(stderr, "only %d of %ld connections established\n", connected.load(), config.conns);
+    }
+
+    runMainLoopFor(gWarmup);
+    for (auto &caller : callers)
+    {
+        Caller *c = caller.get();
+        c->loop()->runInLoop([c]() { c->startMeasuring(); });
+    }
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    runMainLoopFor(gSeconds);
+
+    std::vector<int64_t> latencies;
+    int64_t calls = 0;
+    int64_t errors = 0;
+    for (auto &caller : callers)
+    {
+        Caller *c = caller.get();
+        runInLoopAndWait(c->loop(), [&, c]() {
+            c->stop();
+            calls += c->calls();
+            errors += c->errors();
+            latencies.insert(latencies.end(), c->latencies().begin(), c->latencies().end());
+        });
+    }
+    double elapsed = (Timestamp::monotonicNanoSeconds() - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("{\"conns\":%ld,\"depth\":%ld,\"payload\":%ld,\"server_threads\":%ld,\"client_threads\":%ld,"
+           "\"seconds\":%.2f,\"calls\":%ld,\"calls_per_sec\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"errors\":%ld}\n",
+           config.conns, config.depth, config.payload, config.serverThreads, config.clientThreads, elapsed,
+           static_cast<long>(calls), calls / elapsed, percentile(latencies, 0.50) / 1e3,
+           percentile(latencies, 0.99) / 1e3, percentile(latencies, 0.999) / 1e3, static_cast<long>(errors));
+    fflush(stdout);
+
+    // 先在客户端loop中关闭所有连接，再销毁客户端loop线程
+    for (auto &caller : callers)
+    {
+        Caller *c = caller.get();
+        runInLoopAndWait(c->loop(), [&caller]() { caller.reset(); });
+    }
+    runMainLoopFor(0.1);
+}
+
+int main(int argc, char *argv[])
+{
+    benchQuietLogging();
+
+    std::vector<long> conns = {1, 10};
+    std::vector<long> depths = {1, 16, 128};
+    std::vector<long> threads = {1};
+    long payload = 64;
+    long clientThreads = 0;
+    long port = 19200;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        const char *value = argv[i + 1];
+        if (opt == "--conns")
+            conns = parseList(value);
+        else if (opt == "--depth")
+            depths = parseList(value);
+        else if (opt == "--payload")
+            payload = atol(value);
+        else if (opt == "--threads")
+            threads = parseList(value);
+        else if (opt == "--client-threads")
+            clientThreads = atol(value);
+        else if (opt == "--timeout")
+            gTimeout = atof(value);
+        else if (opt == "--seconds")
+            gSeconds = atof(value);
+        else if (opt == "--warmup")
+            gWarmup = atof(value);
+        else if (opt == "--port")
+            port = atol(value);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", opt.c_str());
+            return 1;
+        }
+    }
+
+    EventLoop mainLoop;
+    long index = 0;
+    for (long t : threads)
+    {
+        for (long c : conns)
+        {
+            for (long d : depths)
+            {
+                long ct = clientThreads > 0 ? clientThreads : std::max(1L, t);
+                // 每组参数使用新的端口，避免上一组残留的连接影响
+                runOne(&mainLoop, Config{c, d, payload, t, ct}, InetAddress(static_cast<uint16_t>(port + index++)));
+            }
+        }
+    }
+    return 0;
+}
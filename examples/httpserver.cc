@@ -0,0 +1,37 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/HttpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <string>
+
+// HTTP服务器 /返回固定的文本，/echo把请求正文原样返回，其他路径返回404
+// 可以用wrk压测: wrk -t1 -c100 -d10s --latency http://127.0.0.1:8080/
+int main()
+{
+    Logger::setLogLevel(ERROR);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(8080, "0.0.0.0"), "HttpServer-01");
+
+    server.setHttpCallback([](const HttpRequest &req, HttpResponse *resp) {
+        // req中的字段都指向连接的输入缓冲区，只在回调期间有效
+        if (req.path() == "/")
+        {
+            resp->setContentType("text/plain");
+            resp->setBody("Hello, World!");
+        }
+        else if (req.path() == "/echo")
+        {
+            resp->setContentType("application/octet-stream");
+            resp->appendBody(req.body().data(), req.body().size());
+        }
+        else
+        {
+            resp->setStatusCode(HttpResponse::k404NotFound);
+        }
+    });
+    server.setThreadNumber(3);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,875 @@
+#include <mymuduo/Buffer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/StringPiece.h>
+#include <mymuduo/TcpServer.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * 分片的内存键值服务器 兼容Redis的RESP协议(也接受redis-cli风格的inline命令)，
+ * 可以直接用redis-cli、redis-benchmark或者bench/kv_bench访问
+ *
+ * share-nothing: 每个subloop拥有一个分片，分片只在自己的loop线程中访问，不加锁
+ * key按哈希值的高32位分配到分片；连接所在loop的分片直接执行，其他分片的命令在一次onMessage中
+ * 按目标分片攒成批次，每个批次通过目标loop的任务队列投递一次，执行完带着全部应答投递回来一次
+ * 应答按命令的序号排好后直接写入输出缓冲区，流水线的客户端收到的顺序和发送的顺序一致
+ *
+ * 每个分片是一个线性探测的开放寻址哈希表，条目(key+value)从分片自己的内存池中按尺寸分级分配
+ * 支持的命令: PING ECHO GET SET DEL EXISTS INCR QUIT COMMAND
+ * 多个key的命令需要跨分片汇总，这里不支持；也没有过期和淘汰
+ *
+ * 用法: kvserver [threads=3] [port=6379]
+ */
+
+static const size_t kMaxBulkLength = 64 * 1024 * 1024;  // 单个参数的最大长度
+static const size_t kMaxArgs = 1024 * 1024;
+static const size_t kMaxInlineLength = 64 * 1024;
+
+// FNV-1a 再用murmur3的fmix64打散，低位用于哈希表，高位用于选择分片
+static uint64_t hashKey(const char *data, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * 分片独占的内存池 尺寸按1.25倍分级，每级一个空闲链表，内存从1MB的大块中顺序切分
+ * 只在分片所属的loop线程中使用，不需要加锁；超过最大级别的请求直接malloc
+ */
+class Arena : noncopyable
+{
+public:
+    static const uint8_t kLargeClass = 0xff;
+
+    Arena() : current_(nullptr), remaining_(0), chunkBytes_(0)
+    {
+        size_t size = kMinClassSize;
+        while (size < kMaxClassSize)
+        {
+            classSizes_.push_back(size);
+            size = (size * 5 / 4 + 7) & ~static_cast<size_t>(7);
+        }
+        classSizes_.push_back(static_cast<size_t>(kMaxClassSize));
+        freeLists_.resize(classSizes_.size(), nullptr);
+    }
+
+    ~Arena()
+    {
+        for (char *chunk : chunks_)
+        {
+            free(chunk);
+        }
+    }
+
+    // 返回至少size字节的内存 *sizeClass记录尺寸级别，释放时原样传回
+    void *allocate(size_t size, uint8_t *sizeClass)
+    {
+        if (size > kMaxClassSize)
+        {
+            *sizeClass = kLargeClass;
+            return malloc(size);
+        }
+        size_t cls = std::lower_bound(classSizes_.begin(), classSizes_.end(), size) - classSizes_.begin();
+        *sizeClass = static_cast<uint8_t>(cls);
+        if (freeLists_[cls] != nullptr)
+        {
+            FreeNode *node = freeLists_[cls];
+            freeLists_[cls] = node->next;
+            return node;
+        }
+        size_t classSize = classSizes_[cls];
+        if (remaining_ < classSize)
+        {
+            // 上一个大块剩下的尾巴不再使用
+            current_ = static_cast<char *>(malloc(kChunkSize));
+            chunks_.push_back(current_);
+            remaining_ = kChunkSize;
+            chunkBytes_ += kChunkSize;
+        }
+        void *p = current_;
+        current_ += classSize;
+        remaining_ -= classSize;
+        return p;
+    }
+
+    void deallocate(void *p, uint8_t sizeClass)
+    {
+        if (sizeClass == kLargeClass)
+        {
+            free(p);
+            return;
+        }
+        FreeNode *node = static_cast<FreeNode *>(p);
+        node->next = freeLists_[sizeClass];
+        freeLists_[sizeClass] = node;
+    }
+
+    // 某个级别实际可用的字节数 大条目返回0，不能原地扩展
+    size_t classSize(uint8_t sizeClass) const
+    {
+        return sizeClass == kLargeClass ? 0 : classSizes_[sizeClass];
+    }
+
+    size_t chunkBytes() const { return chunkBytes_; }
+
+private:
+    static const size_t kChunkSize = 1024 * 1024;
+    static const size_t kMinClassSize = 32;
+    static const size_t kMaxClassSize = kChunkSize / 4;
+
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    std::vector<size_t> classSizes_;
+    std::vector<FreeNode *> freeLists_;
+    std::vector<char *> chunks_;
+    char *current_;
+    size_t remaining_;
+    size_t chunkBytes_;
+};
+
+// 一个键值对 紧跟在头部后面依次存放key和value
+struct Item
+{
+    uint32_t keyLength;
+    uint32_t valueLength;
+    uint8_t sizeClass;
+
+    char *key() { return reinterpret_cast<char *>(this + 1); }
+    const char *key() const { return reinterpret_cast<const char *>(this + 1); }
+    char *value() { return key() + keyLength; }
+    const char *value() const { return key() + keyLength; }
+};
+
+/**
+ * 线性探测的开放寻址哈希表 槽位里保存完整的哈希值，探测和扩容时不需要访问条目
+ * 删除时把后面的条目向前移动(backward shift)，不使用墓碑，探测链始终紧凑
+ */
+class KvTable : noncopyable
+{
+public:
+    KvTable() : slots_(kInitialSlots), mask_(kInitialSlots - 1), size_(0) {}
+
+    ~KvTable()
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.item != nullptr)
+            {
+                arena_.deallocate(slot.item, slot.item->sizeClass);
+            }
+        }
+    }
+
+    const Item *find(uint64_t hash, const StringPiece &key) const
+    {
+        return slots_[probe(hash, key)].item;
+    }
+
+    void set(uint64_t hash, const StringPiece &key, const StringPiece &value)
+    {
+        // 装载因子保持在3/4以下
+        if ((size_ + 1) * 4 > slots_.size() * 3)
+        {
+            grow();
+        }
+        Slot &slot = slots_[probe(hash, key)];
+        Item *item = slot.item;
+        if (item != nullptr && sizeof(Item) + key.size() + value.size() <= arena_.classSize(item->sizeClass))
+        {
+            // 新值放得下就原地覆盖
+            memcpy(item->value(), value.data(), value.size());
+            item->valueLength = static_cast<uint32_t>(value.size());
+            return;
+        }
+        if (item != nullptr)
+        {
+            arena_.deallocate(item, item->sizeClass);
+        }
+        else
+        {
+            ++size_;
+        }
+        uint8_t sizeClass;
+        item = static_cast<Item *>(arena_.allocate(sizeof(Item) + key.size() + value.size(), &sizeClass));
+        item->keyLength = static_cast<uint32_t>(key.size());
+        item->valueLength = static_cast<uint32_t>(value.size());
+        item->sizeClass = sizeClass;
+        memcpy(item->key(), key.data(), key.size());
+        memcpy(item->value(), value.data(), value.size());
+        slot.hash = hash;
+        slot.item = item;
+    }
+
+    bool erase(uint64_t hash, const StringPiece &key)
+    {
+        size_t i = probe(hash, key);
+        if (slots_[i].item == nullptr)
+        {
+            return false;
+        }
+        arena_.deallocate(slots_[i].item, slots_[i].item->sizeClass);
+        --size_;
+        // 把后面探测链上的条目移到空出来的位置，直到遇到空槽
+        size_t j = i;
+        while (true)
+        {
+            j = (j + 1) & mask_;
+            if (slots_[j].item == nullptr)
+            {
+                break;
+            }
+            size_t home = slots_[j].hash & mask_;
+            // home不在(i, j]区间(考虑回绕)时，j上的条目可以移到i
+            bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+            if (movable)
+            {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i].item = nullptr;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+    size_t memoryBytes() const { return arena_.chunkBytes() + slots_.size() * sizeof(Slot); }
+
+private:
+    static const size_t kInitialSlots = 1024;
+
+    struct Slot
+    {
+        uint64_t hash;
+        Item *item;  // nullptr表示空槽
+    };
+
+    // 返回key所在的槽位，不存在时返回探测链末尾的空槽
+    size_t probe(uint64_t hash, const StringPiece &key) const
+    {
+        size_t i = hash & mask_;
+        while (true)
+        {
+            const Item *item = slots_[i].item;
+            if (item == nullptr ||
+                (slots_[i].hash == hash && item->keyLength == key.size() &&
+                 memcmp(item->key(), key.data(), key.size()) == 0))
+            {
+                return i;
+            }
+            i = (i + 1) & mask_;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        mask_ = slots_.size() - 1;
+        for (const Slot &slot : old)
+        {
+            if (slot.item != nullptr)
+            {
+                size_t i = slot.hash & mask_;
+                while (slots_[i].item != nullptr)
+                {
+                    i = (i + 1) & mask_;
+                }
+                slots_[i] = slot;
+            }
+        }
+    }
+
+    Arena arena_;
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_;
+};
+
+enum Op
+{
+    kGet,
+    kSet,
+    kDel,
+    kExists,
+    kIncr,
+};
+
+static void appendInteger(Buffer *out, long long value)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, ":%lld\r\n", value);
+    out->append(buf, n);
+}
+
+static void appendBulk(Buffer *out, const char *data, size_t len)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "$%zu\r\n", len);
+    out->ensureWriteableBytes(n + len + 2);
+    out->append(buf, n);
+    out->append(data, len);
+    out->append("\r\n", 2);
+}
+
+static void appendError(Buffer *out, const std::string &message)
+{
+    out->append("-ERR ", 5);
+    out->append(message);
+    out->append("\r\n", 2);
+}
+
+static bool parseInteger(const char *data, size_t len, long long *value)
+{
+    if (len == 0 || len > 20)
+    {
+        return false;
+    }
+    char buf[24];
+    memcpy(buf, data, len);
+    buf[len] = '\0';
+    char *end;
+    errno = 0;
+    *value = strtoll(buf, &end, 10);
+    return errno == 0 && end == buf + len && !isspace(static_cast<unsigned char>(buf[0]));
+}
+
+// 在分片上执行一条命令，应答追加到out 只能在分片所属的loop线程中调用
+static void executeOnShard(KvTable *table, Op op, uint64_t hash, const StringPiece &key,
+                           const StringPiece &value, Buffer *out)
+{
+    switch (op)
+    {
+    case kGet:
+    {
+        const Item *item = table->find(hash, key);
+        if (item != nullptr)
+        {
+            appendBulk(out, item->value(), item->valueLength);
+        }
+        else
+        {
+            out->append("$-1\r\n", 5);
+        }
+        break;
+    }
+    case kSet:
+        table->set(hash, key, value);
+        out->append("+OK\r\n", 5);
+        break;
+    case kDel:
+        appendInteger(out, table->erase(hash, key) ? 1 : 0);
+        break;
+    case kExists:
+        appendInteger(out, table->find(hash, key) != nullptr ? 1 : 0);
+        break;
+    case kIncr:
+    {
+        long long number = 0;
+        const Item *item = table->find(hash, key);
+        if ((item != nullptr && !parseInteger(item->value(), item->valueLength, &number)) || number == LLONG_MAX)
+        {
+            appendError(out, "value is not an integer or out of range");
+            break;
+        }
+        ++number;
+        char buf[32];
+        int n = snprintf(buf, sizeof buf, "%lld", number);
+        table->set(hash, key, StringPiece(buf, n));
+        appendInteger(out, number);
+        break;
+    }
+    }
+}
+
+struct Shard
+{
+    EventLoop *loop;
+    KvTable table;
+};
+
+// 发往同一个远端分片的一批命令 在目标loop中执行后，同一个对象带着全部应答回到连接所在的loop
+struct Batch
+{
+    struct Command
+    {
+        uint64_t seq;
+        uint64_t hash;
+        Op op;
+        uint32_t keyLength;
+        uint32_t valueLength;
+    };
+
+    TcpConnectionPtr conn;
+    std::string args;  // 所有命令的key和value依次首尾相接
+    std::vector<Command> commands;
+    Buffer replies;  // 应答依次首尾相接
+    std::vector<size_t> replyLengths;
+};
+
+using BatchPtr = std::shared_ptr<Batch>;
+
+/**
+ * 每个连接的状态 只在连接所在的loop线程中访问
+ * 每条命令按到达顺序编号，序号等于nextSend的应答直接写入输出缓冲区，先完成的应答在ready中等待
+ */
+struct Session
+{
+    Session(Shard *shard, size_t numShards)
+        : localShard(shard), batches(numShards), nextSeq(0), nextSend(0), closing(false)
+    {
+    }
+
+    Shard *localShard;
+    std::vector<StringPiece> args;    // 复用的参数数组 指向输入缓冲区
+    std::vector<BatchPtr> batches;    // 本次onMessage中按分片攒的远端命令
+    std::map<uint64_t, std::string> ready;
+    Buffer scratch;  // 乱序的本地应答先写到这里
+    uint64_t nextSeq;
+    uint64_t nextSend;
+    bool closing;  // 收到QUIT或者协议错误，剩下的应答发完后关闭连接
+};
+
+// 从[begin, end)中解析一条完整的命令，参数指向原数据
+// 返回命令占用的字节数，数据不完整返回0，协议错误返回-1并设置*error
+static ssize_t parseCommand(const char *begin, const char *end, std::vector<StringPiece> *args, const char **error)
+{
+    args->clear();
+    if (*begin != '*')
+    {
+        // inline命令: 一行以空白分隔的参数
+        const char *eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+        if (eol == nullptr)
+        {
+            if (static_cast<size_t>(end - begin) > kMaxInlineLength)
+            {
+                *error = "Protocol error: too big inline request";
+                return -1;
+            }
+            return 0;
+        }
+        const char *lineEnd = eol > begin && eol[-1] == '\r' ? eol - 1 : eol;
+        const char *p = begin;
+        while (p < lineEnd)
+        {
+            while (p < lineEnd && (*p == ' ' || *p == '\t'))
+            {
+                ++p;
+            }
+            const char *start = p;
+            while (p < lineEnd && *p != ' ' && *p != '\t')
+            {
+                ++p;
+            }
+            if (p > start)
+            {
+                args->push_back(StringPiece(start, p - start));
+            }
+        }
+        return eol + 1 - begin;
+    }
+
+    // 读取"<前缀><数字>\r\n"，返回下一行的开始位置，数据不完整返回nullptr
+    auto readLength = [end, error](const char *p, long long *value) -> const char * {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr)
+        {
+            if (static_cast<size_t>(end - p) > 32)
+            {
+                *error = "Protocol error: invalid length";
+            }
+            return nullptr;
+        }
+        if (eol[-1] != '\r' || !parseInteger(p + 1, eol - 1 - (p + 1), value))
+        {
+            *error = "Protocol error: invalid length";
+            return nullptr;
+        }
+        return eol + 1;
+    };
+
+    *error = nullptr;
+    long long count = 0;
+    const char *p = readLength(begin, &count);
+    if (p == nullptr)
+    {
+        return *error != nullptr ? -1 : 0;
+    }
+    if (count > static_cast<long long>(kMaxArgs))
+    {
+        *error = "Protocol error: invalid multibulk length";
+        return -1;
+    }
+    for (long long i = 0; i < count; ++i)
+    {
+        if (p == end)
+        {
+            return 0;
+        }
+        if (*p != '$')
+        {
+            *error = "Protocol error: expected '$'";
+            return -1;
+        }
+        long long len = 0;
+        p = readLength(p, &len);
+        if (p == nullptr)
+        {
+            return *error != nullptr ? -1 : 0;
+        }
+        if (len < 0 || len > static_cast<long long>(kMaxBulkLength))
+        {
+            *error = "Protocol error: invalid bulk length";
+            return -1;
+        }
+        if (end - p < len + 2)
+        {
+            return 0;
+        }
+        if (p[len] != '\r' || p[len + 1] != '\n')
+        {
+            *error = "Protocol error: bulk not terminated by CRLF";
+            return -1;
+        }
+        args->push_back(StringPiece(p, len));
+        p += len + 2;
+    }
+    return p - begin;
+}
+
+class KvServer : noncopyable
+{
+public:
+    KvServer(EventLoop *loop, const InetAddress &addr, int numThreads)
+        : server_(loop, addr, "KvServer")
+    {
+        server_.setThreadNumber(numThreads);
+        // 每个subloop线程启动时创建自己的分片，没有subloop时baseLoop拥有唯一的分片
+        server_.setThreadInitCallback([this](EventLoop *ioLoop) {
+            std::unique_ptr<Shard> shard(new Shard);
+            shard->loop = ioLoop;
+            std::lock_guard<std::mutex> lock(mutex_);
+            shards_.push_back(std::move(shard));
+        });
+        server_.setConnectionCallback(std::bind(&KvServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(std::bind(&KvServer::onMessage, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // start()返回时所有loop线程已经初始化完毕，之后shards_只读
+    void start() { server_.start(); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            Shard *local = nullptr;
+            for (auto &shard : shards_)
+            {
+                if (shard->loop == conn->getLoop())
+                {
+                    local = shard.get();
+                }
+            }
+            conn->setContext(std::make_shared<Session>(local, shards_.size()));
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        if (session->closing)
+        {
+            buf->retrieveAll();
+            return;
+        }
+
+        while (buf->readableBytes() > 0)
+        {
+            const char *error = nullptr;
+            ssize_t n = parseCommand(buf->peek(), buf->peek() + buf->readableBytes(), &session->args, &error);
+            if (n == 0)
+            {
+                break;
+            }
+            if (n < 0)
+            {
+                session->scratch.retrieveAll();
+                appendError(&session->scratch, error);
+                deliverScratch(conn, session, session->nextSeq++);
+                session->closing = true;
+                buf->retrieveAll();
+                break;
+            }
+            if (!session->args.empty())
+            {
+                dispatch(conn, session);
+            }
+            buf->retrieve(n);
+            if (session->closing)
+            {
+                buf->retrieveAll();
+                break;
+            }
+        }
+
+        // 每个远端分片投递一次
+        for (size_t i = 0; i < session->batches.size(); ++i)
+        {
+            if (session->batches[i])
+            {
+                Shard *target = shards_[i].get();
+                BatchPtr batch;
+                batch.swap(session->batches[i]);
+                target->loop->queueInLoop([target, batch]() { runBatch(target, batch); });
+            }
+        }
+        finishOutput(conn, session);
+    }
+
+    void dispatch(const TcpConnectionPtr &conn, Session *session)
+    {
+        const std::vector<StringPiece> &args = session->args;
+        const StringPiece &name = args[0];
+        uint64_t seq = session->nextSeq++;
+
+        Op op;
+        size_t arity;
+        if (name.equalsIgnoreCase("GET"))
+        {
+            op = kGet;
+            arity = 2;
+        }
+        else if (name.equalsIgnoreCase("SET"))
+        {
+            op = kSet;
+            arity = 3;
+        }
+        else if (name.equalsIgnoreCase("DEL"))
+        {
+            op = kDel;
+            arity = 2;
+        }
+        else if (name.equalsIgnoreCase("EXISTS"))
+        {
+            op = kExists;
+            arity = 2;
+        }
+        else if (name.equalsIgnoreCase("INCR"))
+        {
+            op = kIncr;
+            arity = 2;
+        }
+        else
+        {
+            // 不涉及key的命令在本地应答
+            Buffer *out = replyBuffer(conn, session, seq);
+            if (name.equalsIgnoreCase("PING") && args.size() <= 2)
+            {
+                if (args.size() == 2)
+                {
+                    appendBulk(out, args[1].data(), args[1].size());
+                }
+                else
+                {
+                    out->append("+PONG\r\n", 7);
+                }
+            }
+            else if (name.equalsIgnoreCase("ECHO") && args.size() == 2)
+            {
+                appendBulk(out, args[1].data(), args[1].size());
+            }
+            else if (name.equalsIgnoreCase("QUIT"))
+            {
+                out->append("+OK\r\n", 5);
+                session->closing = true;
+            }
+            else if (name.equalsIgnoreCase("COMMAND"))
+            {
+                // redis-cli连接时会发送COMMAND DOCS
+                out->append("*0\r\n", 4);
+            }
+            else
+            {
+                appendError(out, "unknown command or wrong number of arguments for '" + name.asString() + "'");
+            }
+            finishReply(conn, session, seq, out);
+            return;
+        }
+
+        if (args.size() != arity)
+        {
+            Buffer *out = replyBuffer(conn, session, seq);
+            appendError(out, "wrong number of arguments for '" + name.asString() + "' command");
+            finishReply(conn, session, seq, out);
+            return;
+        }
+
+        const StringPiece &key = args[1];
+        StringPiece value = arity == 3 ? args[2] : StringPiece();
+        uint64_t hash = hashKey(key.data(), key.size());
+        size_t index = (hash >> 32) % shards_.size();
+        Shard *shard = shards_[index].get();
+        if (shard == session->localShard)
+        {
+            Buffer *out = replyBuffer(conn, session, seq);
+            executeOnShard(&shard->table, op, hash, key, value, out);
+            finishReply(conn, session, seq, out);
+            return;
+        }
+
+        BatchPtr &batch = session->batches[index];
+        if (!batch)
+        {
+            batch = std::make_shared<Batch>();
+            batch->conn = conn;
+        }
+        batch->args.append(key.data(), key.size());
+        batch->args.append(value.data(), value.size());
+        batch->commands.push_back(Batch::Command{seq, hash, op, static_cast<uint32_t>(key.size()),
+                                                 static_cast<uint32_t>(value.size())});
+    }
+
+    // 轮到这个序号时直接写输出缓冲区，否则先写到scratch
+    static Buffer *replyBuffer(const TcpConnectionPtr &conn, Session *session, uint64_t seq)
+    {
+        if (seq == session->nextSend)
+        {
+            return conn->outputBuffer();
+        }
+        session->scratch.retrieveAll();
+        return &session->scratch;
+    }
+
+    static void finishReply(const TcpConnectionPtr &conn, Session *session, uint64_t seq, Buffer *out)
+    {
+        if (out == conn->outputBuffer())
+        {
+            ++session->nextSend;
+            drainReady(conn, session);
+        }
+        else
+        {
+            deliverScratch(conn, session, seq);
+        }
+    }
+
+    static void deliverScratch(const TcpConnectionPtr &conn, Session *session, uint64_t seq)
+    {
+        deliver(conn, session, seq, session->scratch.peek(), session->scratch.readableBytes());
+        session->scratch.retrieveAll();
+    }
+
+    static void deliver(const TcpConnectionPtr &conn, Session *session, uint64_t seq, const char *data, size_t len)
+    {
+        if (seq == session->nextSend)
+        {
+            conn->outputBuffer()->append(data, len);
+            ++session->nextSend;
+            drainReady(conn, session);
+        }
+        else
+        {
+            session->ready.emplace(seq, std::string(data, len));
+        }
+    }
+
+    static void drainReady(const TcpConnectionPtr &conn, Session *session)
+    {
+        while (!session->ready.empty() && session->ready.begin()->first == session->nextSend)
+        {
+            conn->outputBuffer()->append(session->ready.begin()->second);
+            session->ready.erase(session->ready.begin());
+            ++session->nextSend;
+        }
+    }
+
+    static void finishOutput(const TcpConnectionPtr &conn, Session *session)
+    {
+        conn->flushOutput();
+        if (session->closing && session->nextSend == session->nextSeq)
+        {
+            conn->shutdown();
+        }
+    }
+
+    // 在目标分片的loop线程中执行
+    static void runBatch(Shard *shard, const BatchPtr &batch)
+    {
+        const char *p = batch->args.data();
+        for (const Batch::Command &cmd : batch->commands)
+        {
+            StringPiece key(p, cmd.keyLength);
+            StringPiece value(p + cmd.keyLength, cmd.valueLength);
+            p += cmd.keyLength + cmd.valueLength;
+            size_t before = batch->replies.readableBytes();
+            executeOnShard(&shard->table, cmd.op, cmd.hash, key, value, &batch->replies);
+            batch->replyLengths.push_back(batch->replies.readableBytes() - before);
+        }
+        batch->conn->getLoop()->queueInLoop([batch]() { deliverBatch(batch); });
+    }
+
+    // 回到连接所在的loop线程中执行
+    static void deliverBatch(const BatchPtr &batch)
+    {
+        const TcpConnectionPtr &conn = batch->conn;
+        if (!conn->connected())
+        {
+            return;
+        }
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        const char *p = batch->replies.peek();
+        for (size_t i = 0; i < batch->commands.size(); ++i)
+        {
+            deliver(conn, session, batch->commands[i].seq, p, batch->replyLengths[i]);
+            p += batch->replyLengths[i];
+        }
+        finishOutput(conn, session);
+    }
+
+    TcpServer server_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;  // 按分片编号排列
+};
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(ERROR);
+
+    int numThreads = argc > 1 ? atoi(argv[1]) : 3;
+    uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 6379);
+
+    EventLoop loop;
+    KvServer server(&loop, InetAddress(port, "0.0.0.0"), numThreads);
+    server.start();
+    loop.loop();
+    return 0;
+}
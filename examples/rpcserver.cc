@@ -0,0 +1,48 @@
+#include <mymuduo/ComputePool.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/RpcServer.h>
+
+#include <ctype.h>
+
+#include <string>
+
+// RPC服务器 监听9090端口，帧格式见RpcCodec.h
+// echo: 原样返回请求
+// upper: 在计算线程池中把请求转成大写后返回，演示把RpcResponder交给其他线程延迟应答；
+//        调用方的期限已经过了就不再计算
+int main()
+{
+    Logger::setLogLevel(ERROR);
+
+    ComputePool pool;
+    pool.setThreadNum(2);
+    pool.start();
+
+    EventLoop loop;
+    RpcServer server(&loop, InetAddress(9090, "0.0.0.0"), "RpcServer-01");
+
+    server.registerMethod("echo", [](const StringPiece &request, const RpcResponder &responder) {
+        // request指向输入缓冲区，应答直接拷贝到输出缓冲区
+        responder.reply(request);
+    });
+    server.registerMethod("upper", [&pool](const StringPiece &request, const RpcResponder &responder) {
+        std::shared_ptr<std::string> text = std::make_shared<std::string>(request.asString());
+        pool.run([text, responder]() {
+            if (responder.expired())
+            {
+                responder.fail("deadline exceeded before processing");
+                return;
+            }
+            for (char &c : *text)
+            {
+                c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+            }
+            responder.reply(*text);
+        });
+    });
+    server.setThreadNumber(3);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,43 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/HttpServer.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/StaticFileHandler.h>
+
+#include <stdio.h>
+
+// 静态文件服务器 把命令行指定的目录通过8080端口提供出去
+// 例如: ./staticfileserver /var/www 然后 curl -r 0-99 http://127.0.0.1:8080/index.html
+// 指定证书和私钥时提供HTTPS: ./staticfileserver /var/www cert.pem key.pem 然后 curl -k https://127.0.0.1:8080/
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 4)
+    {
+        printf("usage: %s <root directory> [certificate.pem private-key.pem]\n", argv[0]);
+        return 1;
+    }
+    Logger::setLogLevel(ERROR);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(8080, "0.0.0.0"), "StaticFileServer-01");
+
+    // handle()可以在多个loop线程中同时调用，缓存由所有线程共享
+    StaticFileHandler handler(argv[1]);
+    server.setHttpCallback([&handler](const HttpRequest &req, HttpResponse *resp) { handler.handle(req, resp); });
+    if (argc == 4)
+    {
+        TlsOptions options;
+        options.certificateFile = argv[2];
+        options.privateKeyFile = argv[3];
+        TlsContextPtr context = TlsContext::newServerContext(options);
+        if (!context)
+        {
+            return 1;
+        }
+        // 内核支持kTLS时文件仍然通过sendfile发送，否则读出来加密后发送
+        server.setTlsContext(context);
+    }
+    server.setThreadNumber(3);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/UdpServer.h>
+
+#include <string>
+
+// UDP回显服务器 每个subLoop各有一个SO_REUSEPORT的socket，收到的数据报原样发回
+int main()
+{
+    EventLoop loop;
+    UdpServer server(&loop, InetAddress(8001), "UdpEchoServer-01");
+
+    server.setMessageCallback([](UdpChannel *channel,
+                                 const InetAddress &peer,
+                                 const char *data,
+                                 size_t len,
+                                 Timestamp time) {
+        // 回复先进入发送队列，这一批数据报处理完后用sendmmsg一起发送
+        channel->send(peer, data, len);
+    });
+    server.setThreadNumber(3);
+    server.start();
+    loop.loop();
+    return 0;
+}
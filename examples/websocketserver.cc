@@ -0,0 +1,44 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/HttpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <string>
+
+// WebSocket回显服务器 ws://127.0.0.1:8080/echo 把收到的消息原样发回，其他路径拒绝升级
+// 普通HTTP请求返回一个简单的页面
+int main()
+{
+    Logger::setLogLevel(ERROR);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(8080, "0.0.0.0"), "WebSocketServer-01");
+
+    server.setHttpCallback([](const HttpRequest &req, HttpResponse *resp) {
+        resp->setContentType("text/plain");
+        resp->setBody("connect to ws://host:8080/echo\n");
+    });
+    server.setWebSocketOpenCallback([](const HttpRequest &req, const WebSocketConnectionPtr &ws) {
+        if (req.path() != "/echo")
+        {
+            return false;
+        }
+        ws->sendText("welcome");
+        return true;
+    });
+    server.setWebSocketMessageCallback(
+        [](const WebSocketConnectionPtr &ws, const StringPiece &message, bool binary) {
+            // message指向输入缓冲区，发送时直接拷贝到输出缓冲区
+            if (binary)
+            {
+                ws->sendBinary(message);
+            }
+            else
+            {
+                ws->sendText(message);
+            }
+        });
+    server.setThreadNumber(3);
+    server.start();
+    loop.loop();
+    return 0;
+}